@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+
+#include <ipc/Connection.h>
+#include <services/Network.h>
+#include <stream/IStringStream.h>
+#include <stream/Serial.h>
+#include <util/Util.h>
+#include <Hip.h>
+#include <cstring>
+
+using namespace nre;
+
+static uint8_t frame[Network::MAX_FRAME_SIZE];
+
+static void build_frame(Network::mac_type dst, Network::mac_type src, size_t size) {
+    for(size_t i = 0; i < 6; ++i) {
+        frame[i] = dst >> (8 * (5 - i));
+        frame[6 + i] = src >> (8 * (5 - i));
+    }
+    // use an unassigned ethertype to make sure that nobody interprets the frames
+    frame[12] = 0x88;
+    frame[13] = 0xb5;
+    for(size_t i = Network::HEADER_SIZE; i < size; ++i)
+        frame[i] = i & 0xFF;
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = 100000;
+    size_t size = 1514;
+    for(int i = 1; i < argc; ++i) {
+        if(strncmp(argv[i], "count=", 6) == 0)
+            count = IStringStream::read_from<size_t>(argv[i] + 6);
+        else if(strncmp(argv[i], "size=", 5) == 0) {
+            size = IStringStream::read_from<size_t>(argv[i] + 5);
+            size = Math::max(Network::HEADER_SIZE, Math::min(size, Network::MAX_FRAME_SIZE));
+        }
+    }
+
+    // we create two ports and send frames from one to the other, so that the throughput of the
+    // switch is measured without any guest in between
+    Connection con("network");
+    NetworkSession a(con);
+    NetworkSession b(con);
+    Serial::get() << "Sending " << count << " frames of " << size << " bytes from "
+                  << fmt(a.mac(), "#0x", 12) << " to " << fmt(b.mac(), "#0x", 12) << "\n";
+
+    // let the switch learn the address of <b> first
+    build_frame(a.mac(), b.mac(), size);
+    b.send(frame, size);
+    a.consumer().get();
+    a.consumer().next();
+
+    build_frame(b.mac(), a.mac(), size);
+    Consumer<Network::Packet> &cons = b.consumer();
+    uint64_t bytes = 0;
+    size_t sent = 0, received = 0;
+    uint64_t start = Util::tsc();
+    // the switch drops frames if the receive ring of <b> is full. so, never have more frames in
+    // flight than fit into it, because we would wait forever for the dropped ones otherwise. this
+    // assumes that nobody else floods <b> in the meanwhile.
+    size_t window = cons.rblength() - 1;
+    while(received < count) {
+        while(sent < count && sent - received < window && a.send(frame, size))
+            sent++;
+        size_t n = cons.get_batch();
+        for(size_t i = 0; i < n; ++i) {
+            Network::Packet *pk = cons.item(i);
+            if(Network::src(pk->data) == a.mac()) {
+                bytes += pk->len;
+                received++;
+            }
+        }
+        cons.next(n);
+    }
+    uint64_t cycles = Util::tsc() - start;
+
+    // freq_tsc is in KHz
+    uint64_t mbits = (bytes * 8 * Hip::get().freq_tsc) / (cycles * 1000);
+    Serial::get() << "Received " << received << " frames (" << bytes << " bytes) in " << cycles
+                  << " cycles: " << (mbits / 1000) << "." << fmt(mbits % 1000, "0", 3)
+                  << " Gbit/s\n";
+    return 0;
+}
@@ -28,12 +28,13 @@ void PdInfoPage::refresh_console(bool) {
     // display header
     size_t memtotal, memfree;
     _sysinfo.get_mem(memtotal, memfree);
-    cs << fmt("Pd", MAX_NAME_LEN) << ": " << fmt("VirtMem", 24) << fmt("PhysMem", 24)
-       << fmt("Threads", 8) << "\n";
+    cs << fmt("Pd", MAX_NAME_LEN) << ": " << fmt("VirtMem", 20) << fmt("PhysMem", 20)
+       << fmt("Threads", 8) << fmt("Faults", 10) << "\n";
     for(uint i = 0; i < Console::COLS; i++)
         cs << '-';
 
     size_t totalthreads = 0;
+    size_t totalfaults = 0;
     size_t totalphys = 0;
     size_t totalvirt = 0;
     for(size_t idx = 0, c = 0; c < ROWS; ++c, ++idx) {
@@ -45,21 +46,22 @@ void PdInfoPage::refresh_console(bool) {
             size_t namelen = 0;
             const char *name = getname(c.cmdline(), namelen);
             cs << fmt(name, MAX_NAME_LEN, namelen) << ": "
-               << fmt(c.virt_mem() / 1024, 20) << " KiB"
-               << fmt(c.phys_mem() / 1024, 20) << " KiB"
-               << fmt(c.threads(), 8) << "\n";
+               << fmt(c.virt_mem() / 1024, 16) << " KiB"
+               << fmt(c.phys_mem() / 1024, 16) << " KiB"
+               << fmt(c.threads(), 8) << fmt(c.faults(), 10) << "\n";
         }
         totalvirt += c.virt_mem();
         totalphys += c.phys_mem();
         totalthreads += c.threads();
+        totalfaults += c.faults();
     }
 
     // display footer
     for(uint i = 0; i < Console::COLS; i++)
         cs << '-';
     cs << fmt("Total", MAX_NAME_LEN) << ": "
-       << fmt(totalvirt / 1024, 20) << " KiB"
-       << fmt(totalphys / 1024, 8) << " of " << fmt(memtotal / 1024, 8) << " KiB"
-       << fmt(totalthreads, 8) << "\n";
+       << fmt(totalvirt / 1024, 16) << " KiB"
+       << fmt(totalphys / 1024, 6) << " of " << fmt(memtotal / 1024, 6) << " KiB"
+       << fmt(totalthreads, 8) << fmt(totalfaults, 10) << "\n";
     display_footer(cs, 1);
 }
@@ -36,9 +36,13 @@ void test_regmng() {
         rm->free(0x200000, 0x1000);
         rm->free(0x280000, 0x2000);
 
+        // the best fitting region is used
         addr1 = rm->alloc(0x1000);
+        WVPASSEQ(addr1, static_cast<uintptr_t>(0x200000));
         addr2 = rm->alloc(0x2000);
+        WVPASSEQ(addr2, static_cast<uintptr_t>(0x280000));
         addr3 = rm->alloc(0x2000);
+        WVPASSEQ(addr3, static_cast<uintptr_t>(0x100000));
 
         rm->free(addr1, 0x1000);
         rm->free(addr2, 0x2000);
@@ -46,12 +50,12 @@ void test_regmng() {
 
         WVPASSEQ(rm->total_count(), static_cast<size_t>(0x6000));
         auto it = rm->begin();
-        WVPASSEQ(it->addr, static_cast<uintptr_t>(0x200000));
-        WVPASSEQ(it->size, static_cast<size_t>(0x1000));
-        ++it;
         WVPASSEQ(it->addr, static_cast<uintptr_t>(0x100000));
         WVPASSEQ(it->size, static_cast<size_t>(0x3000));
         ++it;
+        WVPASSEQ(it->addr, static_cast<uintptr_t>(0x200000));
+        WVPASSEQ(it->size, static_cast<size_t>(0x1000));
+        ++it;
         WVPASSEQ(it->addr, static_cast<uintptr_t>(0x280000));
         WVPASSEQ(it->size, static_cast<size_t>(0x2000));
     }
@@ -71,13 +75,39 @@ void test_regmng() {
         rm->free(addr2, 0x1000);
 
         auto it = rm->begin();
+        WVPASSEQ(it->addr, static_cast<uintptr_t>(0x100000));
+        WVPASSEQ(it->size, static_cast<size_t>(0x3000));
+        ++it;
         WVPASSEQ(it->addr, static_cast<uintptr_t>(0x200000));
         WVPASSEQ(it->size, static_cast<size_t>(0x1000));
         ++it;
         WVPASSEQ(it->addr, static_cast<uintptr_t>(0x280000));
         WVPASSEQ(it->size, static_cast<size_t>(0x2000));
-        ++it;
-        WVPASSEQ(it->addr, static_cast<uintptr_t>(0x100000));
+    }
+
+    {
+        ScopedPtr<RegionManager<>> rm(new RegionManager<>());
+        rm->free(0x1000, 0x5000);
+
+        // aligning leaves free space in front of and behind the allocation
+        addr1 = rm->alloc(0x1000, 0x4000);
+        WVPASSEQ(addr1, static_cast<uintptr_t>(0x4000));
+        auto it = rm->begin();
+        WVPASSEQ(it->addr, static_cast<uintptr_t>(0x1000));
         WVPASSEQ(it->size, static_cast<size_t>(0x3000));
+        ++it;
+        WVPASSEQ(it->addr, static_cast<uintptr_t>(0x5000));
+        WVPASSEQ(it->size, static_cast<size_t>(0x1000));
+
+        WVPASSEQ(rm->alloc_at(0x2000, 0x1000), static_cast<size_t>(0x1000));
+        WVPASSEQ(rm->total_count(), static_cast<size_t>(0x3000));
+
+        rm->free(0x2000, 0x1000);
+        rm->free(addr1, 0x1000);
+        it = rm->begin();
+        WVPASSEQ(it->addr, static_cast<uintptr_t>(0x1000));
+        WVPASSEQ(it->size, static_cast<size_t>(0x5000));
+        ++it;
+        WVPASS(it == rm->end());
     }
 }
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <util/TimeoutList.h>
+
+#include "TimeoutListTest.h"
+
+using namespace nre;
+using namespace nre::test;
+
+static void test_timeoutlist();
+static void count_expired(size_t nr, void *data);
+
+const TestCase timeoutlisttest = {
+    "Timeout list", test_timeoutlist
+};
+
+static size_t expired;
+
+static void count_expired(size_t, void *) {
+    expired++;
+}
+
+static void test_timeoutlist() {
+    // start small to force the list to grow
+    TimeoutList<void> l(2);
+    WVPASS(l.timeout() == ~0ULL);
+    WVPASSEQ(l.trigger(0), static_cast<size_t>(0));
+
+    size_t nrs[100];
+    for(size_t i = 0; i < ARRAY_SIZE(nrs); ++i)
+        nrs[i] = l.alloc();
+    for(size_t i = 0; i < ARRAY_SIZE(nrs); ++i) {
+        WVPASS(nrs[i] != 0);
+        // request them in an order that is neither sorted nor reversed
+        l.request(nrs[i], 1000 + (i * 37) % ARRAY_SIZE(nrs));
+    }
+    WVPASS(l.timeout() == 1000ULL);
+    WVPASSEQ(l.trigger(999), static_cast<size_t>(0));
+
+    // move the first one to the end and cancel the second one
+    l.request(nrs[0], 2000);
+    WVPASS(l.timeout() == 1001ULL);
+    WVPASS(l.cancel(nrs[73]));
+    WVPASS(!l.cancel(nrs[73]));
+    WVPASS(l.timeout() == 1002ULL);
+
+    // they have to be triggered in order
+    timevalue_t last = 0;
+    size_t count = 0;
+    for(size_t nr; (nr = l.trigger(1999)) != 0; ++count) {
+        timevalue_t to = l.timeout();
+        WVPASS(to >= last);
+        last = to;
+        l.cancel(nr);
+    }
+    WVPASSEQ(count, ARRAY_SIZE(nrs) - 2);
+    WVPASS(l.timeout() == 2000ULL);
+
+    // batch expiry
+    for(size_t i = 1; i < ARRAY_SIZE(nrs); ++i)
+        l.request(nrs[i], 3000 + i);
+    expired = 0;
+    WVPASSEQ(l.expire(3010, count_expired), static_cast<size_t>(11));
+    WVPASSEQ(expired, static_cast<size_t>(11));
+    WVPASS(l.timeout() == 3010ULL + 1);
+
+    // freed numbers are reused
+    WVPASS(l.dealloc(nrs[50], true));
+    WVPASS(!l.dealloc(nrs[50]));
+    WVPASSEQ(l.alloc(), nrs[50]);
+}
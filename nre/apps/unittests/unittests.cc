@@ -33,6 +33,7 @@
 #include "tests/MemOps.h"
 #include "tests/ThreadsTest.h"
 #include "tests/OStreamTest.h"
+#include "tests/TimeoutListTest.h"
 
 using namespace nre;
 using namespace nre::test;
@@ -63,6 +64,7 @@ const TestCase testcases[] = {
     treaptest_perf,
     ostream_writef,
     ostream_strops,
+    timeoutlisttest,
 };
 
 int main() {
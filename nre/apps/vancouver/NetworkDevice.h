@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <kobj/GlobalThread.h>
+#include <kobj/Sc.h>
+#include <services/Network.h>
+#include <stream/OStringStream.h>
+
+#include "bus/motherboard.h"
+#include "bus/message.h"
+
+/**
+ * Connects one network card of the guest to a port of the virtual switch
+ */
+class NetworkDevice {
+public:
+    explicit NetworkDevice(DBus<MessageNetwork> &bus, nre::Connection &con, size_t no)
+        : _no(no), _bus(bus), _sess(con) {
+        char buffer[32];
+        nre::OStringStream os(buffer, sizeof(buffer));
+        os << "vmm-network-" << no;
+        nre::GlobalThread *gt = nre::GlobalThread::create(
+            thread, nre::CPU::current().log_id(), buffer);
+        gt->set_tls<NetworkDevice*>(nre::Thread::TLS_PARAM, this);
+        gt->start();
+    }
+
+    nre::Network::mac_type mac() const {
+        return _sess.mac();
+    }
+    /**
+     * @return the session at the switch
+     */
+    const nre::NetworkSession &session() const {
+        return _sess;
+    }
+    /**
+     * Sends the given frame to the switch. The session does the locking.
+     */
+    bool send(const unsigned char *buffer, size_t len) {
+        if(len < nre::Network::HEADER_SIZE || len > nre::Network::MAX_FRAME_SIZE)
+            return false;
+        return _sess.send(buffer, len);
+    }
+
+private:
+    static void thread(void*) {
+        NetworkDevice *nd = nre::Thread::current()->get_tls<NetworkDevice*>(nre::Thread::TLS_PARAM);
+        nre::Consumer<nre::Network::Packet> &cons = nd->_sess.consumer();
+        for(size_t n; (n = cons.get_batch()) > 0; cons.next(n)) {
+            for(size_t i = 0; i < n; ++i) {
+                nre::Network::Packet *pk = cons.item(i);
+                size_t len = nre::Math::min(pk->len, nre::Network::MAX_FRAME_SIZE);
+                // the receiving models acquire their lock domain
+                MessageNetwork msg(pk->data, len, nd->_no, &nd->_sess);
+                nd->_bus.send(msg);
+            }
+        }
+    }
+
+    size_t _no;
+    DBus<MessageNetwork> &_bus;
+    nre::NetworkSession _sess;
+};
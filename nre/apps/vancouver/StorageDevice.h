@@ -18,6 +18,8 @@
 
 #include <kobj/GlobalThread.h>
 #include <kobj/Sc.h>
+#include <kobj/UserSm.h>
+#include <util/ScopedLock.h>
 #include <services/Storage.h>
 
 #include "bus/motherboard.h"
@@ -27,7 +29,7 @@ class StorageDevice {
 public:
     explicit StorageDevice(DBus<MessageDiskCommit> &bus, nre::DataSpace &guestmem,
                            nre::Connection &con, size_t no)
-        : _no(no), _bus(bus), _con(con), _sess(_con, guestmem, no) {
+        : _no(no), _bus(bus), _con(con), _sess(_con, guestmem, no), _sm() {
         char buffer[32];
         nre::OStringStream os(buffer, sizeof(buffer));
         os << "vmm-storage-" << no;
@@ -42,13 +44,16 @@ public:
     }
     void read(nre::Storage::tag_type tag, nre::Storage::sector_type sector,
               const nre::Storage::dma_type *dma) {
+        nre::ScopedLock<nre::UserSm> guard(&_sm);
         _sess.read(tag, sector, *dma);
     }
     void write(nre::Storage::tag_type tag, nre::Storage::sector_type sector,
                const nre::Storage::dma_type *dma) {
+        nre::ScopedLock<nre::UserSm> guard(&_sm);
         _sess.write(tag, sector, *dma);
     }
     void flush_cache(nre::Storage::tag_type tag) {
+        nre::ScopedLock<nre::UserSm> guard(&_sm);
         _sess.flush(tag);
     }
 
@@ -57,12 +62,11 @@ private:
         StorageDevice *sd = nre::Thread::current()->get_tls<StorageDevice*>(nre::Thread::TLS_PARAM);
         while(1) {
             nre::Storage::Packet *pk = sd->_sess.consumer().get();
-            // the status isn't used anyway
-            {
-                nre::ScopedLock<nre::UserSm> guard(&globalsm);
-                MessageDiskCommit msg(sd->_no, pk->tag, MessageDisk::DISK_OK);
-                sd->_bus.send(msg);
-            }
+            // the receiving models acquire their lock domain
+            MessageDisk::Status status = pk->status ? MessageDisk::DISK_STATUS_DEVICE
+                                                    : MessageDisk::DISK_OK;
+            MessageDiskCommit msg(sd->_no, pk->tag, status);
+            sd->_bus.send(msg);
             sd->_sess.consumer().next();
         }
     }
@@ -71,4 +75,6 @@ private:
     DBus<MessageDiskCommit> &_bus;
     nre::Connection &_con;
     nre::StorageSession _sess;
+    // the disk is used by the BIOS and the disk controllers, which don't share a lock domain
+    nre::UserSm _sm;
 };
@@ -34,23 +34,31 @@ void Timeouts::timer_thread(void*) {
 }
 
 void Timeouts::trigger() {
-    ScopedLock<UserSm> guard(&globalsm);
-    // TODO it can't be correct to not grab _sm here, because we might access stuff from
-    // different threads here. but if we grab it here, we deadlock ourself because the devices
-    // on the bus might call e.g. alloc().
     timevalue_t now = _mb.clock().source_time();
     // Force time reprogramming. Otherwise, we might not reprogram a
     // timer, if the timeout event reached us too early.
     _last_to = NO_TIMEOUT;
 
-    // trigger all timeouts that are due
-    size_t nr;
-    while((nr = _timeouts.trigger(now))) {
-        MessageTimeout msg(nr, _timeouts.timeout());
-        _timeouts.cancel(nr);
+    // trigger all timeouts that are due. note that we can't hold _sm while sending the message,
+    // because the devices on the bus might call e.g. request().
+    while(1) {
+        size_t nr;
+        timevalue_t to;
+        {
+            ScopedLock<UserSm> guard(&_sm);
+            if(!(nr = _timeouts.trigger(now)))
+                break;
+            to = _timeouts.timeout();
+            _timeouts.cancel(nr);
+        }
+        MessageTimeout msg(nr, to);
         _mb.bus_timeout.send(msg);
     }
-    program();
+
+    {
+        ScopedLock<UserSm> guard(&_sm);
+        program();
+    }
 }
 
 void Timeouts::program() {
@@ -26,8 +26,6 @@
 
 #include "bus/motherboard.h"
 
-extern nre::UserSm globalsm;
-
 class Timeouts {
     enum {
         NO_TIMEOUT  = ~0ULL
@@ -64,7 +62,7 @@ private:
 
     Motherboard &_mb;
     nre::UserSm _sm;
-    nre::TimeoutList<32, void> _timeouts;
+    nre::TimeoutList<void> _timeouts;
     nre::Connection _timercon;
     nre::TimerSession _timer;
     timevalue_t _last_to;
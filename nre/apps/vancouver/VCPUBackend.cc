@@ -75,11 +75,8 @@ void VCPUBackend::handle_io(bool is_in, unsigned io_order, unsigned port) {
     CpuMessage msg(is_in, reinterpret_cast<CpuState *>(Thread::current()->utcb()),
                    io_order, port, &uf->eax, uf->mtd);
     skip_instruction(msg);
-    {
-        ScopedLock<UserSm> guard(&globalsm);
-        if(!vcpu->executor.send(msg, true))
-            Util::panic("nobody to execute %s at %x:%x\n", __func__, msg.cpu->cs.sel, msg.cpu->eip);
-    }
+    if(!vcpu->executor.send(msg, true))
+        Util::panic("nobody to execute %s at %x:%x\n", __func__, msg.cpu->cs.sel, msg.cpu->eip);
     /* TODO if(service_events && !msg.consumed)
        service_events->send_event(*utcb,EventsProtocol::EVENT_UNSERVED_IOACCESS,sizeof(port),
        &port);*/
@@ -93,7 +90,10 @@ void VCPUBackend::handle_vcpu(capsel_t pid, bool skip, CpuMessage::Type type) {
     if(skip)
         skip_instruction(msg);
 
-    ScopedLock<UserSm> guard(&globalsm);
+    /**
+     * Note that we don't need a lock here: the VCPU state is only touched by this thread and
+     * the device models acquire their LockDomain themselves.
+     */
 
     /**
      * Send the message to the VCpu.
@@ -159,7 +159,7 @@ bool VCPUBackend::handle_memory(bool need_unmap) {
 
     // XXX use a push model on _startup instead
     // do we have not mapped physram yet?
-    if(_mb->bus_memregion.send(msg, true) && msg.ptr) {
+    if(_mb->bus_memregion.send_range(msg, msg.page, 1, true) && msg.ptr) {
         uintptr_t hostaddr = reinterpret_cast<uintptr_t>(msg.ptr);
         uintptr_t guestbase = msg.start_page << ExecEnv::PAGE_SHIFT;
         uintptr_t hotspot = uf->qual[1] - guestbase;
@@ -32,7 +32,6 @@ using namespace nre;
 static size_t ncpu = 1;
 static DataSpace *guest_mem = nullptr;
 static size_t guest_size = 0;
-nre::UserSm globalsm(0);
 
 PARAM_ALIAS(PC_PS2, "an alias to create an PS2 compatible PC",
             " mem:0,0xa0000 mem:0x100000 ioio nullio:0x80 pic:0x20,,0x4d0 pic:0xa0,2,0x4d1"
@@ -47,7 +46,8 @@ PARAM_HANDLER(ncpu, "ncpu - change the number of vcpus that are created") {
 PARAM_HANDLER(m, "m - specify the amount of memory for the guest in MiB") {
     guest_size = argv[0] * 1024 * 1024;
     guest_mem = new DataSpace(guest_size, DataSpaceDesc::ANONYMOUS,
-                              DataSpaceDesc::RWX | DataSpaceDesc::BIGPAGES, 0, 0,
+                              DataSpaceDesc::RWX | DataSpaceDesc::BIGPAGES |
+                              DataSpaceDesc::POPULATE, 0, 0,
                               Math::next_pow2_shift(ExecEnv::BIG_PAGE_SIZE) - ExecEnv::PAGE_SHIFT);
 }
 PARAM_HANDLER(vcpus, " vcpus - instantiate the vcpus defined with 'ncpu'") {
@@ -59,7 +59,6 @@ void Vancouver::reset() {
     Serial::get() << "RESET device state\n";
     MessageLegacy msg2(MessageLegacy::RESET, 0);
     _mb.bus_legacy.send_fifo(msg2);
-    globalsm.up();
 }
 
 bool Vancouver::receive(CpuMessage &msg) {
@@ -178,10 +177,13 @@ bool Vancouver::receive(MessageHostOp &msg) {
         }
         break;
 
-        case MessageHostOp::OP_GET_MAC:
-            assert(false);
-            // TODO res = !Sigma0Base::hostop(msg);
-            break;
+        case MessageHostOp::OP_GET_MAC: {
+            NetworkDevice *nd = get_netdev(msg.value);
+            if(nd)
+                msg.mac = nd->mac();
+            res = nd != nullptr;
+        }
+        break;
 
         case MessageHostOp::OP_ATTACH_MSI:
         case MessageHostOp::OP_ATTACH_IRQ: {
@@ -208,9 +210,7 @@ bool Vancouver::receive(MessageHostOp &msg) {
 
         case MessageHostOp::OP_VCPU_BLOCK: {
             VCPUBackend *v = reinterpret_cast<VCPUBackend*>(msg.value);
-            globalsm.up();
             v->sm().down();
-            globalsm.down();
             res = true;
         }
         break;
@@ -339,6 +339,36 @@ bool Vancouver::receive(MessageDisk &msg) {
     return false;
 }
 
+NetworkDevice *Vancouver::get_netdev(size_t no) {
+    if(no >= MAX_NETDEVS || !_netcon)
+        return nullptr;
+    if(!_netdevs[no]) {
+        try {
+            _netdevs[no] = new NetworkDevice(_mb.bus_network, *_netcon, no);
+        }
+        catch(const Exception &e) {
+            Serial::get() << "Network connect failed: " << e.msg() << "\n";
+        }
+    }
+    return _netdevs[no];
+}
+
+bool Vancouver::receive(MessageNetwork &msg) {
+    if(msg.client >= MAX_NETDEVS || !_netdevs[msg.client])
+        return false;
+    switch(msg.type) {
+        case MessageNetwork::PACKET:
+            // don't send the frames back that we deliver to the models
+            if(msg.session == &_netdevs[msg.client]->session())
+                return false;
+            return _netdevs[msg.client]->send(msg.buffer, msg.len);
+        case MessageNetwork::QUERY_MAC:
+            msg.mac = _netdevs[msg.client]->mac();
+            return true;
+    }
+    return false;
+}
+
 void Vancouver::keyboard_thread(void*) {
     Vancouver *vc = Thread::current()->get_tls<Vancouver*>(Thread::TLS_PARAM);
     while(1) {
@@ -368,7 +398,6 @@ void Vancouver::keyboard_thread(void*) {
             }
         }
 
-        ScopedLock<UserSm> guard(&globalsm);
         MessageInput msg(0x10000, pk.scancode | pk.flags);
         vc->_mb.bus_input.send(msg);
     }
@@ -399,7 +428,7 @@ void Vancouver::create_devices(const char *args) {
     _mb.bus_disk.add(this, receive_static<MessageDisk> );
     _mb.bus_timer.add(this, receive_static<MessageTimer> );
     _mb.bus_time.add(this, receive_static<MessageTime> );
-    // TODO _mb.bus_network.add(this,receive_static<MessageNetwork>);
+    _mb.bus_network.add(this, receive_static<MessageNetwork> );
     _mb.bus_hwpcicfg.add(this, receive_static<MessageHwPciConfig> );
     _mb.bus_acpi.add(this, receive_static<MessageAcpi> );
     _mb.bus_legacy.add(this, receive_static<MessageLegacy> );
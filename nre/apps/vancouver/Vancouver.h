@@ -26,15 +26,14 @@
 #include "bus/motherboard.h"
 #include "Timeouts.h"
 #include "StorageDevice.h"
+#include "NetworkDevice.h"
 #include "VCPUBackend.h"
 
-extern nre::UserSm globalsm;
-
 class Vancouver : public StaticReceiver<Vancouver> {
 public:
     explicit Vancouver(const char *args, size_t console, const nre::String &constitle)
         : _mb(), _timeouts(_mb), _conscon("console"), _conssess(_conscon, console, constitle),
-          _stcon(), _vmmngcon(), _vmmng(), _vcpus(), _stdevs() {
+          _stcon(), _netcon(), _vmmngcon(), _vmmng(), _vcpus(), _stdevs(), _netdevs() {
         // storage is optional
         try {
             _stcon = new nre::Connection("storage");
@@ -42,6 +41,13 @@ public:
         catch(const nre::Exception &e) {
             nre::Serial::get() << "Unable to connect to storage: " << e.msg() << "\n";
         }
+        // network is optional
+        try {
+            _netcon = new nre::Connection("network");
+        }
+        catch(const nre::Exception &e) {
+            nre::Serial::get() << "Unable to connect to network: " << e.msg() << "\n";
+        }
         create_devices(args);
         create_vcpus();
 
@@ -74,20 +80,26 @@ public:
     bool receive(MessageLegacy &msg);
     bool receive(MessageConsoleView &msg);
     bool receive(MessageDisk &msg);
+    bool receive(MessageNetwork &msg);
 
 private:
     static void keyboard_thread(void*);
     static void vmmng_thread(void*);
     void create_devices(const char *args);
     void create_vcpus();
+    NetworkDevice *get_netdev(size_t no);
+
+    static const size_t MAX_NETDEVS = 8;
 
     Motherboard _mb;
     Timeouts _timeouts;
     nre::Connection _conscon;
     nre::ConsoleSession _conssess;
     nre::Connection *_stcon;
+    nre::Connection *_netcon;
     nre::Connection *_vmmngcon;
     nre::VMManagerSession *_vmmng;
     nre::SList<VCPUBackend> _vcpus;
     StorageDevice *_stdevs[nre::Storage::MAX_CONTROLLER * nre::Storage::MAX_DRIVES];
+    NetworkDevice *_netdevs[MAX_NETDEVS];
 };
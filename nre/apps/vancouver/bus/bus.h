@@ -18,8 +18,66 @@
 #pragma once
 
 #include <stream/Serial.h>
+#include <kobj/Thread.h>
+#include <kobj/UserSm.h>
+#include <util/ScopedLock.h>
 #include <cstring>
 
+/**
+ * A lock domain protects the state of one or more device models. The models are called from
+ * multiple threads (the VCPUs, the timer-, storage- and input-threads), so that each model that
+ * has state declares the domain it belongs to and acquires it in its receive functions, after it
+ * has checked that the message is for it. Devices that talk to each other synchronously in both
+ * directions (e.g. the interrupt controllers) share one domain. The lock is recursive, because
+ * a model might receive a message that it has sent itself.
+ *
+ * To prevent deadlocks, the domains have to be acquired in the following order:
+ *  1. BIOS executors (vbios_disk, vbios_keyboard)
+ *  2. device domains (serial, disk controllers, keyboard controller, network, PCI passthrough)
+ *  3. Motherboard::irq_domain (PIC, IOAPIC, LAPIC, MSI, PIT, RTC, ...)
+ *  4. leaf domains (vga, hostsink), which never send messages to locked models
+ * That is, a model may only send messages to models in a later domain or its own domain while
+ * holding its lock. Note that this includes broadcast messages: a model that receives e.g.
+ * MessageLegacy or MessageMem from a later domain has to filter it before taking its lock.
+ */
+class LockDomain {
+public:
+    explicit LockDomain() : _sm(), _owner(), _depth() {
+    }
+
+    /**
+     * Acquires the domain. If the current thread holds it already, it just increases the depth.
+     */
+    void down() {
+        nre::Thread *cur = nre::Thread::current();
+        if(_owner == cur) {
+            _depth++;
+            return;
+        }
+        _sm.down();
+        _owner = cur;
+        _depth = 1;
+    }
+
+    /**
+     * Releases the domain, if this was the last nested acquisition.
+     */
+    void up() {
+        if(--_depth == 0) {
+            _owner = nullptr;
+            _sm.up();
+        }
+    }
+
+private:
+    LockDomain(const LockDomain&);
+    LockDomain& operator=(const LockDomain&);
+
+    nre::UserSm _sm;
+    nre::Thread *volatile _owner;
+    unsigned _depth;
+};
+
 /**
  * The generic Device used in generic bus transactions.
  */
@@ -49,6 +107,13 @@ public:
 
 /**
  * A bus is a way to connect devices.
+ *
+ * By default, a message is delivered to all devices on the bus. For buses that address a
+ * resource (I/O ports, physical memory, ...), devices can register the ranges they are
+ * responsible for and the sender can use send_range() to deliver the message only to the
+ * devices that cover the given address. For that purpose, the address space is split into
+ * segments at the range boundaries and each segment knows the devices that are interested in it.
+ * Devices without ranges are part of every segment.
  */
 template<class M>
 class DBus {
@@ -56,12 +121,28 @@ class DBus {
     struct Entry {
         Device *_dev;
         ReceiveFunction _func;
+        bool _ranged;
+    };
+    struct Range {
+        uintptr_t _base;
+        uintptr_t _end;
+        size_t _entry;
+    };
+    struct Segment {
+        uintptr_t _start;
+        size_t _first;
+        size_t _count;
     };
 
     unsigned long _debug_counter;
     size_t _list_count;
     size_t _list_size;
     struct Entry *_list;
+    size_t _range_count;
+    struct Range *_ranges;
+    size_t _seg_count;
+    struct Segment *_segs;
+    size_t *_seg_entries;
 
     /**
      * To avoid bugs we disallow the copy constuctor.
@@ -79,13 +160,127 @@ class DBus {
         _list_size = new_size;
     }
 
+    bool covers(size_t entry, uintptr_t addr) const {
+        if(!_list[entry]._ranged)
+            return true;
+        for(size_t i = 0; i < _range_count; i++) {
+            if(_ranges[i]._entry == entry && addr >= _ranges[i]._base && addr < _ranges[i]._end)
+                return true;
+        }
+        return false;
+    }
+
+    static void add_bound(uintptr_t *bounds, size_t &count, uintptr_t bound) {
+        size_t i = count;
+        for(; i > 0 && bounds[i - 1] > bound; i--)
+            ;
+        if(i > 0 && bounds[i - 1] == bound)
+            return;
+        memmove(bounds + i + 1, bounds + i, (count - i) * sizeof(*bounds));
+        bounds[i] = bound;
+        count++;
+    }
+
+    /**
+     * Recalculates the segments. This is only done during the creation of the devices, so that we
+     * don't care about the costs here.
+     */
+    void build_segments() {
+        uintptr_t *bounds = new uintptr_t[_range_count * 2 + 1];
+        size_t count = 0;
+        add_bound(bounds, count, 0);
+        for(size_t i = 0; i < _range_count; i++) {
+            add_bound(bounds, count, _ranges[i]._base);
+            add_bound(bounds, count, _ranges[i]._end);
+        }
+
+        Segment *segs = new Segment[count];
+        size_t *entries = new size_t[count * _list_count];
+        size_t total = 0;
+        for(size_t s = 0; s < count; s++) {
+            segs[s]._start = bounds[s];
+            segs[s]._first = total;
+            // keep the LIFO order of send()
+            for(size_t i = _list_count; i-- > 0; ) {
+                if(covers(i, bounds[s]))
+                    entries[total++] = i;
+            }
+            segs[s]._count = total - segs[s]._first;
+        }
+
+        delete[] bounds;
+        delete[] _segs;
+        delete[] _seg_entries;
+        _segs = segs;
+        _seg_entries = entries;
+        _seg_count = count;
+    }
+
+    size_t find_segment(uintptr_t addr) const {
+        // the first segment starts at 0, so that there is always one
+        size_t lo = 0, hi = _seg_count;
+        while(hi - lo > 1) {
+            size_t mid = lo + (hi - lo) / 2;
+            if(_segs[mid]._start <= addr)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
 public:
     void add(Device *dev, ReceiveFunction func) {
         if(_list_count >= _list_size)
             set_size(_list_size > 0 ? _list_size * 2 : 1);
         _list[_list_count]._dev = dev;
         _list[_list_count]._func = func;
+        _list[_list_count]._ranged = false;
         _list_count++;
+        if(_range_count)
+            build_segments();
+    }
+
+    /**
+     * Adds the given device, which is only interested in messages for the addresses
+     * <base> .. <base> + <count> - 1. The unit depends on the bus (e.g. ports or pages). A device
+     * may cover multiple ranges by calling this function multiple times with the same device and
+     * function. Note that devices are only selected by the range in send_range(); send() still
+     * delivers the message to all devices.
+     *
+     * @param dev the device
+     * @param func the receive function
+     * @param base the first address
+     * @param count the number of addresses
+     */
+    void add(Device *dev, ReceiveFunction func, uintptr_t base, size_t count) {
+        size_t entry = 0;
+        for(; entry < _list_count; entry++) {
+            if(_list[entry]._dev == dev && _list[entry]._func == func)
+                break;
+        }
+        if(entry == _list_count) {
+            if(_list_count >= _list_size)
+                set_size(_list_size > 0 ? _list_size * 2 : 1);
+            _list[_list_count]._dev = dev;
+            _list[_list_count]._func = func;
+            _list_count++;
+        }
+        _list[entry]._ranged = true;
+
+        Range *n = new Range[_range_count + 1];
+        if(_ranges) {
+            memcpy(n, _ranges, _range_count * sizeof(*_ranges));
+            delete[] _ranges;
+        }
+        _ranges = n;
+        // clamp the range at the end of the address space
+        uintptr_t end = base + count;
+        _ranges[_range_count]._base = base;
+        _ranges[_range_count]._end = end < base ? ~0UL : end;
+        _ranges[_range_count]._entry = entry;
+        _range_count++;
+        build_segments();
     }
 
     /**
@@ -99,6 +294,26 @@ public:
         return res;
     }
 
+    /**
+     * Send message LIFO to all devices that cover the addresses <addr> .. <addr> + <count> - 1
+     * or haven't registered a range at all.
+     */
+    bool send_range(M &msg, uintptr_t addr, size_t count, bool earlyout = false) {
+        if(!_seg_count)
+            return send(msg, earlyout);
+        size_t s = find_segment(addr);
+        // if the access crosses a segment boundary, we simply ask everybody
+        if(s + 1 < _seg_count && count > _segs[s + 1]._start - addr)
+            return send(msg, earlyout);
+
+        _debug_counter++;
+        bool res = false;
+        size_t *entries = _seg_entries + _segs[s]._first;
+        for(size_t i = 0; i < _segs[s]._count && !(earlyout && res); i++)
+            res |= _list[entries[i]]._func(_list[entries[i]]._dev, msg);
+        return res;
+    }
+
     /**
      * Send message in FIFO order
      */
@@ -145,6 +360,7 @@ public:
     }
 
     /** Default constructor. */
-    DBus() : _debug_counter(), _list_count(), _list_size(), _list() {
+    DBus() : _debug_counter(), _list_count(), _list_size(), _list(), _range_count(), _ranges(),
+             _seg_count(), _segs(), _seg_entries() {
     }
 };
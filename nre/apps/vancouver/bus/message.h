@@ -21,6 +21,7 @@
 
 #include <arch/Types.h>
 #include <services/Console.h>
+#include <services/Network.h>
 #include <services/Storage.h>
 #include <Compiler.h>
 #include <Desc.h>
@@ -828,12 +829,15 @@ struct MessageNetwork {
     };
 
     unsigned client;
+    // the session the frame has been received from or nullptr if a model sends it
+    const nre::NetworkSession *session;
 
-    MessageNetwork(const unsigned char *buffer, size_t len, unsigned client)
-        : type(PACKET), buffer(buffer), len(len), client(client) {
+    MessageNetwork(const unsigned char *buffer, size_t len, unsigned client,
+                   const nre::NetworkSession *session = nullptr)
+        : type(PACKET), buffer(buffer), len(len), client(client), session(session) {
     }
     MessageNetwork(unsigned type, unsigned client)
-        : type(type), mac(0), client(client) {
+        : type(type), mac(0), client(client), session(nullptr) {
     }
 };
 
@@ -81,6 +81,16 @@ public:
     //DBus<MessageVesa>			bus_vesa;
     VCVCpu *last_vcpu;
 
+    /**
+     * The lock domain of the interrupt controllers and the timers, which notify each other
+     * synchronously (interrupts and EOIs).
+     */
+    LockDomain irq_domain;
+    /**
+     * The lock domain of the keyboard controllers and the PS/2 devices behind them.
+     */
+    LockDomain input_domain;
+
     nre::Clock &clock() {
         return _clock;
     }
@@ -194,6 +204,6 @@ public:
         }
     }
 
-    Motherboard() : _clock(1000), last_vcpu(0) {
+    Motherboard() : _clock(1000), last_vcpu(0), irq_domain(), input_domain() {
     }
 };
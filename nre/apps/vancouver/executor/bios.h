@@ -89,7 +89,7 @@ protected:
      */
     void outb(unsigned short port, unsigned value) {
         MessageIOOut msg(MessageIOOut::TYPE_OUTB, port, value);
-        _mb.bus_ioout.send(msg);
+        _mb.bus_ioout.send_range(msg, port, 1);
     }
 
     BiosCommon(Motherboard &mb)
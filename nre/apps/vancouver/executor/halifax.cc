@@ -36,7 +36,7 @@ public:
         return true;
     }
 
-    Halifax(VCVCpu *vcpu) : InstructionCache(vcpu) {
+    Halifax(VCVCpu *vcpu, unsigned sets, unsigned ways) : InstructionCache(vcpu, sets, ways) {
         vcpu->executor.add(this, receive_static);
     }
     void *operator new(size_t size) {
@@ -45,8 +45,13 @@ public:
 };
 
 PARAM_HANDLER(halifax,
-              "halifax - create a halifax that emulatates instructions.") {
+              "halifax:sets,ways - create a halifax that emulatates instructions.",
+              "The instruction cache has 'sets' sets (default 64) of 'ways' entries (default 4).") {
     if(!mb.last_vcpu)
         throw Exception(E_NOT_FOUND, "no VCPU for this Halifax");
-    new Halifax(mb.last_vcpu);
+    unsigned long sets = argv[0] == ~0UL ? InstructionCache::DEFAULT_SETS : argv[0];
+    unsigned long ways = argv[1] == ~0UL ? InstructionCache::DEFAULT_WAYS : argv[1];
+    if(sets == 0 || sets > 0x10000 || ways == 0 || ways > 64)
+        VTHROW(Exception, E_ARGS_INVALID, "Invalid instruction cache size " << sets << "x" << ways);
+    new Halifax(mb.last_vcpu, sets, ways);
 }
@@ -19,6 +19,7 @@
 #pragma once
 
 #include <Desc.h>
+#include <util/Math.h>
 #include "../bus/helper.h"
 
 /**
@@ -93,6 +94,12 @@ struct InstructionCacheEntry {
     unsigned address_size;
     unsigned modrminfo;
     unsigned cs_ar;
+    unsigned cs_base;
+    unsigned cs_limit;
+    // the cache generation this entry has been decoded in (see InstructionCache::flush)
+    unsigned generation;
+    // the location of the instruction bytes in RAM or 0 if they are not in RAM
+    const char *code;
     unsigned prefixes;
     void __attribute__ ((regparm(3))) (*execute)(InstructionCache *instr, void *tmp_src,
                                                  void *tmp_dst);
@@ -133,15 +140,17 @@ class InstructionCache : public MemTlb {
         IC_MOFS = 1 << 10
     };
 
-    enum {
-        SIZE = 64, ASSOZ = 4
-    };
-
+    unsigned _sets_order;
+    unsigned _ways;
     unsigned _pos;
-    unsigned _tags[SIZE * ASSOZ];
-    InstructionCacheEntry _values[SIZE * ASSOZ];
+    unsigned _generation;
+    // the translation the cached entries have been decoded with
+    uintptr_t _cached_cr3;
+    unsigned _cached_paging;
+    unsigned *_tags;
+    InstructionCacheEntry *_values;
     unsigned slot(unsigned tag) {
-        return ((tag ^ (tag / SIZE)) % SIZE) * ASSOZ;
+        return ((tag ^ (tag >> _sets_order)) & ((1u << _sets_order) - 1)) * _ways;
     }
 
     // cpu state
@@ -180,39 +189,86 @@ class InstructionCache : public MemTlb {
             GP0;
         virt += READ(cs).base;
 
-        read_code(virt, len, entry->data + entry->inst_len);
+        const char *ram = 0;
+        read_code(virt, len, entry->data + entry->inst_len, &ram);
+        // remember where the instruction lives in RAM, as long as it is contiguous there
+        if(!entry->inst_len)
+            entry->code = ram;
+        else if(entry->code && ram != entry->code + entry->inst_len)
+            entry->code = 0;
         entry->inst_len += len;
         return _fault;
     }
 
+    /**
+     * Invalidates all entries. As an entry is only valid in the generation it has been decoded
+     * in, we don't need to touch them, unless the generation wraps around.
+     */
+    void flush() {
+        if(++_generation == 0) {
+            memset(_values, 0, sizeof(*_values) * (_ways << _sets_order));
+            _generation = 1;
+        }
+    }
+
+    /**
+     * Flushes the cache if cr3 or the paging mode have changed since the last instruction. The
+     * entries are unlikely to be of use afterwards. This is no correctness measure, because we
+     * can't notice cr3 reloads or invlpg that the guest executed natively. Therefore, find_entry
+     * translates the address again on every hit.
+     */
+    void check_translation() {
+        unsigned mode = paging_mode();
+        uintptr_t cr3 = (mode & 0x80000000) ? READ(cr3) : 0;
+        if(cr3 != _cached_cr3 || mode != _cached_paging) {
+            flush();
+            _cached_cr3 = cr3;
+            _cached_paging = mode;
+        }
+    }
+
     /**
      * Find a cache entry for the given state and checks whether it is
      * still valid.
      */
     bool find_entry(unsigned &index) {
         unsigned cs_ar = READ(cs).ar;
-        unsigned linear = _cpu->eip + READ(cs).base;
-        for(size_t i = slot(linear); i < slot(linear) + ASSOZ; i++) {
-            if(linear == _tags[i] && _values[i].inst_len) {
-                InstructionCacheEntry tmp;
-                tmp.inst_len = 0;
-                // revalidate entries
-                if(fetch_code(&tmp, _values[i].inst_len))
-                    return false;
-
-                // either code modified or two entries with different bases?
-                if(memcmp(tmp.data, _values[i].data, _values[i].inst_len)
-                   || cs_ar != _values[i].cs_ar)
-                    continue;
-                index = i;
-                //COUNTER_INC("I$ ok");
-                return true;
+        unsigned cs_base = READ(cs).base;
+        unsigned cs_limit = READ(cs).limit;
+        unsigned linear = _cpu->eip + cs_base;
+        unsigned first = slot(linear);
+        for(unsigned i = first; i < first + _ways; i++) {
+            InstructionCacheEntry *e = _values + i;
+            if(linear != _tags[i] || !e->inst_len || e->generation != _generation)
+                continue;
+            // two entries with different segments?
+            if(cs_ar != e->cs_ar || cs_base != e->cs_base || cs_limit != e->cs_limit)
+                continue;
+
+            // the guest might have changed the mapping or the rights of the page natively or
+            // modified the code without us noticing, e.g. via DMA. thus, we translate the address
+            // again, which raises the fault the guest expects, and compare the location and the
+            // bytes with the ones the entry has been decoded from.
+            InstructionCacheEntry tmp;
+            tmp.inst_len = 0;
+            tmp.code = 0;
+            if(fetch_code(&tmp, e->inst_len))
+                return false;
+            if(tmp.code != e->code || memcmp(tmp.data, e->data, e->inst_len)) {
+                e->inst_len = 0;
+                continue;
             }
+            index = i;
+            //COUNTER_INC("I$ ok");
+            return true;
         }
         // allocate new invalid entry
-        index = slot(linear) + (_pos++ % ASSOZ);
+        index = first + (_pos++ % _ways);
         memset(_values + index, 0, sizeof(*_values));
         _values[index].cs_ar = cs_ar;
+        _values[index].cs_base = cs_base;
+        _values[index].cs_limit = cs_limit;
+        _values[index].generation = _generation;
         _values[index].prefixes = 0x8300; // default is to use the DS segment
         _tags[index] = linear;
         return false;
@@ -260,6 +316,7 @@ public:
     int get_instruction() {
         //COUNTER_INC("INSTR");
         unsigned index = 0;
+        check_translation();
         if(!find_entry(index) && !_fault) {
             _entry = _values + index;
             _entry->address_size = _entry->operand_size = ((_entry->cs_ar >> 10) & 1) + 1;
@@ -572,8 +629,23 @@ public:
         msg.mtr_out = _mtr_out;
     }
 
-    InstructionCache(VCVCpu *vcpu)
-        : MemTlb(vcpu->mem, vcpu->memregion), _pos(), _tags(), _values(), _vcpu(vcpu), _entry(),
+    enum {
+        DEFAULT_SETS = 64, DEFAULT_WAYS = 4
+    };
+
+    /**
+     * Creates an instruction cache with <sets> sets of <ways> entries each. The number of sets is
+     * rounded up to the next power of two.
+     */
+    InstructionCache(VCVCpu *vcpu, unsigned sets = DEFAULT_SETS, unsigned ways = DEFAULT_WAYS)
+        : MemTlb(vcpu->mem, vcpu->memregion), _sets_order(nre::Math::next_pow2_shift(sets)),
+          _ways(ways), _pos(), _generation(1), _cached_cr3(), _cached_paging(),
+          _tags(new unsigned[ways << _sets_order]()),
+          _values(new InstructionCacheEntry[ways << _sets_order]()), _vcpu(vcpu), _entry(),
           _oeip(), _oesp(), _ointr_state(), _dr6(), _dr(), _fpustate() {
     }
+    ~InstructionCache() {
+        delete[] _values;
+        delete[] _tags;
+    }
 };
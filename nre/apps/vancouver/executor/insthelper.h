@@ -465,7 +465,8 @@ int helper_MOV__EDX__CR0() {
     _mtr_out |= nre::Mtd::CR;
 
     // XXX flush only if paging-bits change
-    // update TLB
+    // update TLB and drop the decoded instructions, because even reloading cr3 flushes the TLB
+    flush();
     return init();
 }
 
@@ -925,6 +926,8 @@ int helper_INT(unsigned char vector) {
     return idt_traversal(0x80000600 | vector,0);
 }
 int helper_INVLPG() {
+    // we don't cache translations apart from the instruction cache
+    flush();
     return _fault;
 }
 int helper_FWAIT() {
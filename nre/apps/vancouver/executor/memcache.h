@@ -255,6 +255,17 @@ public:
         }
     }
 
+    /**
+     * @return true if <entry> refers to RAM directly instead of to one of the MMIO buffers
+     */
+    bool is_direct(const CacheEntry *entry) const {
+        for(size_t i = 0; i < BUFFERS; i++) {
+            if(entry == _buffers + i)
+                return false;
+        }
+        return true;
+    }
+
     /**
      * Invalidate the cache, thus writeback the buffers.
      */
@@ -194,15 +194,18 @@ protected:
     }
 
     /**
-     * Read the len instruction-bytes at the given address into a buffer.
+     * Read the len instruction-bytes at the given address into a buffer. If <ram> is given, it
+     * is set to the location of the bytes in RAM or to 0 if they are not in RAM.
      */
-    int read_code(uintptr_t virt, size_t len, void *buffer) {
+    int read_code(uintptr_t virt, size_t len, void *buffer, const char **ram = 0) {
         assert(len < 16);
         CacheEntry *entry = find_virtual(virt & ~3, (len + (virt & 3) + 3) & ~3ul,
                                          user_access(Type(TYPE_X | TYPE_R)));
         if(entry) {
             assert(len <= entry->_len);
             memcpy(buffer, entry->_ptr + (virt & 3), len);
+            if(ram)
+                *ram = is_direct(entry) ? entry->_ptr + (virt & 3) : 0;
         }
         else
         // fix CR2 value as we rounded down
@@ -211,6 +214,13 @@ protected:
         return _fault;
     }
 
+    /**
+     * @return the paging mode, i.e. the paging-related bits of cr0, cr4 and efer
+     */
+    unsigned paging_mode() const {
+        return _paging_mode;
+    }
+
     int prepare_virtual(uintptr_t virt, size_t len, Type type, void *&ptr) {
         bool round = (virt | len) & 3;
         CacheEntry *entry = find_virtual(virt & ~3ul, (len + (virt & 3) + 3) & ~3ul,
@@ -40,6 +40,8 @@ class VirtualBiosDisk : public StaticReceiver<VirtualBiosDisk>, public BiosCommo
         DISK_COUNT = 0x75,
         WAKEUP_IRQ = 1,
     };
+    // protects _diskop_inprogress against the completion and timeout of the disk operation
+    LockDomain _domain;
     unsigned _timer;
     Storage::Parameter _disk_params[MAX_DISKS];
     size_t _disk_count;
@@ -246,6 +248,7 @@ public:
      */
     bool receive(MessageDiskCommit &msg) {
         if(msg.usertag == MAGIC_DISK_TAG) {
+            ScopedLock<LockDomain> guard(&_domain);
             write_bda(DISK_COMPLETION_CODE, msg.status, 1);
             if(_diskop_inprogress) {
                 _diskop_inprogress = false;
@@ -262,6 +265,7 @@ public:
      */
     bool receive(MessageTimeout &msg) {
         if(msg.nr == _timer) {
+            ScopedLock<LockDomain> guard(&_domain);
             if(_diskop_inprogress) {
                 // a timeout happened
                 Serial::get().writef("BIOS disk timeout\n");
@@ -278,6 +282,7 @@ public:
     }
 
     bool receive(MessageBios &msg) {
+        ScopedLock<LockDomain> guard(&_domain);
         switch(msg.irq) {
             case 0x13:
                 return handle_int13(msg);
@@ -297,8 +302,9 @@ public:
         }
     }
 
-    VirtualBiosDisk(Motherboard &mb) : BiosCommon(mb), _timer(), _disk_params(), _disk_count(~0u),
-                                       _diskop_inprogress() {
+    VirtualBiosDisk(Motherboard &mb)
+        : BiosCommon(mb), _domain(), _timer(), _disk_params(), _disk_count(~0u),
+          _diskop_inprogress() {
         mb.bus_diskcommit.add(this, VirtualBiosDisk::receive_static<MessageDiskCommit> );
         mb.bus_timeout.add(this, VirtualBiosDisk::receive_static<MessageTimeout> );
 
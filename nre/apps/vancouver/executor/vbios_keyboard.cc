@@ -32,6 +32,9 @@ using namespace nre;
  * Missing: shift state in bda.
  */
 class VirtualBiosKeyboard : public StaticReceiver<VirtualBiosKeyboard>, public BiosCommon {
+    // protects the keyboard buffer in the BDA, which is filled by the host keyboard and drained
+    // by the VCPUs via INT 16h
+    LockDomain _domain;
     Motherboard *_hostmb;
     unsigned _lastkey;
 
@@ -137,6 +140,7 @@ class VirtualBiosKeyboard : public StaticReceiver<VirtualBiosKeyboard>, public B
     bool handle_int16(MessageBios &msg) {
         CpuState *cpu = msg.cpu;
         COUNTER_INC("int16");
+        ScopedLock<LockDomain> guard(&_domain);
         unsigned short next = read_bda(0x1a);
         unsigned short first = read_bda(0x1c);
         unsigned short start = read_bda(0x80);
@@ -190,6 +194,7 @@ public:
      */
     bool receive(MessageInput &msg) {
         if(msg.device == 0x10) {
+            ScopedLock<LockDomain> guard(&_domain);
             update_status(msg.data);
             unsigned value = keycode2bios(msg.data);
             unsigned short next = read_bda(0x1a);
@@ -248,11 +253,11 @@ public:
      * Forward IO messages to the device models and vice-versa.
      */
     bool receive(MessageIOIn &msg) {
-        return _mb.bus_ioin.send(msg);
+        return _mb.bus_ioin.send_range(msg, msg.port, 1 << msg.type);
     }
 
     bool receive(MessageIOOut &msg) {
-        return _mb.bus_ioout.send(msg);
+        return _mb.bus_ioout.send_range(msg, msg.port, 1 << msg.type);
     }
 
     bool receive(MessageBios &msg) {
@@ -284,7 +289,8 @@ public:
         return true;
     }
 
-    VirtualBiosKeyboard(Motherboard &mb) : BiosCommon(mb), _hostmb(new Motherboard()), _lastkey() {
+    VirtualBiosKeyboard(Motherboard &mb) : BiosCommon(mb), _domain(), _hostmb(new Motherboard()),
+          _lastkey() {
         _hostmb->bus_input.add(this, receive_static<MessageInput> );
         _hostmb->bus_hostop.add(this, receive_static<MessageHostOp> );
         _hostmb->bus_hwioin.add(this, receive_static<MessageHwIOIn> );
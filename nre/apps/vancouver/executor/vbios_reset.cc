@@ -128,7 +128,7 @@ class VirtualBiosReset : public StaticReceiver<VirtualBiosReset>, public BiosCom
         memset(_resources, 0, sizeof(_resources));
 
         MessageMemRegion msg3(0);
-        check1(false, !_mb.bus_memregion.send(msg3) || !msg3.ptr || !msg3.count,
+        check1(false, !_mb.bus_memregion.send_range(msg3, msg3.page, 1) || !msg3.ptr || !msg3.count,
                "no low memory available");
 
         // were we start to allocate stuff
@@ -59,9 +59,10 @@ class AhciPort : public FisReceiver {
 #    include "reg.h"
 
 public:
-    void set_parent(ParentIrqProvider *parent, DBus<MessageMemRegion> *bus_memregion,
-                    DBus<MessageMem> *bus_mem) {
+    void set_parent(ParentIrqProvider *parent, LockDomain *domain,
+                    DBus<MessageMemRegion> *bus_memregion, DBus<MessageMem> *bus_mem) {
         _parent = parent;
+        _domain = domain;
         _bus_memregion = bus_memregion;
         _bus_mem = bus_mem;
     }
@@ -131,7 +132,7 @@ public:
         if(_drive)
             return true;
         _drive = drive;
-        _drive->set_peer(this);
+        _drive->set_peer(this, _domain);
 
         comreset();
         return false;
@@ -297,6 +298,7 @@ class AhciController : public ParentIrqProvider, public StaticReceiver<AhciContr
     };
     DBus<MessageIrqLines> &_bus_irqlines;
     DBus<MessageMem> &_bus_mem;
+    LockDomain _domain;
     unsigned char _irq;
     AhciPort _ports[MAX_PORTS];
     uint32_t _bdf;
@@ -321,7 +323,7 @@ public:
                 // MSI?
                 if(PCI_MSI_CTRL & 0x10000) {
                     MessageMem msg(false, PCI_MSI_ADDR, &PCI_MSI_DATA);
-                    _bus_mem.send(msg);
+                    _bus_mem.send_range(msg, msg.phys, 4);
                 }
                 else {
                     MessageIrqLines msg(MessageIrq::ASSERT_IRQ, _irq);
@@ -336,6 +338,8 @@ public:
         if(!match_bar(addr) || !(PCI_CMD_STS & 0x2))
             return false;
 
+        ScopedLock<LockDomain> guard(&_domain);
+
         assert(!(addr & 0x3));
 
         bool res;
@@ -358,6 +362,7 @@ public:
     }
 
     bool receive(MessageAhciSetDrive &msg) {
+        ScopedLock<LockDomain> guard(&_domain);
         if(msg.port > MAX_PORTS || _ports[msg.port].set_drive(msg.drive))
             return false;
 
@@ -378,13 +383,15 @@ public:
     }
 
     bool receive(MessagePciConfig &msg) {
+        ScopedLock<LockDomain> guard(&_domain);
         return PciHelper::receive(msg, this, _bdf);
     }
 
     AhciController(Motherboard &mb, unsigned char irq, uint32_t bdf)
-        : _bus_irqlines(mb.bus_irqlines), _bus_mem(mb.bus_mem), _irq(irq), _ports(), _bdf(bdf) {
+        : _bus_irqlines(mb.bus_irqlines), _bus_mem(mb.bus_mem), _domain(), _irq(irq), _ports(),
+          _bdf(bdf) {
         for(size_t i = 0; i < MAX_PORTS; i++)
-            _ports[i].set_parent(this, &mb.bus_memregion, &mb.bus_mem);
+            _ports[i].set_parent(this, &_domain, &mb.bus_memregion, &mb.bus_mem);
         PCI_reset();
         AhciController_reset();
     }
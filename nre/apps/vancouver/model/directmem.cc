@@ -81,6 +81,7 @@ PARAM_HANDLER(mio,
         Util::panic("can not map IOMEM region %lx+%lx", msg.value, msg.len);
 
     DirectMemDevice *dev = new DirectMemDevice(msg.ptr, dest, 1 << size);
-    mb.bus_memregion.add(dev, DirectMemDevice::receive_static<MessageMemRegion> );
-    mb.bus_mem.add(dev, DirectMemDevice::receive_static<MessageMem> );
+    mb.bus_memregion.add(dev, DirectMemDevice::receive_static<MessageMemRegion>, dest >> 12,
+                         (1 << size) >> 12);
+    mb.bus_mem.add(dev, DirectMemDevice::receive_static<MessageMem>, dest, 1 << size);
 }
@@ -30,6 +30,7 @@ using namespace nre;
  * Features: printf output, buffering, overflow indication
  */
 class HostSink : public StaticReceiver<HostSink> {
+    LockDomain _domain;
     unsigned _hdev;
     size_t _size;
     size_t _count;
@@ -42,6 +43,7 @@ public:
     bool receive(MessageSerial &msg) {
         if(msg.serial != _hdev)
             return false;
+        ScopedLock<LockDomain> guard(&_domain);
         if(msg.ch == '\r')
             return true;
         if(msg.ch == '\n' || _count == _size) {
@@ -59,8 +61,8 @@ public:
     }
 
     HostSink(unsigned hdev, size_t size, ulong head_char, ulong cont_char)
-        : _hdev(hdev), _size(size), _count(0), _overflow(false), _head_char(), _cont_char(),
-          _buffer() {
+        : _domain(), _hdev(hdev), _size(size), _count(0), _overflow(false), _head_char(),
+          _cont_char(), _buffer() {
         if((size == ~0UL) || (size < 1))
             size = 1;
         _head_char = (head_char == ~0UL) ? '#' : head_char;
@@ -49,6 +49,7 @@ private:
 #    include "reg.h"
     DBus<MessageDisk> &_bus_disk;
     DBus<MessageIrqLines> &_bus_irqlines;
+    LockDomain _domain;
     unsigned char _irq;
     uint32_t _bdf;
     size_t _disknr;
@@ -215,8 +216,13 @@ public:
         if(msg.disknr != _disknr)
             return false;
 
-        // XXX abort command
-        assert(!msg.status);
+        ScopedLock<LockDomain> guard(&_domain);
+        if(msg.status) {
+            _status = (_status & ~0x89) | 1;
+            _error |= 4; // abort
+            update_irq(true);
+            return true;
+        }
         // some operation completed, clear the busy flag and set the DRQ on reads
         switch(_command) {
             case 0x20: // READ_SECTOR
@@ -236,6 +242,7 @@ public:
             unsigned port = msg.port & ~PCI_BAR0_mask;
             if(port and msg.type != MessageIOIn::TYPE_INB)
                 return false;
+            ScopedLock<LockDomain> guard(&_domain);
             switch(port) {
                 case 0:
                     if(_bufferoffset >= 512)
@@ -273,6 +280,7 @@ public:
         // alternate status register
         if(!((msg.port ^ PCI_BAR1) & PCI_BAR1_mask) and msg.type == MessageIOIn::TYPE_INB
            and ((msg.port & ~PCI_BAR1_mask) == 2)) {
+            ScopedLock<LockDomain> guard(&_domain);
             LOG("alternate status %x\n", _status);
             msg.value = _status;
             return true;
@@ -285,6 +293,7 @@ public:
             unsigned port = msg.port & ~PCI_BAR0_mask;
             if(port and msg.type != MessageIOOut::TYPE_OUTB)
                 return false;
+            ScopedLock<LockDomain> guard(&_domain);
             //Logging::printf("out<%d>[%d] = %x\n", msg.type, port, msg.value);
             switch(port) {
                 case 0:
@@ -312,6 +321,7 @@ public:
         }
         if(!((msg.port ^ PCI_BAR1) & PCI_BAR1_mask) and msg.type == MessageIOOut::TYPE_OUTB
            and ((msg.port & ~PCI_BAR1_mask) == 2)) {
+            ScopedLock<LockDomain> guard(&_domain);
             // toggle reset?
             if((_control & 4) && (~msg.value & 4))
                 reset_device();
@@ -323,12 +333,14 @@ public:
     }
 
     bool receive(MessagePciConfig &msg) {
+        ScopedLock<LockDomain> guard(&_domain);
         return PciHelper::receive(msg, this, _bdf);
     }
 
     IdeController(DBus<MessageDisk> &bus_disk, DBus<MessageIrqLines> &bus_irqlines, unsigned char irq,
                   uint32_t bdf, size_t disknr, Storage::Parameter params, char *buffer, uintptr_t baddr)
-        : _bus_disk(bus_disk), _bus_irqlines(bus_irqlines), _irq(irq), _bdf(bdf), _disknr(disknr),
+        : _bus_disk(bus_disk), _bus_irqlines(bus_irqlines), _domain(), _irq(irq), _bdf(bdf),
+          _disknr(disknr),
           _params(params), _dma(), _command(), _error(), _status(), _control(), _buffer(buffer),
           _baddr(baddr), _bufferoffset(0) {
         PCI_reset();
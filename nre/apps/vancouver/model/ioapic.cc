@@ -162,7 +162,7 @@ private:
                     value |= 1 << 14;
 
                 MessageMem mem(false, phys, &value);
-                _mb.bus_mem.send(mem);
+                _mb.bus_mem.send_range(mem, mem.phys, 4);
                 if(!level)
                     notify(pin);
             }
@@ -207,6 +207,7 @@ public:
         // all IOApics should get the broadcast EOI from the LAPIC
         if(!in_range(msg.phys, _base, 0x100) && msg.phys != MessageApic::IOAPIC_EOI)
             return false;
+        ScopedLock<LockDomain> guard(&_mb.irq_domain);
 
         switch(msg.phys & 0xff) {
             case OFFSET_INDEX:
@@ -238,12 +239,14 @@ public:
     bool receive(MessageIrq &msg) {
         if(!in_range(msg.line, _gsibase, PINS))
             return false;
+        ScopedLock<LockDomain> guard(&_mb.irq_domain);
         COUNTER_INC("GSI");
         pin_assert(irq_routing(msg.line), msg.type);
         return true;
     }
 
     bool receive(MessageLegacy &msg) {
+        ScopedLock<LockDomain> guard(&_mb.irq_domain);
         if(!_gsibase) {
             if(msg.type == MessageLegacy::INTR)
                 return pin_assert(EXTINT_PIN, MessageIrq::ASSERT_IRQ);
@@ -280,7 +283,8 @@ public:
         : _mb(mb), _base(base), _gsibase(gsibase), _index(), _id(), _redir(), _rirr(), _ds(),
           _notify() {
         reset();
-        _mb.bus_mem.add(this, receive_static<MessageMem> );
+        _mb.bus_mem.add(this, receive_static<MessageMem>, _base, 0x100);
+        _mb.bus_mem.add(this, receive_static<MessageMem>, MessageApic::IOAPIC_EOI, 4);
         _mb.bus_irqlines.add(this, receive_static<MessageIrqLines> );
         _mb.bus_legacy.add(this, receive_static<MessageLegacy> );
         _mb.bus_discovery.add(this, discover);
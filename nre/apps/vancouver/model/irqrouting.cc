@@ -41,7 +41,7 @@ public:
             MessageMem msg1(false, MessageMem::MSI_ADDRESS, &_msi_vector);
             MessageIrqLines msg2(msg.type, _guest_irq);
             if(_msi_vector >= 0x10 && _msi_vector < 0x100)
-                _mb.bus_mem.send(msg1);
+                _mb.bus_mem.send_range(msg1, msg1.phys, 4);
             return _mb.bus_irqlines.send(msg2);
         }
         return false;
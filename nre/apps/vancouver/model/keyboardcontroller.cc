@@ -71,6 +71,7 @@ class KeyboardController : public StaticReceiver<KeyboardController> {
     DBus<MessageIrqLines> &_bus_irqlines;
     DBus<MessagePS2> &_bus_ps2;
     DBus<MessageLegacy> &_bus_legacy;
+    LockDomain &_domain;
     unsigned short _base;
     unsigned _irqkbd;
     unsigned _irqaux;
@@ -164,8 +165,10 @@ class KeyboardController : public StaticReceiver<KeyboardController> {
 
 public:
     bool receive(MessageIOIn &msg) {
-        if(msg.type != MessageIOIn::TYPE_INB)
+        if(msg.type != MessageIOIn::TYPE_INB || (msg.port != _base && msg.port != _base + 4))
             return false;
+
+        ScopedLock<LockDomain> guard(&_domain);
         if(msg.port == _base) {
             msg.value = _ram[RAM_OBF];
             _ram[RAM_STATUS] &= ~STATUS_AUXOBF;
@@ -180,8 +183,10 @@ public:
     }
 
     bool receive(MessageIOOut &msg) {
-        if(msg.type != MessageIOOut::TYPE_OUTB)
+        if(msg.type != MessageIOOut::TYPE_OUTB || (msg.port != _base && msg.port != _base + 4))
             return false;
+
+        ScopedLock<LockDomain> guard(&_domain);
         if(msg.port == _base) {
             if(~_ram[RAM_STATUS] & STATUS_NO_INHB)
                 return true;
@@ -312,12 +317,14 @@ public:
     bool receive(MessagePS2 &msg) {
         if(!in_range(msg.port, _ps2ports, 2) || msg.type != MessagePS2::NOTIFY)
             return false;
+        ScopedLock<LockDomain> guard(&_domain);
         read_all_devices();
         return true;
     }
 
     bool receive(MessageLegacy &msg) {
         if(msg.type == MessageLegacy::RESET) {
+            ScopedLock<LockDomain> guard(&_domain);
             memset(_ram, 0, sizeof(_ram));
             _ram[RAM_CMDBYTE] = CMD_IRQKBD | CMD_TRANSLATE;
             _ram[RAM_STATUS] = STATUS_NO_INHB;
@@ -327,11 +334,10 @@ public:
     }
 
     KeyboardController(DBus<MessageIrqLines> &bus_irqlines, DBus<MessagePS2> &bus_ps2,
-                       DBus<MessageLegacy> &bus_legacy, unsigned short base, unsigned irqkbd,
-                       unsigned irqaux,
-                       unsigned ps2ports)
-        : _bus_irqlines(bus_irqlines), _bus_ps2(bus_ps2), _bus_legacy(bus_legacy), _base(base),
-          _irqkbd(irqkbd), _irqaux(irqaux), _ps2ports(ps2ports), _ram() {
+                       DBus<MessageLegacy> &bus_legacy, LockDomain &domain, unsigned short base,
+                       unsigned irqkbd, unsigned irqaux, unsigned ps2ports)
+        : _bus_irqlines(bus_irqlines), _bus_ps2(bus_ps2), _bus_legacy(bus_legacy), _domain(domain),
+          _base(base), _irqkbd(irqkbd), _irqaux(irqaux), _ps2ports(ps2ports), _ram() {
     }
 };
 
@@ -343,9 +349,12 @@ PARAM_HANDLER(
 {
     static unsigned kbc_count;
     KeyboardController *dev = new KeyboardController(mb.bus_irqlines, mb.bus_ps2, mb.bus_legacy,
-                                                     argv[0], argv[1], argv[2], 2 * kbc_count++);
-    mb.bus_ioin.add(dev, KeyboardController::receive_static<MessageIOIn> );
-    mb.bus_ioout.add(dev, KeyboardController::receive_static<MessageIOOut> );
+                                                     mb.input_domain, argv[0], argv[1], argv[2],
+                                                     2 * kbc_count++);
+    mb.bus_ioin.add(dev, KeyboardController::receive_static<MessageIOIn>, argv[0], 1);
+    mb.bus_ioin.add(dev, KeyboardController::receive_static<MessageIOIn>, argv[0] + 4, 1);
+    mb.bus_ioout.add(dev, KeyboardController::receive_static<MessageIOOut>, argv[0], 1);
+    mb.bus_ioout.add(dev, KeyboardController::receive_static<MessageIOOut>, argv[0] + 4, 1);
     mb.bus_ps2.add(dev, KeyboardController::receive_static<MessagePS2> );
     mb.bus_legacy.add(dev, KeyboardController::receive_static<MessageLegacy> );
 }
@@ -377,7 +377,7 @@ private:
             return;
 
         MessageMem msg(false, MessageApic::IOAPIC_EOI, &vector);
-        _mb.bus_mem.send(msg);
+        _mb.bus_mem.send_range(msg, msg.phys, 4);
     }
 
     /**
@@ -599,6 +599,7 @@ public:
             return false;
         if((msg.phys & 0xf) || (msg.phys & 0xfff) >= 0x400)
             return false;
+        ScopedLock<LockDomain> guard(&_mb.irq_domain);
 
         if(msg.read)
             register_read((msg.phys >> 4) & 0x3f, *msg.ptr);
@@ -626,7 +627,10 @@ public:
      * Timeout for the APIC timer.
      */
     bool receive(MessageTimeout &msg) {
-        if(hw_disabled() || msg.nr != _timer)
+        if(msg.nr != _timer)
+            return false;
+        ScopedLock<LockDomain> guard(&_mb.irq_domain);
+        if(hw_disabled())
             return false;
 
         // no need to call update timer here, as the CPU needs to do an
@@ -639,6 +643,7 @@ public:
      * Receive an IPI.
      */
     bool receive(MessageApic &msg) {
+        ScopedLock<LockDomain> guard(&_mb.irq_domain);
         if(!accept_message(msg))
             return false;
         assert(!(msg.icr & ~0xcfff));
@@ -665,6 +670,7 @@ public:
      * Receive INTA cycle or RESET from the CPU.
      */
     bool receive(LapicEvent &msg) {
+        ScopedLock<LockDomain> guard(&_mb.irq_domain);
         if(!hw_disabled() && msg.type == LapicEvent::INTA) {
             unsigned irrv = prioritize_irq();
 
@@ -699,6 +705,7 @@ public:
      */
     bool receive(CpuMessage &msg) {
         if(msg.type == CpuMessage::TYPE_RDMSR) {
+            ScopedLock<LockDomain> guard(&_mb.irq_domain);
             msg.mtr_out |= Mtd::GPR_ACDB;
 
             // handle APIC base MSR
@@ -730,6 +737,7 @@ public:
 
         // WRMSR
         if(msg.type == CpuMessage::TYPE_WRMSR) {
+            ScopedLock<LockDomain> guard(&_mb.irq_domain);
 
             // handle APIC base MSR
             if(msg.cpu->ecx == 0x1b)
@@ -765,6 +773,7 @@ public:
      * Legacy pins.
      */
     bool receive(MessageLegacy &msg) {
+        ScopedLock<LockDomain> guard(&_mb.irq_domain);
         // the legacy PIC output is level triggered and wired to LINT0
         if(msg.type == MessageLegacy::INTR) {
             _lvtds[_LINT0_offset - LVT_BASE] = true;
@@ -70,6 +70,8 @@ PARAM_HANDLER(mem,
     Serial::get().writef("physmem: %lx %p [%lx, %lx]\n", msg.value, msg.ptr, start, end);
     MemoryController *dev = new MemoryController(msg.ptr, start, end);
     // physmem access
-    mb.bus_mem.add(dev, MemoryController::receive_static<MessageMem> );
-    mb.bus_memregion.add(dev, MemoryController::receive_static<MessageMemRegion> );
+    size_t size = end > start ? end - start : 0;
+    mb.bus_mem.add(dev, MemoryController::receive_static<MessageMem>, start, size);
+    mb.bus_memregion.add(dev, MemoryController::receive_static<MessageMemRegion>, start >> 12,
+                         (end >> 12) - (start >> 12));
 }
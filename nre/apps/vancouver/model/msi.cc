@@ -30,6 +30,7 @@ using namespace nre;
  */
 class Msi : public StaticReceiver<Msi> {
     DBus<MessageApic> & _bus_apic;
+    LockDomain &_domain;
     unsigned _lowest_rr;
 
 public:
@@ -37,6 +38,7 @@ public:
         if(!in_range(msg.phys, MessageMem::MSI_ADDRESS, 1 << 20))
             return false;
 
+        ScopedLock<LockDomain> guard(&_domain);
         COUNTER_INC("MSI");
         uintptr_t dst = ((msg.phys >> 12) & 0xff) | ((msg.phys << 4) & 0xff00);
         unsigned icr = *msg.ptr & 0xc7ff;
@@ -60,11 +62,13 @@ public:
         return _bus_apic.send(msg1);
     }
 
-    Msi(DBus<MessageApic> &bus_apic) : _bus_apic(bus_apic), _lowest_rr() {
+    Msi(DBus<MessageApic> &bus_apic, LockDomain &domain)
+        : _bus_apic(bus_apic), _domain(domain), _lowest_rr() {
     }
 };
 
 PARAM_HANDLER(msi,
               "msi - provide MSI support by forwarding access to 0xfee00000 to the LocalAPICs.") {
-    mb.bus_mem.add(new Msi(mb.bus_apic), Msi::receive_static<MessageMem> );
+    mb.bus_mem.add(new Msi(mb.bus_apic, mb.irq_domain), Msi::receive_static<MessageMem>,
+                   MessageMem::MSI_ADDRESS, 1 << 20);
 }
@@ -47,5 +47,6 @@ public:
 PARAM_HANDLER(nullmem,
               "nullmem:<range> - ignore Memory access to the given physical address range.",
               "Example: 'nullmem:0xfee00000,0x1000'.") {
-    mb.bus_mem.add(new NullMemDevice(argv[0], argv[1]), NullMemDevice::receive_static<MessageMem> );
+    mb.bus_mem.add(new NullMemDevice(argv[0], argv[1]), NullMemDevice::receive_static<MessageMem>,
+                   argv[0], argv[1]);
 }
@@ -45,6 +45,7 @@ class DirectPciDevice : public StaticReceiver<DirectPciDevice>, public HostVfPci
     };
 
     Motherboard &_mb;
+    LockDomain _domain;
     unsigned _hostbdf;
     unsigned _guestbdf;
     unsigned _irq_count;
@@ -230,6 +231,7 @@ public:
     bool receive(MessagePciConfig &msg)
     {
         if(msg.bdf != _guestbdf) return false;
+        ScopedLock<LockDomain> guard(&_domain);
 
         assert(msg.dword < PCI_CFG_SPACE_DWORDS);
         if(msg.type == MessagePciConfig::TYPE_READ) {
@@ -276,6 +278,7 @@ public:
     {
         for(unsigned i = 0; i < _irq_count; i++)
             if(_host_irqs[i] == msg.line) {
+            ScopedLock<LockDomain> guard(&_domain);
 
                 // MSI enabled?
                 if(_msi_cap && _cfgspace[_msi_cap] & 0x10000) {
@@ -289,13 +292,13 @@ public:
                     if(i < multiple_msgs) msi_data |= i;
 
                     MessageMem msg2(false, msi_address, &msi_data);
-                    return _mb.bus_mem.send(msg2);
+                    return _mb.bus_mem.send_range(msg2, msg2.phys, 4);
                 }
 
                 // MSI-X enabled?
                 if(_cfgspace[_msix_cap] >> 31 && _msix_table) {
                     MessageMem msg2(false, _msix_table[i].address, &_msix_table[i].data);
-                    return _mb.bus_mem.send(msg2);
+                    return _mb.bus_mem.send_range(msg2, msg2.phys, 4);
                 }
 
                 // we send a single GSI
@@ -321,6 +324,7 @@ public:
     {
         unsigned *ptr;
         if(!match_bars(msg.phys, 4, ptr)) return false;
+        ScopedLock<LockDomain> guard(&_domain);
         if(msg.read) {
             COUNTER_INC("PCID::READ");
             *msg.ptr = *ptr;
@@ -396,8 +400,8 @@ public:
                     unsigned parent_bdf = 0, unsigned vf_no = 0,
                     bool map = true)
         : HostVfPci(mb.bus_hwpcicfg,
-                    mb.bus_hostop), _mb(mb), _hostbdf(hbdf), _msix_table(0), _msix_host_table(0),
-          _bar_count(count_bars(_hostbdf))
+                    mb.bus_hostop), _mb(mb), _domain(), _hostbdf(hbdf), _msix_table(0),
+          _msix_host_table(0), _bar_count(count_bars(_hostbdf))
     {
 
         _vf = parent_bdf != 0;
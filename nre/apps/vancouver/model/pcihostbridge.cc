@@ -258,13 +258,13 @@ PARAM_HANDLER(pcihostbridge,
 
     // ioport interface
     if(~argv[2]) {
-        mb.bus_ioin.add(dev, PciHostBridge::receive_static<MessageIOIn> );
-        mb.bus_ioout.add(dev, PciHostBridge::receive_static<MessageIOOut> );
+        mb.bus_ioin.add(dev, PciHostBridge::receive_static<MessageIOIn>, argv[2], 8);
+        mb.bus_ioout.add(dev, PciHostBridge::receive_static<MessageIOOut>, argv[2], 8);
     }
 
     // MMCFG interface
     if(~argv[3]) {
-        mb.bus_mem.add(dev, PciHostBridge::receive_static<MessageMem> );
+        mb.bus_mem.add(dev, PciHostBridge::receive_static<MessageMem>, argv[3], argv[1] << 20);
         mb.bus_discovery.add(dev, PciHostBridge::discover);
     }
 
@@ -48,6 +48,7 @@ class PicDevice : public StaticReceiver<PicDevice> {
     DBus<MessagePic> &_bus_pic;
     DBus<MessageLegacy> &_bus_legacy;
     DBus<MessageIrqNotify> &_bus_notify;
+    LockDomain &_domain;
     unsigned short _base;
     unsigned _upstream_irq;
     unsigned short _elcr_base;
@@ -189,6 +190,7 @@ public:
     bool receive(MessageLegacy &msg) {
         if(msg.type != MessageLegacy::INTA)
             return false;
+        ScopedLock<LockDomain> guard(&_domain);
         unsigned char vec;
         get_irqvector(vec);
         msg.value = vec;
@@ -202,6 +204,7 @@ public:
     bool receive(MessagePic &msg) {
         // get irq vector if slave and addr match
         if(is_slave() && (msg.slave == (_icw[ICW3] & 7))) {
+            ScopedLock<LockDomain> guard(&_domain);
             get_irqvector(msg.vector);
             propagate_irq(false);
             return true;
@@ -213,6 +216,7 @@ public:
         if((!in_range(msg.port, _base,
                       2) && msg.port != _elcr_base) || msg.type != MessageIOIn::TYPE_INB)
             return false;
+        ScopedLock<LockDomain> guard(&_domain);
 
         if(msg.port == _elcr_base)
             msg.value = _elcr;
@@ -237,6 +241,7 @@ public:
         if((!in_range(msg.port, _base,
                       2) && msg.port != _elcr_base) || msg.type != MessageIOOut::TYPE_OUTB)
             return false;
+        ScopedLock<LockDomain> guard(&_domain);
 
         if(msg.port == _elcr_base)
             _elcr = msg.value;
@@ -300,11 +305,11 @@ public:
     }
 
     /**
-     * Raise the an irqline. This function needs to be multi-entrance
-     * ready! It should only touch the _irr.
+     * Raise the an irqline.
      */
     bool receive(MessageIrqLines &msg) {
         if(in_range(msg.line, _virq, 8)) {
+            ScopedLock<LockDomain> guard(&_domain);
             unsigned char irq = 1 << (msg.line - _virq);
             if(msg.type == MessageIrq::ASSERT_NOTIFY)
                 Atomic::bit_or(&_notify, irq);
@@ -330,12 +335,13 @@ public:
     }
 
     PicDevice(DBus<MessageIrqLines> &bus_irq, DBus<MessagePic> &bus_pic,
-              DBus<MessageLegacy> &bus_legacy, DBus<MessageIrqNotify> &bus_notify, unsigned short base,
-              unsigned char irq, unsigned short elcr_base, unsigned char virq)
+              DBus<MessageLegacy> &bus_legacy, DBus<MessageIrqNotify> &bus_notify,
+              LockDomain &domain, unsigned short base, unsigned char irq, unsigned short elcr_base,
+              unsigned char virq)
         : _bus_irq(bus_irq), _bus_pic(bus_pic), _bus_legacy(bus_legacy), _bus_notify(bus_notify),
-          _base(base), _upstream_irq(irq), _elcr_base(elcr_base), _virq(virq), _icw(),
-          _icw_mode(OCW1), _rotate_on_aeoi(), _smm(), _read_isr_reg(), _poll_mode(), _prio_lowest(),
-          _imr(), _isr(), _irr(), _elcr(), _notify() {
+          _domain(domain), _base(base), _upstream_irq(irq), _elcr_base(elcr_base), _virq(virq),
+          _icw(), _icw_mode(OCW1), _rotate_on_aeoi(), _smm(), _read_isr_reg(), _poll_mode(),
+          _prio_lowest(), _imr(), _isr(), _irr(), _elcr(), _notify() {
         _icw[ICW1] = 0;
         reset_values();
     }
@@ -350,9 +356,13 @@ PARAM_HANDLER(pic,
               "parameter specifies the io address of the ELCR register") {
     static unsigned virq;
     PicDevice *dev = new PicDevice(mb.bus_irqlines, mb.bus_pic, mb.bus_legacy, mb.bus_irqnotify,
-                                   argv[0], argv[1], argv[2], virq);
-    mb.bus_ioin.add(dev, PicDevice::receive_static<MessageIOIn> );
-    mb.bus_ioout.add(dev, PicDevice::receive_static<MessageIOOut> );
+                                   mb.irq_domain, argv[0], argv[1], argv[2], virq);
+    mb.bus_ioin.add(dev, PicDevice::receive_static<MessageIOIn>, argv[0], 2);
+    mb.bus_ioout.add(dev, PicDevice::receive_static<MessageIOOut>, argv[0], 2);
+    if(argv[2] != ~0UL) {
+        mb.bus_ioin.add(dev, PicDevice::receive_static<MessageIOIn>, argv[2], 1);
+        mb.bus_ioout.add(dev, PicDevice::receive_static<MessageIOOut>, argv[2], 1);
+    }
     mb.bus_irqlines.add(dev, PicDevice::receive_static<MessageIrqLines> );
     mb.bus_pic.add(dev, PicDevice::receive_static<MessagePic> );
     if(!virq)
@@ -65,6 +65,7 @@ class PitCounter : public StaticReceiver<PitCounter> {
     timevalue _start;
     DBus<MessageTimer> * _bus_timer;
     DBus<MessageIrqLines> * _bus_irq;
+    LockDomain *_domain;
     unsigned _irq;
     Clock _clock;
     unsigned _timer;
@@ -302,6 +303,7 @@ public:
     bool receive(MessageIrqNotify &msg) {
         if(msg.baseirq != (_irq & ~7) || !(msg.mask & (1 << (_irq & 7))))
             return false;
+        ScopedLock<LockDomain> guard(_domain);
         if(feature(FPERIODIC))
             update_timer();
         return true;
@@ -317,9 +319,11 @@ public:
         return false;
     }
 
-    PitCounter(DBus<MessageTimer> *bus_timer, DBus<MessageIrqLines> *bus_irq, unsigned irq, Clock &clock)
+    PitCounter(DBus<MessageTimer> *bus_timer, DBus<MessageIrqLines> *bus_irq, LockDomain *domain,
+               unsigned irq, Clock &clock)
         : _modus(), _latch(), _new_counter(), _initial(), _latched_status(), _start(0),
-          _bus_timer(bus_timer), _bus_irq(bus_irq), _irq(irq), _clock(clock), _timer(0) {
+          _bus_timer(bus_timer), _bus_irq(bus_irq), _domain(domain), _irq(irq), _clock(clock),
+          _timer(0) {
         assert(_clock.source_freq() != 0);
         if(_irq != ~0U) {
             MessageTimer msg0;
@@ -328,7 +332,7 @@ public:
             _timer = msg0.nr;
         }
     }
-    PitCounter() : _clock(0) {
+    PitCounter() : _domain(), _clock(0) {
     }
 };
 
@@ -339,9 +343,13 @@ public:
  */
 class PitDevice : public StaticReceiver<PitDevice> {
     friend class PitTest;
+public:
+    static const unsigned COUNTER = 3;
+
+private:
+    LockDomain &_domain;
     unsigned short _base;
     unsigned _addr;
-    static const unsigned COUNTER = 3;
     PitCounter _c[COUNTER];
 
 public:
@@ -349,6 +357,7 @@ public:
     bool receive(MessagePit &msg) {
         if(!in_range(msg.pit, _addr, COUNTER))
             return false;
+        ScopedLock<LockDomain> guard(&_domain);
         switch(msg.type) {
             case MessagePit::GET_OUT:
                 msg.value = _c[msg.pit - _addr].get_out();
@@ -366,6 +375,7 @@ public:
     bool receive(MessageIOIn &msg) {
         if(!in_range(msg.port, _base, COUNTER) || msg.type != MessageIOIn::TYPE_INB)
             return false;
+        ScopedLock<LockDomain> guard(&_domain);
         msg.value = _c[msg.port - _base].read();
         return true;
     }
@@ -373,6 +383,7 @@ public:
     bool receive(MessageIOOut &msg) {
         if(!in_range(msg.port, _base, COUNTER + 1) || msg.type != MessageIOOut::TYPE_OUTB)
             return false;
+        ScopedLock<LockDomain> guard(&_domain);
         if(msg.port == _base + COUNTER) {
             if((msg.value & 0xc0) == 0xc0) {
                 for(size_t i = 0; i < COUNTER; i++) {
@@ -390,9 +401,10 @@ public:
     }
 
     PitDevice(Motherboard &mb, unsigned short base, unsigned irq, unsigned pit)
-        : _base(base), _addr(pit * COUNTER), _c() {
+        : _domain(mb.irq_domain), _base(base), _addr(pit * COUNTER), _c() {
         for(size_t i = 0; i < COUNTER; i++) {
-            _c[i] = PitCounter(&mb.bus_timer, &mb.bus_irqlines, i ? ~0U : irq, mb.clock());
+            _c[i] = PitCounter(&mb.bus_timer, &mb.bus_irqlines, &mb.irq_domain, i ? ~0U : irq,
+                               mb.clock());
             if(!i)
                 mb.bus_irqnotify.add(&_c[i], PitCounter::receive_static<MessageIrqNotify> );
             if(!i)
@@ -408,7 +420,8 @@ PARAM_HANDLER(pit,
     static unsigned pit_count;
     PitDevice *dev = new PitDevice(mb, argv[0], argv[1], pit_count++);
 
-    mb.bus_ioin.add(dev, PitDevice::receive_static<MessageIOIn> );
-    mb.bus_ioout.add(dev, PitDevice::receive_static<MessageIOOut> );
+    mb.bus_ioin.add(dev, PitDevice::receive_static<MessageIOIn>, argv[0], PitDevice::COUNTER);
+    mb.bus_ioout.add(dev, PitDevice::receive_static<MessageIOOut>, argv[0],
+                     PitDevice::COUNTER + 1);
     mb.bus_pit.add(dev, PitDevice::receive_static<MessagePit> );
 }
@@ -35,6 +35,7 @@ using namespace nre;
  */
 class PS2Keyboard : public StaticReceiver<PS2Keyboard> {
     DBus<MessagePS2> &_bus_ps2;
+    LockDomain &_domain;
     unsigned _ps2port;
     unsigned _hostkeyboard;
     unsigned char _scset;
@@ -165,6 +166,7 @@ public:
         if(msg.device != _hostkeyboard)
             return false;
 
+        ScopedLock<LockDomain> guard(&_domain);
         if(_mode & (MODE_DISABLED | MODE_STOPPED))
             return false;
 
@@ -222,6 +224,7 @@ public:
     bool receive(MessagePS2 &msg) {
         if(msg.port != _ps2port)
             return false;
+        ScopedLock<LockDomain> guard(&_domain);
         if(msg.type == MessagePS2::READ_KEY) {
             if(_mode & MODE_RESEND) {
                 msg.value = _last_reply;
@@ -352,14 +355,16 @@ public:
     bool receive(MessageLegacy &msg) {
         if(msg.type != MessageLegacy::RESET)
             return false;
+        ScopedLock<LockDomain> guard(&_domain);
         reset();
         return true;
     }
 
-    PS2Keyboard(DBus<MessagePS2> &bus_ps2, unsigned ps2port, unsigned hostkeyboard)
-        : _bus_ps2(bus_ps2), _ps2port(ps2port), _hostkeyboard(hostkeyboard), _scset(),
-          _buffer(), _pread(), _pwrite(), _response(), _no_breakcode(), _indicators(), _last_command(),
-          _last_reply(), _mode() {
+    PS2Keyboard(DBus<MessagePS2> &bus_ps2, LockDomain &domain, unsigned ps2port,
+                unsigned hostkeyboard)
+        : _bus_ps2(bus_ps2), _domain(domain), _ps2port(ps2port), _hostkeyboard(hostkeyboard),
+          _scset(), _buffer(), _pread(), _pwrite(), _response(), _no_breakcode(), _indicators(),
+          _last_command(), _last_reply(), _mode() {
     }
 };
 
@@ -367,7 +372,7 @@ PARAM_HANDLER(
     keyb,
     "keyb:ps2port,hostkeyboard - attach a PS2 keyboard at the given PS2 port that gets input from the given hostkeyboard.",
     "Example: 'keyb:0,0x17'") {
-    PS2Keyboard *dev = new PS2Keyboard(mb.bus_ps2, argv[0], argv[1]);
+    PS2Keyboard *dev = new PS2Keyboard(mb.bus_ps2, mb.input_domain, argv[0], argv[1]);
     mb.bus_ps2.add(dev, PS2Keyboard::receive_static<MessagePS2> );
     mb.bus_input.add(dev, PS2Keyboard::receive_static<MessageInput> );
     mb.bus_legacy.add(dev, PS2Keyboard::receive_static<MessageLegacy> );
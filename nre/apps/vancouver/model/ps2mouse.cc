@@ -35,6 +35,7 @@ using namespace nre;
 class PS2Mouse : public StaticReceiver<PS2Mouse> {
     unsigned static const HOST_RESOLUTION_SHIFT = 2;
     DBus<MessagePS2> &_bus_ps2;
+    LockDomain &_domain;
     unsigned _ps2port;
     unsigned _hostmouse;
     uint64_t _packet;
@@ -138,6 +139,7 @@ public:
     bool receive(MessageInput &msg) {
         if(msg.device != _hostmouse)
             return false;
+        ScopedLock<LockDomain> guard(&_domain);
 
         // we support only 3 byte packets
         assert((msg.data & 0xff) == 3);
@@ -152,6 +154,7 @@ public:
     bool receive(MessagePS2 &msg) {
         if(msg.port != _ps2port)
             return false;
+        ScopedLock<LockDomain> guard(&_domain);
 
         bool res = false;
         if(msg.type == MessagePS2::READ_KEY) {
@@ -264,8 +267,8 @@ public:
         _posy = 0;
     }
 
-    PS2Mouse(DBus<MessagePS2> &bus_ps2, unsigned ps2port, unsigned hostmouse)
-        : _bus_ps2(bus_ps2), _ps2port(ps2port), _hostmouse(hostmouse), _packet(),
+    PS2Mouse(DBus<MessagePS2> &bus_ps2, LockDomain &domain, unsigned ps2port, unsigned hostmouse)
+        : _bus_ps2(bus_ps2), _domain(domain), _ps2port(ps2port), _hostmouse(hostmouse), _packet(),
           _status(), _resolution(), _samplerate(), _posx(), _posy(), _param() {
         set_defaults();
     }
@@ -275,7 +278,7 @@ PARAM_HANDLER(
     mouse,
     "mouse:ps2port,hostmouse:  attach a PS2 mouse at the given PS2 port that gets input from the given hostmouse.",
     "Example: 'mouse:1,0x17'") {
-    PS2Mouse *dev = new PS2Mouse(mb.bus_ps2, argv[0], argv[1]);
+    PS2Mouse *dev = new PS2Mouse(mb.bus_ps2, mb.input_domain, argv[0], argv[1]);
     mb.bus_ps2.add(dev, PS2Mouse::receive_static<MessagePS2> );
     mb.bus_input.add(dev, PS2Mouse::receive_static<MessageInput> );
 }
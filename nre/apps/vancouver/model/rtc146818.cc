@@ -39,6 +39,7 @@ class Rtc146818 : public StaticReceiver<Rtc146818> {
 
     DBus<MessageTimer> &_bus_timer;
     DBus<MessageIrqLines> &_bus_irqlines;
+    LockDomain &_domain;
     nre::Clock &_clock;
     unsigned _timer;
     unsigned short _iobase;
@@ -315,6 +316,7 @@ public:
     bool receive(MessageIOIn &msg) {
         if(!in_range(msg.port, _iobase, 8) || msg.type != MessageIOIn::TYPE_INB)
             return false;
+        ScopedLock<LockDomain> guard(&_domain);
         timevalue now = get_counter();
         unsigned mod = update_cycle(now);
         if(msg.port & 1) {
@@ -350,6 +352,7 @@ public:
     bool receive(MessageIOOut &msg) {
         if(!in_range(msg.port, _iobase, 8) || msg.type != MessageIOOut::TYPE_OUTB)
             return false;
+        ScopedLock<LockDomain> guard(&_domain);
         if(msg.port & 1) {
             timevalue now = get_counter();
             update_cycle(now);
@@ -394,6 +397,7 @@ public:
     bool receive(MessageIrqNotify &msg) {
         if(msg.baseirq != (_irq & ~7) || !(msg.mask & (1 << (_irq & 7))))
             return false;
+        ScopedLock<LockDomain> guard(&_domain);
         update_timer(get_ram_time(), get_counter());
         return true;
     }
@@ -401,13 +405,15 @@ public:
     bool receive(MessageTimeout &msg) {
         if(msg.nr != _timer)
             return false;
+        ScopedLock<LockDomain> guard(&_domain);
         update_cycle(get_counter());
         return true;
     }
 
-    Rtc146818(DBus<MessageTimer> &bus_timer, DBus<MessageIrqLines> &bus_irqlines, Clock &clock,
-              unsigned timer, unsigned short iobase, unsigned irq)
-        : _bus_timer(bus_timer), _bus_irqlines(bus_irqlines), _clock(clock), _timer(timer),
+    Rtc146818(DBus<MessageTimer> &bus_timer, DBus<MessageIrqLines> &bus_irqlines,
+              LockDomain &domain, Clock &clock, unsigned timer, unsigned short iobase, unsigned irq)
+        : _bus_timer(bus_timer), _bus_irqlines(bus_irqlines), _domain(domain), _clock(clock),
+          _timer(timer),
           _iobase(iobase), _irq(irq), _index(), _ram(), _offset(), _last() {
     }
 };
@@ -420,13 +426,14 @@ PARAM_HANDLER(rtc,
     if(!mb.bus_timer.send(msg0))
         Util::panic("%s can't get a timer", __PRETTY_FUNCTION__);
 
-    Rtc146818 *rtc = new Rtc146818(mb.bus_timer, mb.bus_irqlines, mb.clock(), msg0.nr, argv[0], argv[1]);
+    Rtc146818 *rtc = new Rtc146818(mb.bus_timer, mb.bus_irqlines, mb.irq_domain, mb.clock(),
+                                   msg0.nr, argv[0], argv[1]);
     MessageTime msg1;
     if(!mb.bus_time.send(msg1))
         Serial::get().writef("could not get wallclock time!\n");
     rtc->reset(msg1);
-    mb.bus_ioin.add(rtc, Rtc146818::receive_static<MessageIOIn> );
-    mb.bus_ioout.add(rtc, Rtc146818::receive_static<MessageIOOut> );
+    mb.bus_ioin.add(rtc, Rtc146818::receive_static<MessageIOIn>, argv[0], 8);
+    mb.bus_ioout.add(rtc, Rtc146818::receive_static<MessageIOOut>, argv[0], 8);
     mb.bus_timeout.add(rtc, Rtc146818::receive_static<MessageTimeout> );
     mb.bus_irqnotify.add(rtc, Rtc146818::receive_static<MessageIrqNotify> );
 }
@@ -33,6 +33,8 @@ class Rtl8029 : public StaticReceiver<Rtl8029>
 {
     DBus<MessageNetwork>  &_bus_network;
     DBus<MessageIrqLines> &_bus_irqlines;
+    // all NICs share one domain, because they deliver packets to each other synchronously
+    static LockDomain _domain;
     unsigned char _irq;
     unsigned long long _mac;
     unsigned _bdf;
@@ -259,6 +261,7 @@ public:
     bool  receive(MessageNetwork &msg)
     {
         if(msg.buffer >= _mem && msg.buffer < _mem + sizeof(_mem)) return false;
+        ScopedLock<LockDomain> guard(&_domain);
         return receive_packet(msg.buffer, msg.len);
     }
 
@@ -268,6 +271,7 @@ public:
         if(!match_bar(addr) || !(PCI_CMD_STS & 0x1))
             return false;
 
+        ScopedLock<LockDomain> guard(&_domain);
         // for every byte
         for(unsigned i = 0; i < (1u << msg.type); i++, addr++)
             read_byte(addr, reinterpret_cast<unsigned char *>(&msg.value) + i);
@@ -282,12 +286,14 @@ public:
         if(!match_bar(addr) || !(PCI_CMD_STS & 0x1))
             return false;
 
+        ScopedLock<LockDomain> guard(&_domain);
         for(unsigned i = 0; i < (1u << msg.type); i++, addr++)
             write_byte(addr, msg.value >> (i * 8));
         return true;
     }
 
     bool receive(MessagePciConfig &msg)  {
+        ScopedLock<LockDomain> guard(&_domain);
         return PciHelper::receive(msg, this, _bdf);
     }
 
@@ -314,6 +320,8 @@ public:
     }
 };
 
+LockDomain Rtl8029::_domain;
+
 
 PARAM_HANDLER(
     rtl8029,
@@ -18,17 +18,24 @@
 
 #pragma once
 
+class LockDomain;
+
 class FisReceiver {
 protected:
     FisReceiver *_peer;
+    /**
+     * The lock domain of the controller, which is shared with the attached drive
+     */
+    LockDomain *_domain;
 
 public:
-    FisReceiver() : _peer(0) {
+    FisReceiver() : _peer(0), _domain(0) {
     }
 
     virtual void receive_fis(size_t fislen, unsigned *fis) = 0;
 
-    void set_peer(FisReceiver *peer) {
+    void set_peer(FisReceiver *peer, LockDomain *domain) {
         _peer = peer;
+        _domain = domain;
     }
 };
@@ -390,10 +390,16 @@ public:
     bool receive(MessageDiskCommit &msg) {
         if(msg.disknr != _hostdisk || msg.usertag > 32)
             return false;
+
+        ScopedLock<LockDomain> guard(_domain);
         // we are done
         _status = _status & ~0x8;
         assert(_splits[msg.usertag]);
-        assert(!msg.status);
+        // report failures with the completion of the command
+        if(msg.status) {
+            _error |= 4;
+            _status |= 1;
+        }
         if(!--_splits[msg.usertag]) {
             _dsf[6] = msg.usertag;
             complete_command();
@@ -58,6 +58,7 @@ private:
         DLM,
         MAX,
     };
+    LockDomain _domain;
     unsigned short _base;
     unsigned char _irq;
     unsigned _hostserial;
@@ -97,6 +98,7 @@ public:
         if(msg.serial != _hostserial)
             return false;
 
+        ScopedLock<LockDomain> guard(&_domain);
         unsigned char or_lsr;
         // fifo mode
         if(_regs[FCR] & 1) {
@@ -123,6 +125,7 @@ public:
         if(!in_range(msg.port, _base, 8) || msg.type != MessageIOIn::TYPE_INB)
             return false;
 
+        ScopedLock<LockDomain> guard(&_domain);
         unsigned offset = msg.port - _base;
         if((_regs[LCR] & 0x80) && offset <= IER)
             offset += DLL - THR;
@@ -164,6 +167,7 @@ public:
         if(!in_range(msg.port, _base, 8) || msg.type != MessageIOOut::TYPE_OUTB)
             return false;
 
+        ScopedLock<LockDomain> guard(&_domain);
         msg.value &= 0xff;
         unsigned offset = msg.port - _base;
         if((_regs[LCR] & 0x80) && offset <= IER)
@@ -241,13 +245,13 @@ public:
     }
 
     SerialDevice(Motherboard &mb, unsigned short base, unsigned char irq, unsigned hostserial)
-        : _mb(mb), _base(base), _irq(irq), _hostserial(hostserial), _regs(), _rfifo(), _rfpos(),
-          _rfcount(0), _triggerlevel(1), _sendmask(0x1f) {
+        : _mb(mb), _domain(), _base(base), _irq(irq), _hostserial(hostserial), _regs(), _rfifo(),
+          _rfpos(), _rfcount(0), _triggerlevel(1), _sendmask(0x1f) {
         memset(_regs, 0, sizeof(_regs));
         _regs[LSR] = 0x60;
         _regs[MSR] = 0xb0;
-        _mb.bus_ioin.add(this, receive_static<MessageIOIn> );
-        _mb.bus_ioout.add(this, receive_static<MessageIOOut> );
+        _mb.bus_ioin.add(this, receive_static<MessageIOIn>, _base, 8);
+        _mb.bus_ioout.add(this, receive_static<MessageIOOut>, _base, 8);
         _mb.bus_serial.add(this, receive_static<MessageSerial> );
         _mb.bus_discovery.add(this, discover);
     }
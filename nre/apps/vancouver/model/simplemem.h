@@ -24,7 +24,7 @@ DBus<MessageMem> *_bus_mem;
  */
 bool copy_inout(uintptr_t address, void *ptr, size_t count, bool read) {
     MessageMemRegion msg(address >> 12);
-    if(!_bus_memregion->send(msg) || !msg.ptr ||
+    if(!_bus_memregion->send_range(msg, msg.page, 1) || !msg.ptr ||
        ((address + count) > ((msg.start_page + msg.count) << 12)))
         return false;
     if(read)
@@ -44,14 +44,14 @@ bool copy_out(uintptr_t address, void *ptr, size_t count) {
     if(address & 3) {
         unsigned value;
         MessageMem msg(true, address & ~3, &value);
-        if(!_bus_mem->send(msg, true))
+        if(!_bus_mem->send_range(msg, msg.phys, 4, true))
             return false;
         size_t l = 4 - (address & 3);
         if(l > count)
             l = count;
         memcpy(reinterpret_cast<char *>(&value) + (address & 3), p, l);
         msg.read = false;
-        if(!_bus_mem->send(msg, true))
+        if(!_bus_mem->send_range(msg, msg.phys, 4, true))
             return false;
         p += l;
         address += l;
@@ -60,7 +60,7 @@ bool copy_out(uintptr_t address, void *ptr, size_t count) {
     assert(!(address & 3));
     while(count >= 4) {
         MessageMem msg(false, address, reinterpret_cast<unsigned *>(p));
-        if(!_bus_mem->send(msg, true))
+        if(!_bus_mem->send_range(msg, msg.phys, 4, true))
             return false;
         address += 4;
         p += 4;
@@ -69,11 +69,11 @@ bool copy_out(uintptr_t address, void *ptr, size_t count) {
     if(count) {
         unsigned value;
         MessageMem msg(true, address, &value);
-        if(!_bus_mem->send(msg, true))
+        if(!_bus_mem->send_range(msg, msg.phys, 4, true))
             return false;
         memcpy(&value, p, count);
         msg.read = false;
-        if(!_bus_mem->send(msg, true))
+        if(!_bus_mem->send_range(msg, msg.phys, 4, true))
             return false;
     }
     return true;
@@ -89,7 +89,7 @@ bool copy_in(uintptr_t address, void *ptr, size_t count) {
     if(address & 3) {
         unsigned value;
         MessageMem msg(true, address & ~3, &value);
-        if(!_bus_mem->send(msg, true))
+        if(!_bus_mem->send_range(msg, msg.phys, 4, true))
             return false;
         value >>= 8 * (address & 3);
         size_t l = 4 - (address & 3);
@@ -103,7 +103,7 @@ bool copy_in(uintptr_t address, void *ptr, size_t count) {
     assert(!(address & 3));
     while(count >= 4) {
         MessageMem msg(true, address, reinterpret_cast<unsigned *>(p));
-        if(!_bus_mem->send(msg, true))
+        if(!_bus_mem->send_range(msg, msg.phys, 4, true))
             return false;
         address += 4;
         p += 4;
@@ -112,7 +112,7 @@ bool copy_in(uintptr_t address, void *ptr, size_t count) {
     if(count) {
         unsigned value;
         MessageMem msg(true, address, &value);
-        if(!_bus_mem->send(msg, true))
+        if(!_bus_mem->send_range(msg, msg.phys, 4, true))
             return false;
         memcpy(p, &value, count);
     }
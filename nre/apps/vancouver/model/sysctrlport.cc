@@ -32,6 +32,7 @@ using namespace nre;
 class SystemControlPort : public StaticReceiver<SystemControlPort> {
     DBus<MessageLegacy> &_bus_legacy;
     DBus<MessagePit> &_bus_pit;
+    LockDomain &_domain;
     unsigned _port_a;
     unsigned _port_b;
     unsigned char _last_porta;
@@ -39,9 +40,11 @@ class SystemControlPort : public StaticReceiver<SystemControlPort> {
 
 public:
     bool receive(MessageIOIn &msg) {
-        if(msg.type != MessageIOIn::TYPE_INB)
+        if(msg.type != MessageIOIn::TYPE_INB || (msg.port != _port_a && msg.port != _port_b))
             return false;
 
+        ScopedLock<LockDomain> guard(&_domain);
+
         if(msg.port == _port_a) {
             msg.value = _last_porta & 0x3;
             return true;
@@ -62,9 +65,11 @@ public:
     }
 
     bool receive(MessageIOOut &msg) {
-        if(msg.type != MessageIOOut::TYPE_OUTB)
+        if(msg.type != MessageIOOut::TYPE_OUTB || (msg.port != _port_a && msg.port != _port_b))
             return false;
 
+        ScopedLock<LockDomain> guard(&_domain);
+
         if(msg.port == _port_a) {
             // fast A20 gate
             if((_last_porta ^ msg.value) & 2) {
@@ -88,17 +93,20 @@ public:
         return false;
     }
 
-    SystemControlPort(DBus<MessageLegacy> &bus_legacy, DBus<MessagePit> &bus_pit, unsigned port_a,
-                      unsigned port_b)
-        : _bus_legacy(bus_legacy), _bus_pit(bus_pit), _port_a(port_a), _port_b(port_b),
-          _last_porta(0), _last_portb(0) {
+    SystemControlPort(DBus<MessageLegacy> &bus_legacy, DBus<MessagePit> &bus_pit,
+                      LockDomain &domain, unsigned port_a, unsigned port_b)
+        : _bus_legacy(bus_legacy), _bus_pit(bus_pit), _domain(domain), _port_a(port_a),
+          _port_b(port_b), _last_porta(0), _last_portb(0) {
     }
 };
 
 PARAM_HANDLER(scp,
               "scp:porta,portb - provide the system control ports A+B.",
               "Example: 'scp:0x92,0x61'") {
-    SystemControlPort *scp = new SystemControlPort(mb.bus_legacy, mb.bus_pit, argv[0], argv[1]);
-    mb.bus_ioin.add(scp, SystemControlPort::receive_static<MessageIOIn> );
-    mb.bus_ioout.add(scp, SystemControlPort::receive_static<MessageIOOut> );
+    SystemControlPort *scp = new SystemControlPort(mb.bus_legacy, mb.bus_pit, mb.irq_domain,
+                                                 argv[0], argv[1]);
+    mb.bus_ioin.add(scp, SystemControlPort::receive_static<MessageIOIn>, argv[0], 1);
+    mb.bus_ioin.add(scp, SystemControlPort::receive_static<MessageIOIn>, argv[1], 1);
+    mb.bus_ioout.add(scp, SystemControlPort::receive_static<MessageIOOut>, argv[0], 1);
+    mb.bus_ioout.add(scp, SystemControlPort::receive_static<MessageIOOut>, argv[1], 1);
 }
@@ -287,7 +287,7 @@ class VirtualCpu : public VCVCpu, public StaticReceiver<VirtualCpu> {
 
     void handle_ioin(CpuMessage &msg) {
         MessageIOIn msg2(MessageIOIn::Type(msg.io_order), msg.port);
-        bool res = _mb.bus_ioin.send(msg2);
+        bool res = _mb.bus_ioin.send_range(msg2, msg2.port, 1 << msg2.type);
 
         cpu_move(msg.dst, &msg2.value, msg.io_order);
         msg.mtr_out |= Mtd::GPR_ACDB;
@@ -304,7 +304,7 @@ class VirtualCpu : public VCVCpu, public StaticReceiver<VirtualCpu> {
         MessageIOOut msg2(MessageIOOut::Type(msg.io_order), msg.port, 0);
         cpu_move(&msg2.value, msg.dst, msg.io_order);
 
-        bool res = _mb.bus_ioout.send(msg2);
+        bool res = _mb.bus_ioout.send_range(msg2, msg2.port, 1 << msg2.type);
         if(!res && (~debugioout[msg.port >> 3] & (1 << (msg.port & 7)))) {
             debugioout[msg.port >> 3] |= 1 << (msg.port & 7);
             //dprintf("could not write %x to ioport %x eip %x\n", msg.cpu->eax, msg.port, msg.cpu->eip);
@@ -351,10 +351,10 @@ public:
      * Forward MEM requests to the motherboard.
      */
     bool receive(MessageMem &msg) {
-        return _mb.bus_mem.send(msg, true);
+        return _mb.bus_mem.send_range(msg, msg.phys, 4, true);
     }
     bool receive(MessageMemRegion &msg) {
-        return _mb.bus_memregion.send(msg, true);
+        return _mb.bus_memregion.send_range(msg, msg.page, 1, true);
     }
 
     bool receive(CpuEvent &msg) {
@@ -34,12 +34,16 @@ using namespace nre;
  * Documentation: FreeVGA chipset reference - vga.htm, Browns IRQ List
  */
 class Vga : public StaticReceiver<Vga>, public BiosCommon {
+public:
     enum {
         LOW_BASE            = 0xa0000,
         LOW_SIZE            = 1 << 17,
         TEXT_OFFSET         = 0x18000 >> 1,
         EBDA_FONT_OFFSET    = 0x1000,
     };
+
+private:
+    LockDomain _domain;
     unsigned short _view;
     unsigned short _iobase;
     char * _framebuffer_ptr;
@@ -381,10 +385,14 @@ class Vga : public StaticReceiver<Vga>, public BiosCommon {
 public:
     bool receive(MessageBios &msg) {
         switch(msg.irq) {
-            case 0x10:
+            case 0x10: {
+                ScopedLock<LockDomain> guard(&_domain);
                 return handle_int10(msg);
-            case RESET_VECTOR:
+            }
+            case RESET_VECTOR: {
+                ScopedLock<LockDomain> guard(&_domain);
                 return handle_reset(true);
+            }
             default:
                 return false;
         }
@@ -395,6 +403,7 @@ public:
         for(unsigned i = 0; i < (1u << msg.type); i++) {
             unsigned char value = msg.value >> i * 8;
             if(in_range(msg.port + i, _iobase, 32)) {
+                ScopedLock<LockDomain> guard(&_domain);
                 switch(msg.port + i - _iobase) {
                     case 0x0: // attribute address and write
                     case 0x1: // attribute read
@@ -445,6 +454,7 @@ public:
         bool res = false;
         for(unsigned i = 0; i < (1u << msg.type); i++) {
             if(in_range(msg.port + i, _iobase, 32)) {
+                ScopedLock<LockDomain> guard(&_domain);
                 unsigned char value = ~0;
                 switch(msg.port + i - _iobase) {
                     case 0x14: // crt address
@@ -546,7 +556,7 @@ public:
 
     Vga(Motherboard &mb, ConsoleSession *sess, unsigned short iobase, char *framebuffer_ptr,
         uintptr_t framebuffer_phys, size_t framebuffer_size)
-        : BiosCommon(mb), _view(), _iobase(iobase), _framebuffer_ptr(framebuffer_ptr),
+        : BiosCommon(mb), _domain(), _view(), _iobase(iobase), _framebuffer_ptr(framebuffer_ptr),
           _framebuffer_phys(framebuffer_phys), _framebuffer_size(framebuffer_size), _regs(),
           _crt_index(0), _ebda_segment(), _vbe_mode(), _csess(sess), _cons(*sess) {
         assert(!(framebuffer_phys & 0xfff));
@@ -594,10 +604,13 @@ PARAM_HANDLER(vga,
        if(!mb.bus_hostop.send(msg) || !mb.bus_hostop.send(msg2))
         Util::panic("%s failed to alloc %ld from guest memory\n",__PRETTY_FUNCTION__,fbsize);
        Vga *dev = new Vga(mb,argv[0],msg2.ptr + msg.phys,msg.phys,fbsize);*/
-    mb.bus_ioin.add(dev, Vga::receive_static<MessageIOIn> );
-    mb.bus_ioout.add(dev, Vga::receive_static<MessageIOOut> );
+    mb.bus_ioin.add(dev, Vga::receive_static<MessageIOIn>, argv[0], 32);
+    mb.bus_ioout.add(dev, Vga::receive_static<MessageIOOut>, argv[0], 32);
     mb.bus_bios.add(dev, Vga::receive_static<MessageBios> );
-    mb.bus_mem.add(dev, Vga::receive_static<MessageMem> );
-    mb.bus_memregion.add(dev, Vga::receive_static<MessageMemRegion> );
+    mb.bus_mem.add(dev, Vga::receive_static<MessageMem>, msg1.phys, fbsize);
+    mb.bus_mem.add(dev, Vga::receive_static<MessageMem>, Vga::LOW_BASE, Vga::LOW_SIZE);
+    mb.bus_memregion.add(dev, Vga::receive_static<MessageMemRegion>, msg1.phys >> 12, fbsize >> 12);
+    mb.bus_memregion.add(dev, Vga::receive_static<MessageMemRegion>, Vga::LOW_BASE >> 12,
+                         Vga::LOW_SIZE >> 12);
     mb.bus_discovery.add(dev, Vga::receive_static<MessageDiscovery> );
 }
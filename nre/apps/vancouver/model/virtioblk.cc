@@ -0,0 +1,502 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#ifndef REGBASE
+#    include <util/Sync.h>
+
+#    include "../bus/motherboard.h"
+#    include "../bus/helper.h"
+#    include "pci.h"
+
+using namespace nre;
+
+/**
+ * A virtio block device on a PCI card, using the legacy virtio PCI interface.
+ *
+ * In contrast to the IDE and AHCI models, the guest doesn't program registers per request.
+ * Instead, it puts the requests into a virtqueue in its memory and notifies us with a single
+ * I/O port write. We translate the descriptors directly into DMA descriptors for the storage
+ * service, so that the data is transferred from/to guest memory without copying, and complete
+ * each request by a single update of the used ring and an interrupt.
+ *
+ * State: unstable
+ * Features: PCI cfg space, one virtqueue, read, write, flush, get-id, IRQ
+ * Missing: MSI-X, indirect descriptors, event index
+ * Documentation: virtio spec 0.9.5
+ */
+class VirtioBlk : public StaticReceiver<VirtioBlk> {
+    enum {
+        QUEUE_SIZE          = 128,
+        // register offsets in the I/O BAR
+        REG_HOST_FEATURES   = 0x00,
+        REG_GUEST_FEATURES  = 0x04,
+        REG_QUEUE_PFN       = 0x08,
+        REG_QUEUE_SIZE      = 0x0c,
+        REG_QUEUE_SEL       = 0x0e,
+        REG_QUEUE_NOTIFY    = 0x10,
+        REG_STATUS          = 0x12,
+        REG_ISR             = 0x13,
+        REG_CONFIG          = 0x14,
+        // features
+        F_SEG_MAX           = 1 << 2,
+        F_BLK_SIZE          = 1 << 6,
+        F_FLUSH             = 1 << 9,
+        HOST_FEATURES       = F_SEG_MAX | F_BLK_SIZE | F_FLUSH,
+        // device status
+        STATUS_DRIVER_OK    = 4,
+        // descriptor and ring flags
+        DESC_F_NEXT         = 1,
+        DESC_F_WRITE        = 2,
+        AVAIL_F_NO_INTERRUPT = 1,
+        // request types
+        T_IN                = 0,
+        T_OUT               = 1,
+        T_FLUSH             = 4,
+        T_GET_ID            = 8,
+        ID_BYTES            = 20,
+        // request status
+        S_OK                = 0,
+        S_IOERR             = 1,
+        S_UNSUPP            = 2,
+        // virtio uses 512 byte sectors, regardless of the block size
+        SECTOR_SIZE         = 512,
+    };
+
+    struct Config {
+        uint64_t capacity;
+        uint32_t size_max;
+        uint32_t seg_max;
+        uint16_t cylinders;
+        uint8_t heads;
+        uint8_t sectors;
+        uint32_t blk_size;
+    } PACKED;
+
+    /**
+     * The layout of our I/O BAR (see REG_*)
+     */
+    struct Regs {
+        uint32_t host_features;
+        uint32_t guest_features;
+        uint32_t queue_pfn;
+        uint16_t queue_size;
+        uint16_t queue_sel;
+        uint16_t queue_notify;
+        uint8_t status;
+        uint8_t isr;
+        Config config;
+    } PACKED;
+
+    struct Desc {
+        uint64_t addr;
+        uint32_t len;
+        uint16_t flags;
+        uint16_t next;
+    } PACKED;
+    struct Avail {
+        uint16_t flags;
+        uint16_t idx;
+        uint16_t ring[QUEUE_SIZE];
+    } PACKED;
+    struct UsedElem {
+        uint32_t id;
+        uint32_t len;
+    } PACKED;
+    struct Used {
+        uint16_t flags;
+        uint16_t idx;
+        UsedElem ring[QUEUE_SIZE];
+    } PACKED;
+
+    struct ReqHeader {
+        uint32_t type;
+        uint32_t ioprio;
+        uint64_t sector;
+    } PACKED;
+
+    /**
+     * A request that has been passed to the storage service. It is identified by the index of
+     * the head descriptor, which is also used as the tag.
+     */
+    struct Request {
+        bool pending;
+        uint8_t *status;
+        uint32_t len;
+    };
+
+#    define  REGBASE "virtioblk.cc"
+#    include "reg.h"
+    DBus<MessageDisk> &_bus_disk;
+    DBus<MessageIrqLines> &_bus_irqlines;
+    LockDomain _domain;
+    unsigned char _irq;
+    uint32_t _bdf;
+    size_t _disknr;
+    Storage::Parameter _params;
+    Storage::dma_type _dma;
+    char *_guest_mem;
+    size_t _guest_size;
+    uint32_t _guest_features;
+    uint32_t _queue_pfn;
+    uint16_t _queue_sel;
+    uint8_t _status;
+    uint8_t _isr;
+    uint16_t _last_avail;
+    Desc *_desc;
+    Avail *_avail;
+    Used *_used;
+    Request _reqs[QUEUE_SIZE];
+
+    static size_t used_offset() {
+        return Math::round_up<size_t>(sizeof(Desc) * QUEUE_SIZE + sizeof(Avail) + 2,
+                                      ExecEnv::PAGE_SIZE);
+    }
+
+    /**
+     * @return the pointer to guest-physical <addr>, if <len> bytes are available there
+     */
+    template<typename T>
+    T *guest_ptr(uint64_t addr, size_t len) const {
+        if(addr > _guest_size || len > _guest_size - addr)
+            return nullptr;
+        return reinterpret_cast<T*>(_guest_mem + addr);
+    }
+
+    void reset() {
+        _guest_features = 0;
+        _queue_pfn = 0;
+        _queue_sel = 0;
+        _status = 0;
+        _isr = 0;
+        _last_avail = 0;
+        _desc = nullptr;
+        _avail = nullptr;
+        _used = nullptr;
+        // requests that are still in flight are silently dropped on completion
+        memset(_reqs, 0, sizeof(_reqs));
+        update_irq();
+    }
+
+    void update_irq() {
+        MessageIrqLines msg(_isr ? MessageIrqLines::ASSERT_IRQ : MessageIrqLines::DEASSERT_IRQ,
+                            _irq);
+        _bus_irqlines.send(msg);
+    }
+
+    void set_queue(uint32_t pfn) {
+        uint64_t addr = static_cast<uint64_t>(pfn) << ExecEnv::PAGE_SHIFT;
+        char *queue = guest_ptr<char>(addr, used_offset() + sizeof(Used));
+        if(!pfn || !queue) {
+            _queue_pfn = 0;
+            _desc = nullptr;
+            _avail = nullptr;
+            _used = nullptr;
+            return;
+        }
+        _queue_pfn = pfn;
+        _last_avail = 0;
+        _desc = reinterpret_cast<Desc*>(queue);
+        _avail = reinterpret_cast<Avail*>(queue + sizeof(Desc) * QUEUE_SIZE);
+        _used = reinterpret_cast<Used*>(queue + used_offset());
+    }
+
+    /**
+     * Puts the request with head <head> into the used ring and raises an interrupt.
+     */
+    void complete(uint16_t head, uint8_t status) {
+        Request &req = _reqs[head];
+        if(req.status)
+            *req.status = status;
+        req.pending = false;
+
+        UsedElem &elem = _used->ring[_used->idx % QUEUE_SIZE];
+        elem.id = head;
+        elem.len = req.status ? req.len + 1 : 0;
+        // the guest has to see the element before the index
+        Sync::memory_barrier();
+        _used->idx++;
+        Sync::memory_barrier();
+
+        if(!(_avail->flags & AVAIL_F_NO_INTERRUPT)) {
+            _isr |= 1;
+            update_irq();
+        }
+    }
+
+    /**
+     * Writes our id into the buffer of the given request
+     */
+    uint8_t get_id(Request &req, const Desc *d) {
+        char *buf = d ? guest_ptr<char>(d->addr, d->len) : nullptr;
+        if(!buf)
+            return S_IOERR;
+        req.len = Math::min<size_t>(d->len, ID_BYTES);
+        memset(buf, 0, req.len);
+        memcpy(buf, _params.name, Math::min<size_t>(strlen(_params.name), req.len));
+        return S_OK;
+    }
+
+    /**
+     * Parses the descriptor chain starting at <head> and passes the request to the storage
+     * service. Requests that can't be passed on are completed immediately.
+     */
+    void handle_request(uint16_t head) {
+        Request &req = _reqs[head];
+        req.status = nullptr;
+        req.len = 0;
+
+        // the first descriptor holds the header, the last one the status byte. everything in
+        // between is the data of the request
+        ReqHeader *hdrptr = nullptr;
+        const Desc *data = nullptr;
+        bool valid = true;
+        _dma.clear();
+        uint16_t idx = head;
+        for(size_t i = 0; i < QUEUE_SIZE; ++i) {
+            const Desc &d = _desc[idx];
+            if(i == 0) {
+                if(d.len >= sizeof(ReqHeader))
+                    hdrptr = guest_ptr<ReqHeader>(d.addr, sizeof(ReqHeader));
+            }
+            else if(!(d.flags & DESC_F_NEXT)) {
+                if(d.flags & DESC_F_WRITE)
+                    req.status = guest_ptr<uint8_t>(d.addr, 1);
+            }
+            else {
+                if(!data)
+                    data = &d;
+                if(_dma.count() == Storage::MAX_DMA_DESCS || !guest_ptr<char>(d.addr, d.len))
+                    valid = false;
+                else
+                    _dma.push(DMADesc(d.addr, d.len));
+            }
+            if(!(d.flags & DESC_F_NEXT) || d.next >= QUEUE_SIZE)
+                break;
+            idx = d.next;
+        }
+
+        // without a status byte, we can't tell the guest anything but that we're done
+        if(!valid || !hdrptr || !req.status) {
+            complete(head, S_IOERR);
+            return;
+        }
+
+        // copy the header to prevent that the guest changes it while we're looking at it
+        ReqHeader hdr = *hdrptr;
+        MessageDisk::Type type;
+        switch(hdr.type) {
+            case T_IN:
+                type = MessageDisk::DISK_READ;
+                break;
+            case T_OUT:
+                type = MessageDisk::DISK_WRITE;
+                break;
+            case T_FLUSH:
+                type = MessageDisk::DISK_FLUSH_CACHE;
+                break;
+            case T_GET_ID:
+                complete(head, get_id(req, data));
+                return;
+            default:
+                complete(head, S_UNSUPP);
+                return;
+        }
+
+        Storage::sector_type sector = 0;
+        if(type != MessageDisk::DISK_FLUSH_CACHE) {
+            // check the request here, because the storage session would throw an exception
+            uint64_t offset = hdr.sector * SECTOR_SIZE;
+            size_t bytes = _dma.bytecount();
+            sector = offset / _params.sector_size;
+            if(!bytes || (offset % _params.sector_size) || (bytes % _params.sector_size) ||
+               sector >= _params.sectors ||
+               bytes / _params.sector_size > _params.sectors - sector) {
+                complete(head, S_IOERR);
+                return;
+            }
+            if(type == MessageDisk::DISK_READ)
+                req.len = bytes;
+        }
+
+        req.pending = true;
+        MessageDisk msg(type, _disknr, head, sector, &_dma);
+        if(!_bus_disk.send(msg) || msg.error != MessageDisk::DISK_OK)
+            complete(head, S_IOERR);
+    }
+
+    /**
+     * Handles all requests the guest has added to the available ring since the last call.
+     */
+    void process_queue() {
+        if(!_avail || !(_status & STATUS_DRIVER_OK))
+            return;
+        while(_last_avail != _avail->idx) {
+            // read the index before the ring entry
+            Sync::memory_barrier();
+            uint16_t head = _avail->ring[_last_avail % QUEUE_SIZE];
+            _last_avail++;
+            if(head < QUEUE_SIZE && !_reqs[head].pending)
+                handle_request(head);
+        }
+    }
+
+    Regs get_regs() const {
+        Regs regs;
+        memset(&regs, 0, sizeof(regs));
+        regs.host_features = HOST_FEATURES;
+        regs.guest_features = _guest_features;
+        regs.queue_pfn = _queue_pfn;
+        regs.queue_size = _queue_sel == 0 ? QUEUE_SIZE : 0;
+        regs.queue_sel = _queue_sel;
+        regs.status = _status;
+        regs.isr = _isr;
+        regs.config.capacity = (_params.sectors * _params.sector_size) / SECTOR_SIZE;
+        // longer DMA lists are put into consecutive slots of the submission ring, so that the
+        // guest can use all of them without a synchronous call to the storage service
+        regs.config.seg_max = Storage::MAX_DMA_DESCS;
+        regs.config.blk_size = _params.sector_size;
+        return regs;
+    }
+
+public:
+    bool receive(MessageDiskCommit &msg) {
+        if(msg.disknr != _disknr || msg.usertag >= QUEUE_SIZE)
+            return false;
+
+        ScopedLock<LockDomain> guard(&_domain);
+        if(!_reqs[msg.usertag].pending || !_used)
+            return false;
+        complete(msg.usertag, msg.status ? S_IOERR : S_OK);
+        return true;
+    }
+
+    bool receive(MessageIOIn &msg) {
+        if((msg.port ^ PCI_BAR0) & PCI_BAR0_mask)
+            return false;
+
+        ScopedLock<LockDomain> guard(&_domain);
+        unsigned offset = msg.port & ~PCI_BAR0_mask;
+        unsigned size = 1 << msg.type;
+        Regs regs = get_regs();
+        if(offset + size > sizeof(regs))
+            return false;
+        msg.value = 0;
+        memcpy(&msg.value, reinterpret_cast<char*>(&regs) + offset, size);
+
+        // reading the ISR acknowledges the interrupt
+        if(offset == REG_ISR && _isr) {
+            _isr = 0;
+            update_irq();
+        }
+        return true;
+    }
+
+    bool receive(MessageIOOut &msg) {
+        if((msg.port ^ PCI_BAR0) & PCI_BAR0_mask)
+            return false;
+
+        ScopedLock<LockDomain> guard(&_domain);
+        unsigned offset = msg.port & ~PCI_BAR0_mask;
+        switch(offset) {
+            case REG_GUEST_FEATURES:
+                _guest_features = msg.value & HOST_FEATURES;
+                break;
+            case REG_QUEUE_PFN:
+                if(_queue_sel == 0)
+                    set_queue(msg.value);
+                break;
+            case REG_QUEUE_SEL:
+                _queue_sel = msg.value;
+                break;
+            case REG_QUEUE_NOTIFY:
+                if((msg.value & 0xffff) == 0)
+                    process_queue();
+                break;
+            case REG_STATUS:
+                _status = msg.value;
+                if(_status == 0)
+                    reset();
+                else
+                    process_queue();
+                break;
+            default:
+                // the config space is read-only
+                if(offset >= sizeof(Regs))
+                    return false;
+                break;
+        }
+        return true;
+    }
+
+    bool receive(MessagePciConfig &msg) {
+        ScopedLock<LockDomain> guard(&_domain);
+        return PciHelper::receive(msg, this, _bdf);
+    }
+
+    VirtioBlk(DBus<MessageDisk> &bus_disk, DBus<MessageIrqLines> &bus_irqlines, unsigned char irq,
+              uint32_t bdf, size_t disknr, Storage::Parameter params, char *guest_mem,
+              size_t guest_size)
+        : _bus_disk(bus_disk), _bus_irqlines(bus_irqlines), _domain(), _irq(irq), _bdf(bdf),
+          _disknr(disknr), _params(params), _dma(), _guest_mem(guest_mem), _guest_size(guest_size),
+          _guest_features(), _queue_pfn(), _queue_sel(), _status(), _isr(), _last_avail(),
+          _desc(), _avail(), _used(), _reqs() {
+        PCI_reset();
+        reset();
+        Serial::get().writef("virtio-blk controller (bdf %#x)\n", bdf);
+        Serial::get().writef("Attaching disk '%s' (%Lu sectors) to it\n",
+                             params.name, params.sectors);
+    }
+};
+
+PARAM_HANDLER(
+    virtioblk,
+    "virtioblk:iobase,irq,bdf,disk - attach a virtio block device to a PCI bus.",
+    "Example: 'virtioblk:0xc000,11,0x40,0' attaches disk 0 to 00:08.0 at port 0xc000, irq 11.",
+    "If no bdf is given, the first free one is searched.") {
+    Storage::Parameter params;
+    size_t hostdisk = argv[3];
+    MessageDisk msg0(hostdisk, &params);
+    if(!mb.bus_disk.send(msg0) || msg0.error != MessageDisk::DISK_OK)
+        Util::panic("%s: unable to connect to disk %lu\n", __PRETTY_FUNCTION__, hostdisk);
+
+    MessageHostOp msg1(MessageHostOp::OP_GUEST_MEM, 0UL);
+    if(!mb.bus_hostop.send(msg1))
+        Util::panic("%s: could not find base address of guest memory\n", __PRETTY_FUNCTION__);
+
+    uint32_t bdf = PciHelper::find_free_bdf(mb.bus_pcicfg, argv[2]);
+    VirtioBlk *dev = new VirtioBlk(mb.bus_disk, mb.bus_irqlines, argv[1], bdf, hostdisk, params,
+                                   msg1.ptr, msg1.len);
+    mb.bus_pcicfg.add(dev, VirtioBlk::receive_static<MessagePciConfig> );
+    mb.bus_ioin.add(dev, VirtioBlk::receive_static<MessageIOIn> );
+    mb.bus_ioout.add(dev, VirtioBlk::receive_static<MessageIOOut> );
+    mb.bus_diskcommit.add(dev, VirtioBlk::receive_static<MessageDiskCommit> );
+
+    // set default state; this is normally done by the BIOS
+    dev->PCI_write(VirtioBlk::PCI_BAR0_offset, argv[0]);
+    dev->PCI_write(VirtioBlk::PCI_INTR_offset, argv[1]);
+    // enable IRQ, IOPort access and bus mastering
+    dev->PCI_write(VirtioBlk::PCI_CMD_STS_offset, 0x405);
+}
+#else
+REGSET(PCI,
+       REG_RO(PCI_ID, 0x0, 0x10011af4)
+       REG_RW(PCI_CMD_STS, 0x1, 0, 0x0405, )
+       REG_RO(PCI_RID_CC, 0x2, 0x01000000)
+       REG_RW(PCI_BAR0, 0x4, 1, 0x0000ffc0, )
+       REG_RO(PCI_SS, 0xb, 0x00021af4)
+       REG_RO(PCI_CAP, 0xd, 0x00)
+       REG_RW(PCI_INTR, 0xf, 0x0100, 0xff, ));
+#endif
@@ -0,0 +1,515 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#ifndef REGBASE
+#    include <services/Network.h>
+#    include <util/Sync.h>
+
+#    include "../bus/motherboard.h"
+#    include "../bus/helper.h"
+#    include "pci.h"
+
+using namespace nre;
+
+/**
+ * A virtio network card on a PCI card, using the legacy virtio PCI interface.
+ *
+ * The guest puts the frames to send into the transmit queue and notifies us with a single I/O
+ * port write for all of them. Frames that are contiguous in guest memory, which is the common
+ * case, are passed to the network backend without copying them. Received frames are copied
+ * directly into the buffers the guest has put into the receive queue. If there are none or the
+ * next one is too small, the frame is dropped, as a real network card would do it.
+ *
+ * State: unstable
+ * Features: PCI cfg space, receive and transmit queue, MAC address, IRQ
+ * Missing: MSI-X, control queue, checksum offloading, GSO, mergeable receive buffers
+ * Documentation: virtio spec 0.9.5
+ */
+class VirtioNet : public StaticReceiver<VirtioNet> {
+    enum {
+        QUEUE_SIZE          = 256,
+        RX_QUEUE            = 0,
+        TX_QUEUE            = 1,
+        QUEUE_COUNT         = 2,
+        // register offsets in the I/O BAR
+        REG_HOST_FEATURES   = 0x00,
+        REG_GUEST_FEATURES  = 0x04,
+        REG_QUEUE_PFN       = 0x08,
+        REG_QUEUE_SIZE      = 0x0c,
+        REG_QUEUE_SEL       = 0x0e,
+        REG_QUEUE_NOTIFY    = 0x10,
+        REG_STATUS          = 0x12,
+        REG_ISR             = 0x13,
+        REG_CONFIG          = 0x14,
+        // features
+        F_MAC               = 1 << 5,
+        HOST_FEATURES       = F_MAC,
+        // device status
+        STATUS_DRIVER_OK    = 4,
+        // descriptor and ring flags
+        DESC_F_NEXT         = 1,
+        DESC_F_WRITE        = 2,
+        AVAIL_F_NO_INTERRUPT = 1,
+        // the size of the header in front of each frame (without mergeable receive buffers)
+        HDR_SIZE            = 10,
+    };
+
+    struct Config {
+        uint8_t mac[6];
+    } PACKED;
+
+    /**
+     * The layout of our I/O BAR (see REG_*)
+     */
+    struct Regs {
+        uint32_t host_features;
+        uint32_t guest_features;
+        uint32_t queue_pfn;
+        uint16_t queue_size;
+        uint16_t queue_sel;
+        uint16_t queue_notify;
+        uint8_t status;
+        uint8_t isr;
+        Config config;
+    } PACKED;
+
+    struct Desc {
+        uint64_t addr;
+        uint32_t len;
+        uint16_t flags;
+        uint16_t next;
+    } PACKED;
+    struct Avail {
+        uint16_t flags;
+        uint16_t idx;
+        uint16_t ring[QUEUE_SIZE];
+    } PACKED;
+    struct UsedElem {
+        uint32_t id;
+        uint32_t len;
+    } PACKED;
+    struct Used {
+        uint16_t flags;
+        uint16_t idx;
+        UsedElem ring[QUEUE_SIZE];
+    } PACKED;
+
+    /**
+     * A virtqueue in guest memory
+     */
+    struct Queue {
+        uint32_t pfn;
+        uint16_t last_avail;
+        Desc *desc;
+        Avail *avail;
+        Used *used;
+    };
+
+#    define  REGBASE "virtionet.cc"
+#    include "reg.h"
+    DBus<MessageNetwork> &_bus_network;
+    DBus<MessageIrqLines> &_bus_irqlines;
+    LockDomain _domain;
+    unsigned char _irq;
+    uint32_t _bdf;
+    size_t _netnr;
+    Network::mac_type _mac;
+    char *_guest_mem;
+    size_t _guest_size;
+    uint32_t _guest_features;
+    uint16_t _queue_sel;
+    uint8_t _status;
+    uint8_t _isr;
+    Queue _queues[QUEUE_COUNT];
+    size_t _rx_dropped;
+    // for frames that are spread over multiple descriptors
+    unsigned char _txframe[Network::MAX_FRAME_SIZE];
+
+    static size_t used_offset() {
+        return Math::round_up<size_t>(sizeof(Desc) * QUEUE_SIZE + sizeof(Avail) + 2,
+                                      ExecEnv::PAGE_SIZE);
+    }
+
+    /**
+     * @return the pointer to guest-physical <addr>, if <len> bytes are available there
+     */
+    template<typename T>
+    T *guest_ptr(uint64_t addr, size_t len) const {
+        if(addr > _guest_size || len > _guest_size - addr)
+            return nullptr;
+        return reinterpret_cast<T*>(_guest_mem + addr);
+    }
+
+    void reset() {
+        _guest_features = 0;
+        _queue_sel = 0;
+        _status = 0;
+        _isr = 0;
+        memset(_queues, 0, sizeof(_queues));
+        update_irq();
+    }
+
+    void update_irq() {
+        MessageIrqLines msg(_isr ? MessageIrqLines::ASSERT_IRQ : MessageIrqLines::DEASSERT_IRQ,
+                            _irq);
+        _bus_irqlines.send(msg);
+    }
+
+    void set_queue(Queue &q, uint32_t pfn) {
+        uint64_t addr = static_cast<uint64_t>(pfn) << ExecEnv::PAGE_SHIFT;
+        char *queue = guest_ptr<char>(addr, used_offset() + sizeof(Used));
+        memset(&q, 0, sizeof(q));
+        if(!pfn || !queue)
+            return;
+        q.pfn = pfn;
+        q.desc = reinterpret_cast<Desc*>(queue);
+        q.avail = reinterpret_cast<Avail*>(queue + sizeof(Desc) * QUEUE_SIZE);
+        q.used = reinterpret_cast<Used*>(queue + used_offset());
+    }
+
+    /**
+     * @return true if the guest has put a buffer into <q> that we haven't used yet
+     */
+    bool has_avail(const Queue &q) const {
+        return q.avail && (_status & STATUS_DRIVER_OK) && q.last_avail != q.avail->idx;
+    }
+
+    uint16_t next_avail(Queue &q) {
+        // read the index before the ring entry
+        Sync::memory_barrier();
+        return q.avail->ring[q.last_avail++ % QUEUE_SIZE];
+    }
+
+    void put_used(Queue &q, uint16_t head, uint32_t len) {
+        UsedElem &elem = q.used->ring[q.used->idx % QUEUE_SIZE];
+        elem.id = head;
+        elem.len = len;
+        // the guest has to see the element before the index
+        Sync::memory_barrier();
+        q.used->idx++;
+        Sync::memory_barrier();
+    }
+
+    /**
+     * Raises an interrupt for <q>, unless the guest doesn't want one or it's still pending
+     */
+    void notify(const Queue &q) {
+        if(!(q.avail->flags & AVAIL_F_NO_INTERRUPT) && !(_isr & 1)) {
+            _isr |= 1;
+            update_irq();
+        }
+    }
+
+    /**
+     * Copies <len> bytes at offset <off> of the header plus frame to <dst>
+     */
+    static void copy_out(unsigned char *dst, size_t off, size_t len, const unsigned char *frame) {
+        // the header is empty, because we don't offer checksum offloading and GSO
+        if(off < HDR_SIZE) {
+            size_t amount = Math::min<size_t>(len, HDR_SIZE - off);
+            memset(dst, 0, amount);
+            dst += amount;
+            off += amount;
+            len -= amount;
+        }
+        memcpy(dst, frame + off - HDR_SIZE, len);
+    }
+
+    /**
+     * Counts a dropped frame and reports it from time to time
+     */
+    void drop_frame() {
+        if((++_rx_dropped & (_rx_dropped - 1)) == 0)
+            Serial::get().writef("virtio-net: dropped %zu received frames\n", _rx_dropped);
+    }
+
+    /**
+     * @return the number of bytes the descriptor chain starting at <head> can take or 0 if the
+     *  chain is invalid
+     */
+    size_t rx_capacity(const Queue &q, uint16_t head) const {
+        size_t capacity = 0;
+        uint16_t idx = head;
+        for(size_t i = 0; i < QUEUE_SIZE; ++i) {
+            const Desc &d = q.desc[idx];
+            if(!(d.flags & DESC_F_WRITE) || !guest_ptr<unsigned char>(d.addr, d.len))
+                return 0;
+            capacity += d.len;
+            if(!(d.flags & DESC_F_NEXT) || d.next >= QUEUE_SIZE)
+                break;
+            idx = d.next;
+        }
+        return capacity;
+    }
+
+    /**
+     * Puts the given frame into the next buffer of the receive queue. If the buffer is too small,
+     * the frame is dropped, but the buffer is kept for the following frames. Thus, an oversized
+     * frame never blocks the receive queue.
+     */
+    void receive_frame(const unsigned char *frame, size_t len) {
+        Queue &q = _queues[RX_QUEUE];
+        if(!has_avail(q)) {
+            drop_frame();
+            return;
+        }
+
+        // read the ring entry without consuming it, because we might not be able to use it
+        Sync::memory_barrier();
+        uint16_t head = q.avail->ring[q.last_avail % QUEUE_SIZE];
+        size_t total = HDR_SIZE + len;
+        size_t capacity = head < QUEUE_SIZE ? rx_capacity(q, head) : 0;
+        // an invalid buffer would stay at the head forever, so give it back to the guest
+        if(capacity == 0) {
+            q.last_avail++;
+            if(head < QUEUE_SIZE) {
+                put_used(q, head, 0);
+                notify(q);
+            }
+            drop_frame();
+            return;
+        }
+        if(capacity < total) {
+            drop_frame();
+            return;
+        }
+
+        // the guest might have changed the descriptors meanwhile, so check them again
+        size_t done = 0;
+        uint16_t idx = head;
+        for(size_t i = 0; i < QUEUE_SIZE && idx < QUEUE_SIZE && done < total; ++i) {
+            const Desc &d = q.desc[idx];
+            unsigned char *buf = guest_ptr<unsigned char>(d.addr, d.len);
+            if(!buf)
+                break;
+            size_t amount = Math::min<size_t>(d.len, total - done);
+            copy_out(buf, done, amount, frame);
+            done += amount;
+            idx = d.next;
+        }
+        if(done < total)
+            drop_frame();
+
+        q.last_avail++;
+        put_used(q, head, done < total ? 0 : total);
+        notify(q);
+    }
+
+    /**
+     * Sends the frame in the descriptor chain starting at <head>
+     */
+    void transmit(Queue &q, uint16_t head) {
+        const unsigned char *frame = nullptr;
+        size_t len = 0;
+        size_t skip = HDR_SIZE;
+        uint16_t idx = head;
+        for(size_t i = 0; i < QUEUE_SIZE; ++i) {
+            const Desc &d = q.desc[idx];
+            const unsigned char *buf = guest_ptr<unsigned char>(d.addr, d.len);
+            if(!buf || (d.flags & DESC_F_WRITE))
+                return;
+            size_t off = Math::min<size_t>(skip, d.len);
+            size_t amount = d.len - off;
+            skip -= off;
+            if(amount) {
+                if(len + amount > sizeof(_txframe))
+                    return;
+                // only copy the frame if it's spread over multiple descriptors
+                if(!frame)
+                    frame = buf + off;
+                else {
+                    if(frame != _txframe) {
+                        memcpy(_txframe, frame, len);
+                        frame = _txframe;
+                    }
+                    memcpy(_txframe + len, buf + off, amount);
+                }
+                len += amount;
+            }
+            if(!(d.flags & DESC_F_NEXT) || d.next >= QUEUE_SIZE)
+                break;
+            idx = d.next;
+        }
+        if(!frame)
+            return;
+
+        MessageNetwork msg(frame, len, _netnr);
+        _bus_network.send(msg);
+    }
+
+    /**
+     * Sends all frames the guest has added to the transmit queue since the last call.
+     */
+    void process_tx() {
+        Queue &q = _queues[TX_QUEUE];
+        bool sent = false;
+        while(has_avail(q)) {
+            uint16_t head = next_avail(q);
+            if(head >= QUEUE_SIZE)
+                continue;
+            // there is no way to report errors; the frame is simply lost
+            transmit(q, head);
+            put_used(q, head, 0);
+            sent = true;
+        }
+        if(sent)
+            notify(q);
+    }
+
+    Regs get_regs() const {
+        Regs regs;
+        memset(&regs, 0, sizeof(regs));
+        regs.host_features = HOST_FEATURES;
+        regs.guest_features = _guest_features;
+        if(_queue_sel < QUEUE_COUNT) {
+            regs.queue_pfn = _queues[_queue_sel].pfn;
+            regs.queue_size = QUEUE_SIZE;
+        }
+        regs.queue_sel = _queue_sel;
+        regs.status = _status;
+        regs.isr = _isr;
+        for(size_t i = 0; i < sizeof(regs.config.mac); ++i)
+            regs.config.mac[i] = _mac >> (8 * (sizeof(regs.config.mac) - 1 - i));
+        return regs;
+    }
+
+public:
+    bool receive(MessageNetwork &msg) {
+        // only take frames from the switch, so that we ignore the ones we send ourself
+        if(msg.type != MessageNetwork::PACKET || msg.client != _netnr || !msg.session)
+            return false;
+
+        ScopedLock<LockDomain> guard(&_domain);
+        receive_frame(msg.buffer, msg.len);
+        return true;
+    }
+
+    bool receive(MessageIOIn &msg) {
+        if((msg.port ^ PCI_BAR0) & PCI_BAR0_mask)
+            return false;
+
+        ScopedLock<LockDomain> guard(&_domain);
+        unsigned offset = msg.port & ~PCI_BAR0_mask;
+        unsigned size = 1 << msg.type;
+        Regs regs = get_regs();
+        if(offset + size > sizeof(regs))
+            return false;
+        msg.value = 0;
+        memcpy(&msg.value, reinterpret_cast<char*>(&regs) + offset, size);
+
+        // reading the ISR acknowledges the interrupt
+        if(offset == REG_ISR && _isr) {
+            _isr = 0;
+            update_irq();
+        }
+        return true;
+    }
+
+    bool receive(MessageIOOut &msg) {
+        if((msg.port ^ PCI_BAR0) & PCI_BAR0_mask)
+            return false;
+
+        ScopedLock<LockDomain> guard(&_domain);
+        unsigned offset = msg.port & ~PCI_BAR0_mask;
+        switch(offset) {
+            case REG_GUEST_FEATURES:
+                _guest_features = msg.value & HOST_FEATURES;
+                break;
+            case REG_QUEUE_PFN:
+                if(_queue_sel < QUEUE_COUNT)
+                    set_queue(_queues[_queue_sel], msg.value);
+                break;
+            case REG_QUEUE_SEL:
+                _queue_sel = msg.value;
+                break;
+            case REG_QUEUE_NOTIFY:
+                // new receive buffers are used as soon as the next frame arrives
+                if((msg.value & 0xffff) == TX_QUEUE)
+                    process_tx();
+                break;
+            case REG_STATUS:
+                _status = msg.value;
+                if(_status == 0)
+                    reset();
+                else
+                    process_tx();
+                break;
+            default:
+                // the config space is read-only
+                if(offset >= sizeof(Regs))
+                    return false;
+                break;
+        }
+        return true;
+    }
+
+    bool receive(MessagePciConfig &msg) {
+        ScopedLock<LockDomain> guard(&_domain);
+        return PciHelper::receive(msg, this, _bdf);
+    }
+
+    VirtioNet(DBus<MessageNetwork> &bus_network, DBus<MessageIrqLines> &bus_irqlines,
+              unsigned char irq, uint32_t bdf, size_t netnr, Network::mac_type mac,
+              char *guest_mem, size_t guest_size)
+        : _bus_network(bus_network), _bus_irqlines(bus_irqlines), _domain(), _irq(irq),
+          _bdf(bdf), _netnr(netnr), _mac(mac), _guest_mem(guest_mem), _guest_size(guest_size),
+          _guest_features(), _queue_sel(), _status(), _isr(), _queues(), _rx_dropped(),
+          _txframe() {
+        PCI_reset();
+        reset();
+        Serial::get().writef("virtio-net controller (bdf %#x) with MAC %012Lx\n", bdf,
+                             static_cast<unsigned long long>(mac));
+    }
+};
+
+PARAM_HANDLER(
+    virtionet,
+    "virtionet:iobase,irq,bdf,net - attach a virtio network card to a PCI bus.",
+    "Example: 'virtionet:0xc040,10,0x48,0' connects network 0 to 00:09.0 at port 0xc040, irq 10.",
+    "If no bdf is given, the first free one is searched. The network defaults to 0.") {
+    size_t netnr = argv[3] == ~0UL ? 0 : argv[3];
+    MessageHostOp msg0(MessageHostOp::OP_GET_MAC, netnr);
+    if(!mb.bus_hostop.send(msg0))
+        Util::panic("%s: unable to connect to network %lu\n", __PRETTY_FUNCTION__, netnr);
+
+    MessageHostOp msg1(MessageHostOp::OP_GUEST_MEM, 0UL);
+    if(!mb.bus_hostop.send(msg1))
+        Util::panic("%s: could not find base address of guest memory\n", __PRETTY_FUNCTION__);
+
+    uint32_t bdf = PciHelper::find_free_bdf(mb.bus_pcicfg, argv[2]);
+    VirtioNet *dev = new VirtioNet(mb.bus_network, mb.bus_irqlines, argv[1], bdf, netnr,
+                                   msg0.mac, msg1.ptr, msg1.len);
+    mb.bus_pcicfg.add(dev, VirtioNet::receive_static<MessagePciConfig> );
+    mb.bus_ioin.add(dev, VirtioNet::receive_static<MessageIOIn> );
+    mb.bus_ioout.add(dev, VirtioNet::receive_static<MessageIOOut> );
+    mb.bus_network.add(dev, VirtioNet::receive_static<MessageNetwork> );
+
+    // set default state; this is normally done by the BIOS
+    dev->PCI_write(VirtioNet::PCI_BAR0_offset, argv[0]);
+    dev->PCI_write(VirtioNet::PCI_INTR_offset, argv[1]);
+    // enable IRQ, IOPort access and bus mastering
+    dev->PCI_write(VirtioNet::PCI_CMD_STS_offset, 0x405);
+}
+#else
+REGSET(PCI,
+       REG_RO(PCI_ID, 0x0, 0x10001af4)
+       REG_RW(PCI_CMD_STS, 0x1, 0, 0x0405, )
+       REG_RO(PCI_RID_CC, 0x2, 0x02000000)
+       REG_RW(PCI_BAR0, 0x4, 1, 0x0000ffe0, )
+       REG_RO(PCI_SS, 0xb, 0x00011af4)
+       REG_RO(PCI_CAP, 0xd, 0x00)
+       REG_RW(PCI_INTR, 0xf, 0x0100, 0xff, ));
+#endif
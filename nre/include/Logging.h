@@ -69,15 +69,16 @@ public:
         STORAGE         = 1 << 19,
         STORAGE_DETAIL  = 1 << 20,
         CONSOLE         = 1 << 21,
+        NET             = 1 << 22,
     };
 
     static UserSm sm;
     static const int level = 0 |
 #ifndef NDEBUG
         CHILD_CREATE | MEM_MAP | CPUS | PLATFORM | CHILD_KILL | ACPI |
-        REBOOT | TIMER | KEYBOARD | STORAGE
+        REBOOT | TIMER | KEYBOARD | STORAGE | NET
 #else
-        CHILD_KILL | MEM_MAP | PLATFORM | KEYBOARD | TIMER | STORAGE
+        CHILD_KILL | MEM_MAP | PLATFORM | KEYBOARD | TIMER | STORAGE | NET
 #endif
     ;
 
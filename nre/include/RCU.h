@@ -35,8 +35,10 @@
  *
  * Please note that RCU::invalidate() doesn't ensure that all objects are deleted. That is, only
  * objects that are already safe to delete, are deleted. This way, there is no busy-waiting
- * going on until the deletion is possible. If that is important for you, you can use RCU::gc(true)
- * to force the method to wait until all objects can be deleted.
+ * going on until the deletion is possible. The remaining objects are deleted by a reclaim thread,
+ * which is woken up by the last reader that leaves its critical section. If you need the objects
+ * to be deleted at a specific point, you can use RCU::gc(true) to force the method to wait until
+ * all objects can be deleted.
  */
 
 /*
@@ -138,12 +140,7 @@ public:
         cur->_rcu_counter = counter;
         Sync::memory_barrier();
     }
-    void up() {
-        // ensure that everything in the critical section is written before the counter is increased
-        Sync::memory_barrier();
-        Thread *cur = Thread::current();
-        cur->_rcu_counter--;
-    }
+    inline void up();
 
 private:
     RCULock(const RCULock&);
@@ -217,6 +214,7 @@ public:
         }
 
         store_versions();
+        wait_for_readers();
     }
 
     /**
@@ -239,6 +237,7 @@ public:
             _objs->_state = RCUObject::DELETABLE;
 
         delete_objects();
+        wait_for_readers();
     }
 
     /**
@@ -249,6 +248,20 @@ public:
     }
 
 private:
+    friend class RCULock;
+
+    /**
+     * Is called by a reader that left its critical section, if objects are waiting for deletion.
+     * Wakes up the reclaim thread, which runs gc(false).
+     */
+    static void grace_period_end();
+    /**
+     * Lets the readers trigger the reclaim thread when they leave their critical section, if there
+     * are still objects that could not be deleted. Expects that _sm is held.
+     */
+    static void wait_for_readers();
+    NORETURN static void reclaim_thread(void*);
+
     static void delete_objects() {
         bool deletable = false;
         RCUObject *p = nullptr, *o = _objs;
@@ -320,6 +333,18 @@ private:
     // it would cause a deadlock.
     static UserSm _ecsm;
     static RCULock _lock;
+    // whether there are objects that wait for the end of the grace period
+    static volatile bool _waiting;
 };
 
+inline void RCULock::up() {
+    // ensure that everything in the critical section is written before the counter is increased
+    Sync::memory_barrier();
+    Thread *cur = Thread::current();
+    cur->_rcu_counter--;
+    // if we left the critical section and there are objects to delete, maybe we were the last one
+    if(EXPECT_FALSE(RCU::_waiting) && (cur->_rcu_counter & 0xFFFF) == 0)
+        RCU::grace_period_end();
+}
+
 }
@@ -83,40 +83,82 @@ public:
         return _inst;
     }
 
+    /**
+     * A small cache of single selectors that is kept per thread, so that the common pattern of
+     * allocating and freeing one selector doesn't need to take the global lock.
+     */
+    struct ThreadCache {
+        static const uint SIZE      = 8;
+        // marks the cache of a dying thread as unusable
+        static const uint DISABLED  = static_cast<uint>(-1);
+
+        explicit ThreadCache() : count(0), sels() {
+        }
+
+        uint count;
+        capsel_t sels[SIZE];
+    };
+
     /**
      * Allocates <count> selectors with alignment <align>.
      *
      * @param count the number of selectors to allocate (default = 1)
      * @param align the alignment of the selectors (default = 1). has to be a power of 2!
      */
-    capsel_t allocate(uint count = 1, uint align = 1) {
-        ScopedLock<SpinLock> lock(&_lck);
-        capsel_t res = (_off + align - 1) & ~(align - 1);
-        if(res + count < res || res + count > Hip::get().cfg_cap)
-            throw CapException(E_NO_CAP_SELS);
-        _off = res + count;
-        return res;
-    }
+    capsel_t allocate(uint count = 1, uint align = 1);
     /**
      * Free's the selectors <base>...<base>+<count>-1
      *
      * @param base the base of the selectors
      * @param count the number (default = 1)
      */
-    void free(UNUSED capsel_t base, UNUSED uint count = 1) {
-        // TODO implement me
-    }
+    void free(capsel_t base, uint count = 1);
+
+    /**
+     * Gives all selectors in the given cache back and disables it. This is called when the
+     * thread that owns the cache is destroyed.
+     *
+     * @param cache the cache
+     */
+    void flush(ThreadCache &cache);
 
 private:
-    explicit CapSelSpace() : _lck(), _off(Hip::get().object_caps()) {
-    }
+    /**
+     * A free, naturally aligned block of 2^order selectors. Freed blocks are merged with their
+     * buddies, if possible.
+     */
+    struct Block {
+        capsel_t base;
+        Block *next;
+    };
+
+    // the number of block descriptors that are available from the beginning, because we need the
+    // selector space before malloc works. if less than MIN_BLOCKS are left, we allocate
+    // GROW_BLOCKS more via malloc. only if that fails, freed selectors are lost.
+    static const size_t INIT_BLOCKS = 256;
+    static const size_t MIN_BLOCKS  = 32;
+    static const size_t GROW_BLOCKS = 128;
+    static const uint ORDERS        = sizeof(capsel_t) * 8;
+
+    explicit CapSelSpace();
 
     CapSelSpace(const CapSelSpace&);
     CapSelSpace& operator=(const CapSelSpace&);
 
+    static ThreadCache *cache();
+    bool take(uint order, capsel_t &base);
+    void add_range(capsel_t base, uint count);
+    void push(capsel_t base, uint order);
+    void grow();
+
     static CapSelSpace _inst;
     SpinLock _lck;
     capsel_t _off;
+    Block *_lists[ORDERS];
+    Block *_unused;
+    size_t _unused_count;
+    bool _growing;
+    Block _blocks[INIT_BLOCKS];
 };
 
 }
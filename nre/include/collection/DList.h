@@ -200,6 +200,28 @@ public:
         _len++;
         return iterator(static_cast<T*>(e->prev()), e);
     }
+    /**
+     * Inserts the given item after <p> into the list. This works in constant time.
+     *
+     * @param p the item to insert it after (nullptr = at the beginning)
+     * @param e the list item
+     * @return the position where it has been inserted
+     */
+    iterator insert(T *p, T *e) {
+        T *n = p ? static_cast<T*>(p->next()) : _head;
+        e->prev(p);
+        e->next(n);
+        if(p)
+            p->next(e);
+        else
+            _head = e;
+        if(n)
+            n->prev(e);
+        else
+            _tail = e;
+        _len++;
+        return iterator(p, e);
+    }
     /**
      * Removes the given item from the list. This works in constant time.
      * Expects that the item is in the list!
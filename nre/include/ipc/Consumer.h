@@ -18,6 +18,7 @@
 
 #include <kobj/Sm.h>
 #include <mem/DataSpace.h>
+#include <util/Atomic.h>
 #include <util/Sync.h>
 #include <util/Math.h>
 
@@ -29,11 +30,24 @@ class Producer;
 /**
  * Consumer-part for the producer-consumer-communication over a dataspace.
  *
+ * The consumer announces in the shared state whether it is sleeping (or about to) and the
+ * producer does only notify it via the semaphore in this case. Thus, as long as the consumer is
+ * busy, producing items does not cause any system calls.
+ *
+ * Optionally, the producer can wait until there are free slots (see Producer::wait_free()). For
+ * that, the consumer needs a second semaphore, which it ups in next() if the producer waits.
+ *
  * Usage-example:
  * Consumer<char> cons(&ds);
  * for(char *c; (c = cons->get()) != nullptr; cons.next()) {
  *   // do something with *c
  * }
+ *
+ * Or, to handle multiple items at once:
+ * for(size_t n; (n = cons.get_batch()) > 0; cons.next(n)) {
+ *   for(size_t i = 0; i < n; ++i)
+ *     // do something with *cons.item(i)
+ * }
  */
 template<typename T>
 class Consumer {
@@ -42,6 +56,10 @@ class Consumer {
     struct Interface {
         volatile size_t rpos;
         volatile size_t wpos;
+        // whether the consumer waits for a notification
+        volatile word_t sleeping;
+        // whether the producer waits for free slots
+        volatile word_t waiting;
         T buffer[];
     };
 
@@ -54,14 +72,21 @@ public:
      * @param init whether the consumer should init the state. this should only be done by one
      *  party and preferably by the first one. That is, if the client is the consumer it should
      *  init it (because it will create the dataspace and share it to the service).
+     * @param offset the offset in the dataspace where the ring-buffer starts
+     * @param size the size of the ring-buffer in bytes (0 = till the end of the dataspace)
+     * @param space the semaphore to notify the producer about free slots, if it waits for them
+     *  (optional)
      */
-    explicit Consumer(DataSpace &ds, Sm &sm, bool init = false)
-        : _ds(ds), _if(reinterpret_cast<Interface*>(ds.virt())),
-          _max(Math::prev_pow2((ds.size() - sizeof(Interface)) / sizeof(T))),
-          _sm(sm), _stop(false) {
+    explicit Consumer(DataSpace &ds, Sm &sm, bool init = false, size_t offset = 0, size_t size = 0,
+                      Sm *space = nullptr)
+        : _ds(ds), _if(reinterpret_cast<Interface*>(ds.virt() + offset)),
+          _max(Math::prev_pow2(((size ? size : ds.size() - offset) - sizeof(Interface)) / sizeof(T))),
+          _sm(sm), _space(space), _stop(false) {
         if(init) {
             _if->rpos = 0;
             _if->wpos = 0;
+            _if->sleeping = 0;
+            _if->waiting = 0;
         }
     }
 
@@ -94,6 +119,13 @@ public:
         return _if->rpos != _if->wpos;
     }
 
+    /**
+     * @return the number of items that are available at the moment
+     */
+    size_t available() const {
+        return (_if->wpos - _if->rpos) & (_max - 1);
+    }
+
     /**
      * Retrieves the item at current position. If there is no item anymore, it blocks until the
      * producer notifies it, that there is data available. You might interrupt that by using stop().
@@ -104,33 +136,98 @@ public:
      * @return pointer to the data
      */
     T *get() {
+        if(EXPECT_FALSE(!wait()))
+            return nullptr;
+        return _if->buffer + _if->rpos;
+    }
+
+    /**
+     * Waits until there is at least one item, like get(), and returns the number of items that
+     * are available. You can access them via item() and have to call next(n) afterwards.
+     *
+     * @return the number of available items (0 if it has been stopped and there is no data)
+     */
+    size_t get_batch() {
+        if(EXPECT_FALSE(!wait()))
+            return 0;
+        return available();
+    }
+
+    /**
+     * @param i the index, relative to the current position (has to be below the number of
+     *  available items)
+     * @return the i'th item
+     */
+    T *item(size_t i) {
+        return _if->buffer + ((_if->rpos + i) & (_max - 1));
+    }
+
+    /**
+     * Tells the producer that you're done working with the current <n> items (i.e. the producer
+     * will never touch the items while you're working with them). If the producer waits for
+     * free slots, it is notified.
+     *
+     * @param n the number of items
+     */
+    void next(size_t n = 1) {
+        _if->rpos = (_if->rpos + n) & (_max - 1);
+        if(_space) {
+            // pairs with the fence in Producer::prepare_wait()
+            Sync::memory_fence();
+            // only the one that resets the flag notifies the producer
+            if(_if->waiting && Atomic::cmpnswap(&_if->waiting, 1UL, 0UL)) {
+                try {
+                    _space->up();
+                }
+                catch(...) {
+                    // the producer might be gone already
+                }
+            }
+        }
+    }
+
+    /**
+     * Tells the producer that the consumer is about to block on the semaphore and checks again
+     * afterwards whether there is data available. get() and get_batch() do that on their own;
+     * this is intended for consumers that wait for multiple rings with one semaphore.
+     *
+     * @return true if there is data available, i.e. you should not block
+     */
+    bool prepare_wait() {
+        // afterwards, check again, because the producer might have produced something in the
+        // meantime without seeing the flag.
+        _if->sleeping = 1;
+        Sync::memory_fence();
+        if(_if->rpos != _if->wpos) {
+            _if->sleeping = 0;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    bool wait() {
         while(EXPECT_FALSE(_if->rpos == _if->wpos)) {
             if(EXPECT_FALSE(_stop))
-                return nullptr;
+                return false;
+            if(prepare_wait())
+                break;
             // they might fail if someone revokes the Sm-caps
             try {
                 _sm.zero();
             }
             catch(...) {
-                return nullptr;
+                return false;
             }
         }
-        return _if->buffer + _if->rpos;
+        return true;
     }
 
-    /**
-     * Tells the producer that you're done working with the current item (i.e. the producer will
-     * never touch the item while you're working with it)
-     */
-    void next() {
-        _if->rpos = (_if->rpos + 1) & (_max - 1);
-    }
-
-private:
     DataSpace &_ds;
     Interface *_if;
     size_t _max;
     Sm &_sm;
+    Sm *_space;
     bool _stop;
 };
 
@@ -18,6 +18,7 @@
 
 #include <mem/DataSpace.h>
 #include <ipc/Consumer.h>
+#include <util/Atomic.h>
 #include <util/Sync.h>
 #include <util/Math.h>
 #include <cstdlib>
@@ -25,7 +26,12 @@
 namespace nre {
 
 /**
- * Producer-part for the producer-consumer-communication over a dataspace.
+ * Producer-part for the producer-consumer-communication over a dataspace. The consumer is only
+ * notified if it announced that it is sleeping (see Consumer).
+ *
+ * Besides producing item by item, you can put multiple items into the free slots (see free()
+ * and slot()) and publish them at once with commit(), or use produce_batch(). If the consumer
+ * has been created with a semaphore for free slots, you can wait for them with wait_free().
  */
 template<typename T>
 class Producer {
@@ -38,14 +44,19 @@ public:
      * @param init whether the producer should init the state. this should only be done by one
      *  party and preferably by the first one. That is, if the client is the producer it should
      *  init it (because it will create the dataspace and share it to the service).
+     * @param offset the offset in the dataspace where the ring-buffer starts
+     * @param size the size of the ring-buffer in bytes (0 = till the end of the dataspace)
      */
-    explicit Producer(DataSpace &ds, Sm &sm, bool init = true)
-        : _ds(ds), _if(reinterpret_cast<typename Consumer<T>::Interface*>(ds.virt())),
-          _max(Math::prev_pow2((ds.size() - sizeof(typename Consumer<T>::Interface)) / sizeof(T))),
+    explicit Producer(DataSpace &ds, Sm &sm, bool init = true, size_t offset = 0, size_t size = 0)
+        : _ds(ds), _if(reinterpret_cast<typename Consumer<T>::Interface*>(ds.virt() + offset)),
+          _max(Math::prev_pow2(((size ? size : ds.size() - offset) -
+                                sizeof(typename Consumer<T>::Interface)) / sizeof(T))),
           _sm(sm) {
         if(init) {
             _if->rpos = 0;
             _if->wpos = 0;
+            _if->sleeping = 0;
+            _if->waiting = 0;
         }
     }
 
@@ -68,18 +79,80 @@ public:
         return _if->buffer + _if->wpos;
     }
 
+    /**
+     * @return the number of free slots at the moment
+     */
+    size_t free() const {
+        return (_if->rpos - _if->wpos - 1) & (_max - 1);
+    }
+
+    /**
+     * @param i the index, relative to the current position (has to be below free())
+     * @return the i'th free slot
+     */
+    T *slot(size_t i) {
+        return _if->buffer + ((_if->wpos + i) & (_max - 1));
+    }
+
     /**
      * Moves to the next slot. That is, the position is moved forward and the consumer is notified,
-     * that new data is available
+     * that new data is available.
      */
     void next() {
-        _if->wpos = (_if->wpos + 1) & (_max - 1);
-        Sync::memory_barrier();
-        try {
-            _sm.up();
+        commit(1);
+    }
+
+    /**
+     * Publishes the next <n> slots, which have to be written before. The consumer is notified
+     * only once and only if it is sleeping.
+     *
+     * @param n the number of slots (has to be <= free())
+     */
+    void commit(size_t n) {
+        _if->wpos = (_if->wpos + n) & (_max - 1);
+        Sync::memory_fence();
+        // only the one that resets the flag notifies the consumer
+        if(_if->sleeping && Atomic::cmpnswap(&_if->sleeping, 1UL, 0UL)) {
+            try {
+                _sm.up();
+            }
+            catch(...) {
+                // if the client closed the session, we might get here. so, just ignore it.
+            }
+        }
+    }
+
+    /**
+     * Tells the consumer that we're about to block until at least <n> slots are free and checks
+     * again afterwards. This requires that the consumer has been created with a semaphore for
+     * free slots, which it ups in next() in this case.
+     *
+     * @param n the number of slots
+     * @return true if there are <n> free slots, i.e. you should not block
+     */
+    bool prepare_wait(size_t n = 1) {
+        _if->waiting = 1;
+        // pairs with the fence in Consumer::next()
+        Sync::memory_fence();
+        if(free() >= n) {
+            _if->waiting = 0;
+            return true;
         }
-        catch(...) {
-            // if the client closed the session, we might get here. so, just ignore it.
+        return false;
+    }
+
+    /**
+     * Blocks on <space> until at least <n> slots are free. <space> has to be the semaphore that
+     * the consumer uses to notify us about free slots. Note that there can only be one party
+     * that waits for free slots at a time.
+     *
+     * @param n the number of slots (has to be below rblength())
+     * @param space the semaphore
+     */
+    void wait_free(size_t n, Sm &space) {
+        while(free() < n) {
+            if(!prepare_wait(n))
+                space.zero();
         }
     }
 
@@ -99,6 +172,22 @@ public:
         return slot != 0;
     }
 
+    /**
+     * Produces as many of the given items as there are free slots and publishes them at once.
+     *
+     * @param values the values to produce
+     * @param count the number of values
+     * @return the number of produced items
+     */
+    size_t produce_batch(const T *values, size_t count) {
+        size_t n = Math::min(count, free());
+        for(size_t i = 0; i < n; ++i)
+            *slot(i) = values[i];
+        if(n > 0)
+            commit(n);
+        return n;
+    }
+
 private:
     DataSpace &_ds;
     typename Consumer<T>::Interface * _if;
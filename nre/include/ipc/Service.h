@@ -61,8 +61,8 @@ class Service {
     friend class SessionIterator;
 
 public:
-    static const uint MAX_SESSIONS_ORDER        =   6;
-    static const size_t MAX_SESSIONS            =   1 << MAX_SESSIONS_ORDER;
+    static const uint CHUNK_ORDER               =   6;
+    static const size_t CHUNK_SIZE              =   1 << CHUNK_ORDER;
 
     /**
      * The commands the parent provides for working with services
@@ -85,9 +85,9 @@ public:
      */
     explicit Service(const char *name, const CPUSet &cpus, Pt::portal_func portal)
         : _regcaps(CapSelSpace::get().allocate(1 << CPU::order(), 1 << CPU::order())),
-          _caps(CapSelSpace::get().allocate(MAX_SESSIONS << CPU::order(), MAX_SESSIONS << CPU::order())),
           _sm(), _kill_sm(), _stop(false), _name(name), _func(portal),
-          _insts(new ServiceCPUHandler *[CPU::count()]), _reg_cpus(cpus.get()), _sessions() {
+          _insts(new ServiceCPUHandler *[CPU::count()]), _reg_cpus(cpus.get()),
+          _chunks(new ChunkTable(0)), _first(), _last() {
         for(size_t i = 0; i < CPU::count(); ++i) {
             if(_reg_cpus.is_set(i))
                 _insts[i] = new ServiceCPUHandler(this, _regcaps + i, i);
@@ -99,15 +99,15 @@ public:
      * Destroys this service, i.e. destroys all sessions. You should have called unreg() before.
      */
     virtual ~Service() {
-        for(size_t i = 0; i < MAX_SESSIONS; ++i) {
-            ServiceSession *sess = rcu_dereference(_sessions[i]);
-            if(sess)
-                remove_session(sess);
-        }
+        while(_first)
+            remove_session(_first);
+        RCU::gc(true);
+        for(size_t i = 0; i < _chunks->count; ++i)
+            delete _chunks->chunks[i];
+        delete _chunks;
         for(size_t i = 0; i < CPU::count(); ++i)
             delete _insts[i];
         delete[] _insts;
-        CapSelSpace::get().free(_caps, MAX_SESSIONS << CPU::order());
         CapSelSpace::get().free(_regcaps, 1 << CPU::order());
     }
 
@@ -145,12 +145,6 @@ public:
     Pt::portal_func portal() const {
         return _func;
     }
-    /**
-     * @return the capabilities used for all session-portals
-     */
-    capsel_t caps() const {
-        return _caps;
-    }
     /**
      * @return the bitmask that specified on which CPUs it is available
      */
@@ -160,7 +154,8 @@ public:
 
     /**
      * @return the iterator-beginning to walk over all sessions (note that you need to use an
-     *  RCULock to prevent that sessions are destroyed while iterating over them)
+     *  RCULock to prevent that sessions are destroyed while iterating over them). Only the live
+     *  sessions are visited, in the order of their creation
      */
     template<class T>
     SessionIterator<T> sessions_begin();
@@ -177,7 +172,10 @@ public:
      */
     template<class T>
     T *get_session(capsel_t pid) {
-        return get_session_by_id<T>((pid - _caps) >> CPU::order());
+        T *sess = static_cast<T*>(session_by_pt(pid));
+        if(!sess)
+            VTHROW(ServiceException, E_ARGS_INVALID, "No session for portal " << pid);
+        return sess;
     }
     /**
      * @param id the session-id
@@ -186,7 +184,7 @@ public:
      */
     template<class T>
     T *get_session_by_id(size_t id) {
-        T *sess = static_cast<T*>(rcu_dereference(_sessions[id]));
+        T *sess = static_cast<T*>(session(id));
         if(!sess)
             VTHROW(ServiceException, E_ARGS_INVALID, "Session " << id << " does not exist");
         return sess;
@@ -211,6 +209,92 @@ protected:
     ServiceSession *new_session(capsel_t cap);
 
 private:
+    /**
+     * The sessions are stored in chunks of CHUNK_SIZE slots, that are allocated on demand,
+     * together with the selectors for the portals of their sessions. This way, we can support
+     * any number of sessions without wasting memory or selectors for services with only a few
+     * clients. Chunks are not freed before the service is destroyed, so that readers only need
+     * to hold the RCULock.
+     */
+    struct Chunk {
+        explicit Chunk()
+            : caps(CapSelSpace::get().allocate(caps_count(), caps_count())), used(), sessions() {
+        }
+        ~Chunk() {
+            CapSelSpace::get().free(caps, caps_count());
+        }
+
+        /**
+         * @return the number of selectors for the portals of all sessions in a chunk
+         */
+        static size_t caps_count() {
+            return CHUNK_SIZE << CPU::order();
+        }
+        /**
+         * @return the order of caps_count(). since the selectors of a chunk are aligned to
+         *  caps_count(), all portals of a chunk have the same key <pid> >> caps_order()
+         */
+        static uint caps_order() {
+            return CHUNK_ORDER + CPU::order();
+        }
+
+        capsel_t caps;
+        size_t used;
+        ServiceSession *sessions[CHUNK_SIZE];
+    };
+
+    /**
+     * The table of all chunks. It is replaced by a larger copy if a chunk is added, so that
+     * readers always see a consistent table. Besides the chunks in the order of their session-ids,
+     * it holds an index that maps the selector-range of a chunk to the chunk. The index is an
+     * open-addressed hashtable with at least twice as many entries as chunks, so that a portal
+     * is found in a constant number of steps.
+     */
+    struct ChunkTable : public RCUObject {
+        explicit ChunkTable(size_t count)
+            : RCUObject(), count(count), chunks(new Chunk *[count]), mask(index_size(count) - 1),
+              index(new Chunk *[mask + 1]()) {
+        }
+        virtual ~ChunkTable() {
+            delete[] index;
+            delete[] chunks;
+        }
+
+        /**
+         * Puts <c> into the index
+         */
+        void insert(Chunk *c) {
+            size_t i = (c->caps >> Chunk::caps_order()) & mask;
+            while(index[i])
+                i = (i + 1) & mask;
+            index[i] = c;
+        }
+        /**
+         * @param pid the portal selector
+         * @return the chunk that contains <pid> or nullptr
+         */
+        Chunk *find(capsel_t pid) const {
+            capsel_t key = pid >> Chunk::caps_order();
+            for(size_t i = key & mask; index[i]; i = (i + 1) & mask) {
+                if((index[i]->caps >> Chunk::caps_order()) == key)
+                    return index[i];
+            }
+            return nullptr;
+        }
+
+        static size_t index_size(size_t count) {
+            size_t size = 2;
+            while(size < count * 2)
+                size <<= 1;
+            return size;
+        }
+
+        size_t count;
+        Chunk **chunks;
+        size_t mask;
+        Chunk **index;
+    };
+
     /**
      * May be overwritten to create an inherited class from ServiceSession.
      *
@@ -249,15 +333,55 @@ private:
         uf.check_reply();
     }
 
+    // the max. number of dead sessions to collect in one pass of check_sessions()
+    static const size_t MAX_DEAD    = 16;
+
+    ServiceSession *session(size_t id) {
+        ChunkTable *t = rcu_dereference(_chunks);
+        if((id >> CHUNK_ORDER) >= t->count)
+            return nullptr;
+        Chunk *c = t->chunks[id >> CHUNK_ORDER];
+        return rcu_dereference(c->sessions[id & (CHUNK_SIZE - 1)]);
+    }
+    ServiceSession *session_by_pt(capsel_t pid) {
+        ChunkTable *t = rcu_dereference(_chunks);
+        Chunk *c = t->find(pid);
+        if(!c)
+            return nullptr;
+        return rcu_dereference(c->sessions[(pid - c->caps) >> CPU::order()]);
+    }
     void add_session(ServiceSession *sess) {
-        rcu_assign_pointer(_sessions[sess->id()], sess);
+        Chunk *c = _chunks->chunks[sess->id() >> CHUNK_ORDER];
+        c->used++;
+        // the session has to be initialized before it's reachable via the list
+        sess->_prev = _last;
+        sess->_next = nullptr;
+        if(_last)
+            rcu_assign_pointer(_last->_next, sess);
+        else
+            rcu_assign_pointer(_first, sess);
+        _last = sess;
+        rcu_assign_pointer(c->sessions[sess->id() & (CHUNK_SIZE - 1)], sess);
         created_session(sess->id());
     }
     void remove_session(ServiceSession *sess) {
-        rcu_assign_pointer(_sessions[sess->id()], nullptr);
+        Chunk *c = _chunks->chunks[sess->id() >> CHUNK_ORDER];
+        rcu_assign_pointer(c->sessions[sess->id() & (CHUNK_SIZE - 1)], nullptr);
+        c->used--;
+        // readers that are currently at <sess> can still follow its _next pointer
+        if(sess->_prev)
+            rcu_assign_pointer(sess->_prev->_next, sess->_next);
+        else
+            rcu_assign_pointer(_first, sess->_next);
+        if(sess->_next)
+            sess->_next->_prev = sess->_prev;
+        else
+            _last = sess->_prev;
         sess->invalidate();
+        // revoke the portals now to be able to reuse the slot immediately. the object itself is
+        // deleted as soon as nobody can access it anymore
+        sess->destroy_portals();
         RCU::invalidate(sess);
-        RCU::gc(true);
     }
     void check_sessions();
     void destroy_session(capsel_t pid);
@@ -266,7 +390,6 @@ private:
     Service& operator=(const Service&);
 
     capsel_t _regcaps;
-    capsel_t _caps;
     UserSm _sm;
     Sm *_kill_sm;
     bool _stop;
@@ -274,13 +397,15 @@ private:
     Pt::portal_func _func;
     ServiceCPUHandler **_insts;
     BitField<Hip::MAX_CPUS> _reg_cpus;
-    ServiceSession *_sessions[MAX_SESSIONS];
+    ChunkTable *_chunks;
+    ServiceSession *_first;
+    ServiceSession *_last;
 };
 
 /**
- * The iterator to walk forwards or backwards over all sessions. We need that, because we have to
- * skip unused slots. Note that the iterator assumes that no sessions are destroyed while being
- * used. Sessions may be added or removed in the meanwhile.
+ * The iterator to walk over all sessions. It follows the list of live sessions, i.e. it doesn't
+ * need to skip unused slots. Note that the iterator assumes that no sessions are destroyed while
+ * being used. Sessions may be added or removed in the meanwhile.
  */
 template<class T>
 class SessionIterator {
@@ -288,12 +413,11 @@ class SessionIterator {
 
 public:
     /**
-     * Creates an iterator that starts at given position
+     * Creates an iterator that starts at given session
      *
-     * @param s the service
-     * @param pos the start-position (index into session-array)
+     * @param sess the session (nullptr = end)
      */
-    explicit SessionIterator(Service *s, ssize_t pos = 0) : _s(s), _pos(pos), _last(next()) {
+    explicit SessionIterator(ServiceSession *sess = nullptr) : _last(static_cast<T*>(sess)) {
     }
 
     T & operator*() const {
@@ -303,10 +427,8 @@ public:
         return &operator*();
     }
     SessionIterator & operator++() {
-        if(_pos < static_cast<ssize_t>(Service::MAX_SESSIONS) - 1) {
-            _pos++;
-            _last = next();
-        }
+        if(_last)
+            _last = static_cast<T*>(rcu_dereference(_last->_next));
         return *this;
     }
     SessionIterator operator++(int) {
@@ -314,58 +436,25 @@ public:
         operator++();
         return tmp;
     }
-    SessionIterator & operator--() {
-        if(_pos > 0) {
-            _pos--;
-            _last = prev();
-        }
-        return *this;
-    }
-    SessionIterator operator--(int) {
-        SessionIterator<T> tmp(*this);
-        operator++();
-        return tmp;
-    }
     bool operator==(const SessionIterator<T>& rhs) const {
-        return _pos == rhs._pos;
+        return _last == rhs._last;
     }
     bool operator!=(const SessionIterator<T>& rhs) const {
-        return _pos != rhs._pos;
+        return _last != rhs._last;
     }
 
 private:
-    T *next() {
-        while(_pos < static_cast<ssize_t>(Service::MAX_SESSIONS)) {
-            T *t = static_cast<T*>(rcu_dereference(_s->_sessions[_pos]));
-            if(t)
-                return t;
-            _pos++;
-        }
-        return nullptr;
-    }
-    T *prev() {
-        while(_pos >= 0) {
-            T *t = static_cast<T*>(rcu_dereference(_s->_sessions[_pos]));
-            if(t)
-                return t;
-            _pos--;
-        }
-        return nullptr;
-    }
-
-    Service* _s;
-    ssize_t _pos;
     T *_last;
 };
 
 template<class T>
 SessionIterator<T> Service::sessions_begin() {
-    return SessionIterator<T>(this);
+    return SessionIterator<T>(rcu_dereference(_first));
 }
 
 template<class T>
 SessionIterator<T> Service::sessions_end() {
-    return SessionIterator<T>(this, MAX_SESSIONS);
+    return SessionIterator<T>();
 }
 
 }
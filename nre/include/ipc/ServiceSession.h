@@ -23,6 +23,8 @@
 namespace nre {
 
 class Service;
+template<class T>
+class SessionIterator;
 
 /**
  * The server-part of a session. This way the service can manage per-session-data. That is,
@@ -32,6 +34,8 @@ class Service;
 class ServiceSession : public RCUObject {
     friend class Service;
     friend class ServiceCPUHandler;
+    template<class T>
+    friend class SessionIterator;
 
 public:
     /**
@@ -49,8 +53,7 @@ public:
      * Destroyes this session
      */
     virtual ~ServiceSession() {
-        for(uint i = 0; i < CPU::count(); ++i)
-            delete _pts[i];
+        destroy_portals();
         delete[] _pts;
     }
 
@@ -82,10 +85,21 @@ protected:
     }
 
 private:
+    void destroy_portals() {
+        for(uint i = 0; i < CPU::count(); ++i) {
+            delete _pts[i];
+            _pts[i] = nullptr;
+        }
+    }
+
     size_t _id;
     capsel_t _cap;
     capsel_t _caps;
     Pt **_pts;
+    // the list of live sessions in the service. _next is RCU-protected, _prev is only used by
+    // the writer
+    ServiceSession *_prev;
+    ServiceSession *_next;
 };
 
 }
@@ -50,6 +50,7 @@ protected:
 public:
     /**
      * Destructor. Depending on the flags, it frees the selector and/or the capability (revoke).
+     * Note that the selector is only freed if the capability is revoked as well.
      */
     virtual ~ObjCap();
 
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <arch/ExecEnv.h>
+#include <cap/CapSelSpace.h>
 #include <kobj/Ec.h>
 #include <collection/SList.h>
 #include <util/Atomic.h>
@@ -39,12 +40,15 @@ class Utcb;
 class Thread : public Ec, public SListItem {
     friend class RCU;
     friend class RCULock;
+    friend class CapSelSpace;
 
     static const size_t TLS_SIZE    = 4;
 
 public:
     // the slot 0 is reserved for putting a ec-parameter in it
     static const size_t TLS_PARAM   = 0;
+    // the slot 1 is reserved for the per-thread cache of malloc
+    static const size_t TLS_MALLOC  = 1;
     enum Flags {
         HAS_OWN_STACK   = 1,
         HAS_OWN_UTCB    = 2,
@@ -152,6 +156,7 @@ private:
     uintptr_t _stack_addr;
     uint _flags;
     void *_tls[TLS_SIZE];
+    CapSelSpace::ThreadCache _capsels;
     static size_t _tls_idx;
 };
 
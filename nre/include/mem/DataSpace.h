@@ -65,6 +65,12 @@ public:
      * @throws DataSpaceException if the creation failed
      */
     static void create(DataSpaceDesc &desc, capsel_t *sel = nullptr, capsel_t *unmapsel = nullptr);
+    /**
+     * Destroys the dataspace with given properties and capability selectors, which has been
+     * created by create(desc, sel, unmapsel). Frees the selectors afterwards. This function is
+     * only intended for the malloc-backend as well.
+     */
+    static void destroy(const DataSpaceDesc &desc, capsel_t sel, capsel_t unmapsel);
 
     /**
      * Creates a new dataspace with given properties
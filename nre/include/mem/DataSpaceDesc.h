@@ -45,6 +45,9 @@ public:
         RX          = R | X,
         RWX         = R | W | X,
         BIGPAGES    = 1 << 3,   // use 4M pages; requires an align to 4M
+        // map as much as possible on the first pagefault instead of growing the mapped window
+        // step by step (the bit 4 is used by ChildMemory)
+        POPULATE    = 1 << 5,
     };
 
     /**
@@ -20,6 +20,7 @@
 #include <kobj/UserSm.h>
 #include <collection/Treap.h>
 #include <Exception.h>
+#include <new>
 
 namespace nre {
 
@@ -33,37 +34,61 @@ static OStream &operator<<(OStream &os, const DataSpaceManager<DS> &mng);
  * The DataSpaceManager is responsible for keeping track of the number of references to a dataspace.
  * That is, you can create dataspaces, join dataspaces and release them again and this class will
  * make sure, that a dataspace is destroyed only when there are no references anymore.
+ *
+ * The dataspaces are indexed by their selector and their unmap selector, so that all lookups
+ * are logarithmic. The slots are allocated in pages, which are dataspaces of type DS as well,
+ * because DS might be the dataspace we're building dynamic memory with (in root). For the same
+ * reason, the construction and destruction of dataspaces is serialized, while the index has its
+ * own lock that is only held for a short time. Thus, joining an existing dataspace does not
+ * have to wait until the creation of a different one is finished.
  */
 template<class DS>
 class DataSpaceManager {
     template<class DS2>
     friend OStream & operator<<(OStream &os, const DataSpaceManager<DS2> &mng);
 
-    static const size_t MAX_SLOTS   = 512;
+    struct Slot;
+
+    /**
+     * The node to find a slot by the selector of the dataspace
+     */
+    struct SelNode : public TreapNode<capsel_t> {
+        explicit SelNode(Slot *slot) : TreapNode<capsel_t>(0), slot(slot) {
+        }
+        Slot *slot;
+    };
 
     /**
-     * We use a treap here and use the unmap selector as key. this way, we can quickly find a ds
-     * by the unmap selector. unfortunatly, we have to be able to find a ds by its selector as
-     * well. we do that by linear searching. but we need the first one more often, therefore
-     * its better to do it this way, I think.
-     * TODO an idea would be to define that both selectors are always directly together.
-     * That is, sel=X, unmapsel=X+1. this way we could use _tree.find() here as well. but I'm not
-     * sure if we should do that, because it should be transparent for the user and I think its
-     * difficult to achieve that.
+     * A slot is directly found by the unmap selector of the dataspace
      */
     struct Slot : public TreapNode<capsel_t> {
-        Slot() : TreapNode<capsel_t>(0), ds(), refs(), next() {
+        explicit Slot() : TreapNode<capsel_t>(0), selnode(this), ds(), refs(), next() {
         }
+        SelNode selnode;
         DS *ds;
         unsigned refs;
         Slot *next;
     };
 
+    /**
+     * The header of a page of slots
+     */
+    struct Chunk {
+        DS *ds;
+        Chunk *next;
+    };
+
+    static const size_t SLOTS_PER_CHUNK = (ExecEnv::PAGE_SIZE - sizeof(Chunk)) / sizeof(Slot);
+
 public:
-    explicit DataSpaceManager() : _sm(), _tree(), _free(nullptr), _slots() {
-        for(size_t i = 0; i < MAX_SLOTS; ++i) {
-            _slots[i].next = _free;
-            _free = _slots + i;
+    explicit DataSpaceManager()
+        : _sm(), _objsm(), _unmaps(), _sels(), _free(nullptr), _chunks(nullptr) {
+    }
+    ~DataSpaceManager() {
+        while(_chunks) {
+            Chunk *c = _chunks;
+            _chunks = c->next;
+            delete c->ds;
         }
     }
 
@@ -76,12 +101,18 @@ public:
      * @throws DataSpaceException if there are no free slots anymore
      */
     const DS &create(const DataSpaceDesc& desc) {
+        ScopedLock<UserSm> objguard(&_objsm);
+        Slot *slot = alloc_slot();
+        try {
+            slot->ds = new DS(desc);
+        }
+        catch(...) {
+            free_slot(slot);
+            throw;
+        }
+
         ScopedLock<UserSm> guard(&_sm);
-        Slot *slot = find_free();
-        slot->ds = new DS(desc);
-        slot->refs = 1;
-        slot->key(slot->ds->unmapsel());
-        _tree.insert(slot);
+        add(slot);
         return *slot->ds;
     }
 
@@ -93,17 +124,27 @@ public:
      * @throws DataSpaceException if there are no free slots anymore
      */
     const DS &join(capsel_t sel) {
-        ScopedLock<UserSm> guard(&_sm);
-        Slot *slot = find(sel);
-        if(!slot) {
-            slot = find_free();
+        const DS *ds = join_existing(sel);
+        if(ds)
+            return *ds;
+
+        ScopedLock<UserSm> objguard(&_objsm);
+        // somebody else might have joined it in the meanwhile
+        ds = join_existing(sel);
+        if(ds)
+            return *ds;
+
+        Slot *slot = alloc_slot();
+        try {
             slot->ds = new DS(sel);
-            slot->refs = 1;
-            slot->key(slot->ds->unmapsel());
-            _tree.insert(slot);
         }
-        else
-            slot->refs++;
+        catch(...) {
+            free_slot(slot);
+            throw;
+        }
+
+        ScopedLock<UserSm> guard(&_sm);
+        add(slot);
         return *slot->ds;
     }
 
@@ -115,8 +156,8 @@ public:
      */
     void swap(capsel_t ds1, capsel_t ds2) {
         ScopedLock<UserSm> guard(&_sm);
-        Slot *s1 = find_unmap(ds1);
-        Slot *s2 = find_unmap(ds2);
+        Slot *s1 = _unmaps.find(ds1);
+        Slot *s2 = _unmaps.find(ds2);
         if(!s1 || !s2) {
             VTHROW(DataSpaceException, E_NOT_FOUND,
                    "DataSpace " << (s1 ? ds1 : ds2) << " does not exist");
@@ -133,55 +174,113 @@ public:
      *
      * @param desc the descriptor. Is updated from the found dataspace
      * @param sel the selector
+     * @return true if the dataspace has been destroyed
      * @throws DataSpaceException if the dataspace was not found
      */
-    void release(DataSpaceDesc &desc, capsel_t sel) {
-        ScopedLock<UserSm> guard(&_sm);
-        Slot *s = find_unmap(sel);
-        if(!s)
-            VTHROW(DataSpaceException, E_NOT_FOUND, "DataSpace " << sel << " does not exist");
-        if(--s->refs == 0) {
+    bool release(DataSpaceDesc &desc, capsel_t sel) {
+        DS *ds;
+        {
+            ScopedLock<UserSm> guard(&_sm);
+            Slot *s = _unmaps.find(sel);
+            if(!s)
+                VTHROW(DataSpaceException, E_NOT_FOUND, "DataSpace " << sel << " does not exist");
+            if(--s->refs > 0)
+                return false;
+
             desc = s->ds->desc();
-            delete s->ds;
-            _tree.remove(s);
+            ds = s->ds;
+            _unmaps.remove(s);
+            _sels.remove(&s->selnode);
             s->ds = nullptr;
             s->next = _free;
             _free = s;
         }
+
+        ScopedLock<UserSm> objguard(&_objsm);
+        delete ds;
+        return true;
     }
 
 private:
-    Slot *find(capsel_t sel) {
-        for(size_t i = 0; i < MAX_SLOTS; ++i) {
-            if(_slots[i].ds && _slots[i].ds->sel() == sel)
-                return _slots + i;
-        }
-        return nullptr;
+    DataSpaceManager(const DataSpaceManager&);
+    DataSpaceManager& operator=(const DataSpaceManager&);
+
+    const DS *join_existing(capsel_t sel) {
+        ScopedLock<UserSm> guard(&_sm);
+        SelNode *n = _sels.find(sel);
+        if(!n)
+            return nullptr;
+        n->slot->refs++;
+        return n->slot->ds;
+    }
+
+    void add(Slot *slot) {
+        slot->refs = 1;
+        slot->key(slot->ds->unmapsel());
+        slot->selnode.key(slot->ds->sel());
+        _unmaps.insert(slot);
+        _sels.insert(&slot->selnode);
     }
-    Slot *find_unmap(capsel_t sel) {
-        return _tree.find(sel);
+
+    /**
+     * Allocates a slot. Expects that _objsm is held.
+     */
+    Slot *alloc_slot() {
+        {
+            ScopedLock<UserSm> guard(&_sm);
+            if(_free) {
+                Slot *s = _free;
+                _free = _free->next;
+                return s;
+            }
+        }
+
+        // put a new page of slots into our list. the first one is for the caller
+        DS *ds = new DS(DataSpaceDesc(ExecEnv::PAGE_SIZE, DataSpaceDesc::ANONYMOUS,
+                                      DataSpaceDesc::RW));
+        Chunk *c = reinterpret_cast<Chunk*>(ds->desc().virt());
+        c->ds = ds;
+        Slot *slots = reinterpret_cast<Slot*>(c + 1);
+        for(size_t i = 0; i < SLOTS_PER_CHUNK; ++i)
+            new (slots + i) Slot();
+
+        ScopedLock<UserSm> guard(&_sm);
+        c->next = _chunks;
+        _chunks = c;
+        for(size_t i = 1; i < SLOTS_PER_CHUNK; ++i) {
+            slots[i].next = _free;
+            _free = slots + i;
+        }
+        return slots;
     }
-    Slot *find_free() {
-        if(!_free)
-            throw DataSpaceException(E_CAPACITY, "No free dataspace slots");
-        Slot *s = _free;
-        _free = _free->next;
-        return s;
+    void free_slot(Slot *slot) {
+        ScopedLock<UserSm> guard(&_sm);
+        slot->ds = nullptr;
+        slot->next = _free;
+        _free = slot;
     }
 
+    // protects the index, the reference counts and the free slots
     UserSm _sm;
-    Treap<Slot> _tree;
+    // serializes the construction and destruction of dataspaces
+    UserSm _objsm;
+    Treap<Slot> _unmaps;
+    Treap<SelNode> _sels;
     Slot *_free;
-    Slot _slots[MAX_SLOTS];
+    Chunk *_chunks;
 };
 
 template<class DS>
 static inline OStream &operator<<(OStream &os, const DataSpaceManager<DS> &mng) {
+    typedef typename DataSpaceManager<DS>::Chunk chunk_t;
+    typedef typename DataSpaceManager<DS>::Slot slot_t;
     os << "DataSpaces:\n";
-    for(size_t i = 0; i < DataSpaceManager<DS>::MAX_SLOTS; ++i) {
-        if(mng._slots[i].refs)
-            os << "\tSlot " << i << ":" << *(mng._slots[i].ds) << " (" << mng._slots[i].refs <<
-            " refs)\n";
+    for(const chunk_t *c = mng._chunks; c != nullptr; c = c->next) {
+        const slot_t *slots = reinterpret_cast<const slot_t*>(c + 1);
+        for(size_t i = 0; i < DataSpaceManager<DS>::SLOTS_PER_CHUNK; ++i) {
+            if(slots[i].refs)
+                os << "\t" << *(slots[i].ds) << " (" << slots[i].refs << " refs)\n";
+        }
     }
     return os;
 }
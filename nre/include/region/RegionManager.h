@@ -20,6 +20,7 @@
 #include <stream/OStream.h>
 #include <stream/OStringStream.h>
 #include <collection/DList.h>
+#include <collection/Treap.h>
 #include <util/Math.h>
 #include <util/Bytes.h>
 #include <Exception.h>
@@ -33,9 +34,42 @@ public:
     }
 };
 
-struct Region : public DListItem {
+/**
+ * The key for the index of regions by size. The address is included to make it unique
+ */
+struct RegionSizeKey {
+    explicit RegionSizeKey(size_t size = 0, uintptr_t addr = 0) : size(size), addr(addr) {
+    }
+
+    bool operator==(const RegionSizeKey &k) const {
+        return size == k.size && addr == k.addr;
+    }
+    bool operator<(const RegionSizeKey &k) const {
+        return size < k.size || (size == k.size && addr < k.addr);
+    }
+
+    size_t size;
+    uintptr_t addr;
+};
+
+/**
+ * A free region. It is in a list that is sorted by address, in a treap with the address as key
+ * and in a treap with the size as key. Note that addr and size may only be changed by the
+ * RegionManager.
+ */
+struct Region : public DListItem, public TreapNode<uintptr_t> {
+    struct SizeNode : public TreapNode<RegionSizeKey> {
+        explicit SizeNode(Region *reg) : TreapNode<RegionSizeKey>(RegionSizeKey()), reg(reg) {
+        }
+        Region *reg;
+    };
+
+    explicit Region() : DListItem(), TreapNode<uintptr_t>(0), addr(), size(), sizenode(this) {
+    }
+
     uintptr_t addr;
     size_t size;
+    SizeNode sizenode;
 };
 
 class PortManager;
@@ -45,10 +79,24 @@ class PortManager;
  * can manage memory with it by adding some available memory to it (by using free()) and allocating
  * it chunk by chunk via alloc() later. The class will keep track of what parts are allocated and
  * what not.
+ *
+ * The free regions are indexed by address, which is used to find the neighbours for merging,
+ * and by size, which is used to find the best fitting region. Thus, all operations are
+ * logarithmic in the number of free regions.
+ *
+ * Reg may provide its own new and delete operators, which may in turn allocate from this
+ * region manager by get() and resize(). Therefore, new regions are always created while the
+ * data structures are consistent and all lookups are repeated afterwards.
  */
 template<class Reg = Region>
 class RegionManager {
     friend class PortManager;
+
+    typedef typename Region::SizeNode sizenode_t;
+
+    // the number of regions we check in get() before we switch to one that fits for sure
+    static const size_t MAX_ALIGN_TRIES = 4;
+
 public:
     typedef typename DList<Reg>::iterator iterator;
     typedef typename DList<Reg>::const_iterator const_iterator;
@@ -56,7 +104,7 @@ public:
     /**
      * Creates an empty region list
      */
-    explicit RegionManager() : _regs() {
+    explicit RegionManager() : _regs(), _addrs(), _sizes() {
     }
     /**
      * Destroys all region-objects
@@ -69,7 +117,7 @@ public:
     }
 
     /**
-     * @return the beginning of all regions
+     * @return the beginning of all regions (sorted by address)
      */
     const_iterator begin() const {
         return _regs.cbegin();
@@ -102,22 +150,31 @@ public:
      */
     size_t alloc_at(uintptr_t start, size_t count, bool free_required = false) {
         size_t total = 0;
-        for(auto it = _regs.begin(); it != _regs.end(); ++it) {
-            if(nre::Math::overlapped(start, count, it->addr, it->size)) {
-                // since adjacent regions are merged, it is sufficient to check whether the
-                // desired range is inside this region. if not, there is something missing, which
-                // means that it is already allocated.
-                if(free_required && !(start >= it->addr && start + count <= it->addr + it->size)) {
-                    VTHROW(RegionManagerException, E_EXISTS,
-                           fmt(start, "p") << " .. " << fmt(start + count, "p") << " not free");
-                }
-                total += remove_from(&*it, start, count);
-                // we assume that there are no duplicates, thus we can stop here
-                if(free_required)
-                    break;
-                it = _regs.begin();
+        Reg *nr = nullptr;
+        for(Reg *r = first_overlapping(start, count); r && r->addr < start + count; ) {
+            // since adjacent regions are merged, it is sufficient to check whether the
+            // desired range is inside this region. if not, there is something missing, which
+            // means that it is already allocated.
+            if(free_required && !(start >= r->addr && start + count <= r->addr + r->size)) {
+                if(nr)
+                    delete nr;
+                VTHROW(RegionManagerException, E_EXISTS,
+                       fmt(start, "p") << " .. " << fmt(start + count, "p") << " not free");
             }
+
+            // do we need to split the region?
+            if(start > r->addr && start + count < r->addr + r->size && !nr) {
+                nr = new Reg;
+                r = first_overlapping(start, count);
+                continue;
+            }
+
+            Reg *succ = next(r);
+            total += remove_from(r, start, count, nr);
+            r = succ;
         }
+        if(nr)
+            delete nr;
         return total;
     }
 
@@ -131,30 +188,42 @@ public:
      * @throws RegionManagerException if there is no region with enough units
      */
     uintptr_t alloc(size_t count, size_t align = 1) {
-        Reg *r = get(count, align);
-        if(!r) {
-            VTHROW(RegionManagerException, E_CAPACITY,
-                   "Unable to allocate " << count << " units aligned to " << align);
-        }
-        uintptr_t org = r->addr;
-        uintptr_t start = (r->addr + align - 1) & ~(align - 1);
-        count += start - r->addr;
-        r->addr += count;
-        r->size -= count;
-        // if there is space left before the start due to aligning, free it
-        if(start > org) {
-            Reg *nr = r;
-            // do we need a new region?
-            if(nr->size > 0) {
-                nr = new Reg;
-                _regs.append(nr);
+        Reg *nr = nullptr;
+        while(1) {
+            Reg *r = get(count, align);
+            if(!r) {
+                if(nr)
+                    delete nr;
+                VTHROW(RegionManagerException, E_CAPACITY,
+                       "Unable to allocate " << count << " units aligned to " << align);
             }
-            nr->addr = org;
-            nr->size = start - org;
+
+            uintptr_t org = r->addr;
+            uintptr_t start = (r->addr + align - 1) & ~(align - 1);
+            size_t after = r->size - (start - org) - count;
+            // if there is space left before and after it, we need a new region
+            if(start > org && after > 0) {
+                if(!nr) {
+                    nr = new Reg;
+                    continue;
+                }
+                nr->addr = start + count;
+                nr->size = after;
+                add(r, nr);
+                nr = nullptr;
+                resize(r, org, start - org);
+            }
+            else if(start > org)
+                resize(r, org, start - org);
+            else if(after > 0)
+                resize(r, start + count, after);
+            else
+                remove_reg(r);
+
+            if(nr)
+                delete nr;
+            return start;
         }
-        if(r->size == 0)
-            remove_reg(r);
-        return start;
     }
 
     /**
@@ -165,32 +234,30 @@ public:
      * @param count the number of units
      */
     void free(uintptr_t start, size_t count) {
-        Reg *p = nullptr, *n = nullptr;
-        for(iterator it = _regs.begin(); it != _regs.end(); ++it) {
-            if(it->addr + it->size == start)
-                p = &*it;
-            else if(it->addr == start + count)
-                n = &*it;
-            if(n && p)
-                break;
+        Reg *prev, *p, *n;
+        neighbours(start, count, prev, p, n);
+        if(!p && !n) {
+            Reg *f = new Reg;
+            // creating the region might have changed the regions
+            neighbours(start, count, prev, p, n);
+            if(!p && !n) {
+                f->addr = start;
+                f->size = count;
+                add(prev, f);
+                return;
+            }
+            delete f;
         }
 
         if(n && p) {
-            p->size += count + n->size;
+            size_t size = p->size + count + n->size;
             remove_reg(n);
+            resize(p, p->addr, size);
         }
-        else if(n) {
-            n->addr -= count;
-            n->size += count;
-        }
-        else if(p)
-            p->size += count;
-        else {
-            Reg *f = new Reg;
-            f->addr = start;
-            f->size = count;
-            _regs.append(f);
-        }
+        else if(n)
+            resize(n, n->addr - count, n->size + count);
+        else
+            resize(p, p->addr, p->size + count);
     }
 
 private:
@@ -198,49 +265,121 @@ private:
     RegionManager& operator=(const RegionManager&);
 
 protected:
+    /**
+     * Finds the region with the fewest units that can hold <count> units aligned to <align>
+     *
+     * @param count the number of units
+     * @param align the alignment
+     * @return the region or nullptr if there is none
+     */
     Reg *get(size_t count, size_t align) {
-        for(auto it = _regs.begin(); it != _regs.end(); ++it) {
-            if(it->size >= count) {
-                uintptr_t start = (it->addr + align - 1) & ~(align - 1);
-                if(it->size - (start - it->addr) >= count)
-                    return &*it;
-            }
+        sizenode_t *n = _sizes.find_next(RegionSizeKey(count, 0));
+        if(align <= 1)
+            return n ? static_cast<Reg*>(n->reg) : nullptr;
+
+        // a region with at least count + align - 1 units fits for sure. before that, we try
+        // a few smaller ones, which might be aligned properly
+        size_t sure = count + align - 1;
+        for(size_t i = 0; n && n->key().size < sure && i < MAX_ALIGN_TRIES; ++i) {
+            Reg *r = static_cast<Reg*>(n->reg);
+            uintptr_t start = (r->addr + align - 1) & ~(align - 1);
+            if(start >= r->addr && start - r->addr <= r->size - count)
+                return r;
+            n = _sizes.find_next(RegionSizeKey(n->key().size, n->key().addr + 1));
         }
-        return nullptr;
+        if(sure < count)
+            return nullptr;
+        if(!n || n->key().size < sure)
+            n = _sizes.find_next(RegionSizeKey(sure, 0));
+        return n ? static_cast<Reg*>(n->reg) : nullptr;
     }
 
+    /**
+     * Changes the address and size of <r>. The new range has to stay between the neighbours of
+     * <r> and has to be non-empty.
+     */
+    void resize(Reg *r, uintptr_t addr, size_t size) {
+        _sizes.remove(&r->sizenode);
+        r->addr = addr;
+        r->size = size;
+        // the order by address doesn't change, so that we can simply change the key
+        r->key(addr);
+        r->sizenode.key(RegionSizeKey(size, addr));
+        _sizes.insert(&r->sizenode);
+    }
+
+    void add(Reg *prev, Reg *r) {
+        _regs.insert(prev, r);
+        r->key(r->addr);
+        _addrs.insert(r);
+        r->sizenode.key(RegionSizeKey(r->size, r->addr));
+        _sizes.insert(&r->sizenode);
+    }
     void remove_reg(Reg *r) {
         _regs.remove(r);
+        _addrs.remove(r);
+        _sizes.remove(&r->sizenode);
         delete r;
     }
-    size_t remove_from(Reg *r, uintptr_t start, size_t count) {
+
+    /**
+     * Determines the region in front of <start> and the regions that are directly adjacent to
+     * <start> .. <count>-1.
+     */
+    void neighbours(uintptr_t start, size_t count, Reg *&prev, Reg *&p, Reg *&n) {
+        prev = _addrs.find_prev(start);
+        Reg *succ = prev ? next(prev) : head();
+        p = prev && prev->addr + prev->size == start ? prev : nullptr;
+        n = succ && succ->addr == start + count ? succ : nullptr;
+    }
+
+    Reg *head() {
+        return _regs.begin() != _regs.end() ? &*_regs.begin() : nullptr;
+    }
+    Reg *next(Reg *r) {
+        iterator it(nullptr, r);
+        ++it;
+        return it != _regs.end() ? &*it : nullptr;
+    }
+    Reg *first_overlapping(uintptr_t start, size_t count) {
+        Reg *r = _addrs.find_prev(start);
+        if(!r || r->addr + r->size <= start)
+            r = r ? next(r) : head();
+        return r && Math::overlapped(start, count, r->addr, r->size) ? r : nullptr;
+    }
+
+    size_t remove_from(Reg *r, uintptr_t start, size_t count, Reg *&nr) {
         size_t res = count;
+        uintptr_t end = r->addr + r->size;
         // complete region should be removed?
-        if(start <= r->addr && start + count >= r->addr + r->size) {
+        if(start <= r->addr && start + count >= end) {
             res = r->size;
             remove_reg(r);
         }
         // at the beginning?
         else if(start <= r->addr) {
-            r->size -= (start + count) - r->addr;
-            r->addr = start + count;
+            res = start + count - r->addr;
+            resize(r, start + count, end - (start + count));
         }
         // at the end?
-        else if(start + count >= r->addr + r->size)
-            r->size = start - r->addr;
+        else if(start + count >= end) {
+            res = end - start;
+            resize(r, r->addr, start - r->addr);
+        }
         // in the middle
         else {
-            size_t oldsize = r->size;
-            r->size = start - r->addr;
-            Reg *nr = new Reg;
             nr->addr = start + count;
-            nr->size = (r->addr + oldsize) - nr->addr;
-            _regs.append(nr);
+            nr->size = end - nr->addr;
+            add(r, nr);
+            nr = nullptr;
+            resize(r, r->addr, start - r->addr);
         }
         return res;
     }
 
     DList<Reg> _regs;
+    Treap<Reg> _addrs;
+    Treap<sizenode_t> _sizes;
 };
 
 template<class Reg>
@@ -18,35 +18,135 @@
 
 #include <ipc/PtClientSession.h>
 #include <ipc/Connection.h>
+#include <ipc/Producer.h>
 #include <utcb/UtcbFrame.h>
 #include <kobj/Pt.h>
+#include <kobj/Sm.h>
+#include <kobj/UserSm.h>
+#include <mem/DataSpace.h>
+#include <util/ScopedLock.h>
+#include <util/Atomic.h>
+#include <util/Util.h>
+#include <cstring>
 
 namespace nre {
 
 /**
- * Represents a session at the log-service
+ * Represents a session at the log-service. The lines are appended to a ring-buffer that is shared
+ * with the log-service, so that writing a line does not require IPC and does never block. If the
+ * ring is full, the line is dropped and the log-service reports the number of dropped lines.
  */
 class LogSession : public PtClientSession {
 public:
+    static const size_t MAX_LINE_LEN    = 128;
+    static const size_t RING_SIZE       = ExecEnv::PAGE_SIZE * 8;
+    // the ring-buffer starts behind the Header in the dataspace
+    static const size_t RING_OFFSET     = 64;
+
+    /**
+     * The available commands
+     */
+    enum Command {
+        WRITE,
+        GET_RING
+    };
+
+    /**
+     * A line in the ring-buffer
+     */
+    struct Line {
+        // the TSC value at the time the line has been written, to merge the rings of all clients
+        timevalue_t tsc;
+        size_t len;
+        char text[MAX_LINE_LEN];
+    };
+
+    /**
+     * The header of the ring-buffer dataspace
+     */
+    struct Header {
+        // the number of lines that have been dropped because the ring was full
+        volatile word_t dropped;
+    };
+
     /**
      * Creates a new session with given connection
      *
      * @param con the connection
      */
-    explicit LogSession(Connection &con) : PtClientSession(con) {
+    explicit LogSession(Connection &con)
+        : PtClientSession(con), _sm(), _ds(), _notify(), _prod() {
+        get_ring();
+    }
+    /**
+     * Destroys this session
+     */
+    virtual ~LogSession() {
+        delete _prod;
+        delete _notify;
+        delete _ds;
     }
 
     /**
-     * Writes the given line to the log service. Note that the line should be short enough to fit
-     * into the Utcb!
+     * Writes the given line to the log service. If the ring is not available, it is sent via IPC.
+     * In this case, the line should be short enough to fit into the Utcb!
+     *
+     * @param line the line
+     * @param len the length of the line
+     */
+    void write(const char *line, size_t len) {
+        if(EXPECT_FALSE(!_prod)) {
+            write(String(line, len));
+            return;
+        }
+
+        ScopedLock<UserSm> guard(&_sm);
+        Line *slot = _prod->current();
+        if(EXPECT_FALSE(!slot)) {
+            Atomic::add(&reinterpret_cast<Header*>(_ds->virt())->dropped, 1UL);
+            return;
+        }
+        slot->tsc = Util::tsc();
+        slot->len = Math::min(len, MAX_LINE_LEN);
+        memcpy(slot->text, line, slot->len);
+        _prod->next();
+    }
+
+    /**
+     * Writes the given line to the log service via IPC. Note that the line should be short enough
+     * to fit into the Utcb!
      *
      * @param line the line
      */
     void write(const String &line) {
         UtcbFrame uf;
-        uf << line;
+        uf << WRITE << line;
         pt().call(uf);
     }
+
+private:
+    void get_ring() {
+        ScopedCapSels caps(2, 2);
+        UtcbFrame uf;
+        uf.delegation_window(Crd(caps.get(), 1, Crd::OBJ_ALL));
+        uf << GET_RING;
+        pt().call(uf);
+        ErrorCode res;
+        uf >> res;
+        // if the log-service doesn't give us a ring, we fall back to IPC
+        if(res != E_SUCCESS)
+            return;
+
+        _ds = new DataSpace(caps.get());
+        _notify = new Sm(caps.get() + 1, true);
+        caps.release();
+        _prod = new Producer<Line>(*_ds, *_notify, false, RING_OFFSET);
+    }
+
+    UserSm _sm;
+    DataSpace *_ds;
+    Sm *_notify;
+    Producer<Line> *_prod;
 };
 
 }
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <arch/Types.h>
+#include <arch/ExecEnv.h>
+#include <ipc/Connection.h>
+#include <ipc/PtClientSession.h>
+#include <ipc/Consumer.h>
+#include <ipc/Producer.h>
+#include <kobj/UserSm.h>
+#include <util/ScopedLock.h>
+#include <utcb/UtcbFrame.h>
+#include <Exception.h>
+#include <cstring>
+
+namespace nre {
+
+/**
+ * Types for the network service
+ */
+class Network {
+public:
+    /**
+     * A MAC address in the lower 48 bits. The most significant byte is the first one on the wire.
+     */
+    typedef uint64_t mac_type;
+
+    // the size of one slot in the rings
+    static const size_t PACKET_SIZE     = 2048;
+    // the max. size of an ethernet frame without FCS (including a VLAN tag)
+    static const size_t MAX_FRAME_SIZE  = 1518;
+    static const size_t HEADER_SIZE     = 14;
+    static const size_t RING_SLOTS      = 128;
+    // one additional page for the state of the ring
+    static const size_t RING_SIZE       = RING_SLOTS * PACKET_SIZE + ExecEnv::PAGE_SIZE;
+    // the control dataspace holds the receive ring, followed by the transmit ring
+    static const size_t CTRLDS_SIZE     = RING_SIZE * 2;
+
+    /**
+     * The available commands
+     */
+    enum Command {
+        INIT,
+    };
+
+    /**
+     * An ethernet frame in one of the rings
+     */
+    struct Packet {
+        size_t len;
+        uint8_t data[PACKET_SIZE - sizeof(size_t)];
+    };
+
+    /**
+     * @param frame the ethernet frame
+     * @return the destination MAC address of the given frame
+     */
+    static mac_type dst(const uint8_t *frame) {
+        return to_mac(frame);
+    }
+    /**
+     * @param frame the ethernet frame
+     * @return the source MAC address of the given frame
+     */
+    static mac_type src(const uint8_t *frame) {
+        return to_mac(frame + 6);
+    }
+    /**
+     * @param mac the MAC address
+     * @return true if the given address is a multicast or broadcast address
+     */
+    static bool is_multicast(mac_type mac) {
+        return mac & (static_cast<mac_type>(1) << 40);
+    }
+
+private:
+    static mac_type to_mac(const uint8_t *bytes) {
+        mac_type mac = 0;
+        for(size_t i = 0; i < 6; ++i)
+            mac = (mac << 8) | bytes[i];
+        return mac;
+    }
+
+    Network();
+};
+
+/**
+ * Represents a session at the network service, i.e. a port at the virtual switch. Frames are
+ * exchanged via two rings in a shared dataspace: the transmit ring is filled by the client and
+ * the receive ring by the service. Both parties are only notified if the other one is sleeping.
+ */
+class NetworkSession : public PtClientSession {
+public:
+    /**
+     * Creates a new session with given connection
+     *
+     * @param con the connection
+     */
+    explicit NetworkSession(Connection &con)
+        : PtClientSession(con),
+          _ctrlds(Network::CTRLDS_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW), _rxsm(0),
+          _txsm(0), _txlock(), _rx(_ctrlds, _rxsm, true, 0, Network::RING_SIZE),
+          _tx(_ctrlds, _txsm, true, Network::RING_SIZE, Network::RING_SIZE), _mac() {
+        init();
+    }
+
+    /**
+     * @return the MAC address that the service has assigned to this port
+     */
+    Network::mac_type mac() const {
+        return _mac;
+    }
+
+    /**
+     * @return the consumer to receive frames from the switch
+     */
+    Consumer<Network::Packet> &consumer() {
+        return _rx;
+    }
+
+    /**
+     * Sends the given frame to the switch. Like a real network card, the frame is dropped if the
+     * transmit ring is full.
+     *
+     * @param frame the ethernet frame
+     * @param len the length of the frame (without FCS)
+     * @return true if the frame has been put into the transmit ring
+     */
+    bool send(const void *frame, size_t len) {
+        if(len < Network::HEADER_SIZE || len > Network::MAX_FRAME_SIZE)
+            VTHROW(Exception, E_ARGS_INVALID, "Invalid frame length (" << len << ")");
+
+        ScopedLock<UserSm> guard(&_txlock);
+        Network::Packet *pk = _tx.current();
+        if(!pk)
+            return false;
+        pk->len = len;
+        memcpy(pk->data, frame, len);
+        _tx.next();
+        return true;
+    }
+
+private:
+    void init() {
+        UtcbFrame uf;
+        uf.delegate(_ctrlds.sel(), 0);
+        uf.delegate(_rxsm.sel(), 1);
+        uf.delegate(_txsm.sel(), 2);
+        uf << Network::INIT;
+        pt().call(uf);
+        uf.check_reply();
+        uf >> _mac;
+    }
+
+    DataSpace _ctrlds;
+    Sm _rxsm;
+    Sm _txsm;
+    UserSm _txlock;
+    Consumer<Network::Packet> _rx;
+    Producer<Network::Packet> _tx;
+    Network::mac_type _mac;
+};
+
+}
@@ -20,6 +20,9 @@
 #include <ipc/Connection.h>
 #include <ipc/PtClientSession.h>
 #include <ipc/Consumer.h>
+#include <ipc/Producer.h>
+#include <kobj/UserSm.h>
+#include <util/ScopedLock.h>
 #include <utcb/UtcbFrame.h>
 #include <util/DMA.h>
 #include <Exception.h>
@@ -38,8 +41,16 @@ public:
     static const size_t MAX_CONTROLLER      = 8;
     static const size_t MAX_DRIVES          = 32;   // per controller
     static const size_t MAX_DMA_DESCS       = 64;
+    // per slot in the submission ring; longer lists continue in the following slots
+    static const size_t MAX_RING_DMA_DESCS  = 8;
+
+    // the control dataspace holds the completion ring, followed by the submission ring
+    static const size_t COMPLETION_RING_SIZE    = ExecEnv::PAGE_SIZE;
+    static const size_t SUBMISSION_RING_SIZE    = ExecEnv::PAGE_SIZE * 3;
+    static const size_t CTRLDS_SIZE             = COMPLETION_RING_SIZE + SUBMISSION_RING_SIZE;
 
     typedef DMADescList<MAX_DMA_DESCS> dma_type;
+    typedef DMADescList<MAX_RING_DMA_DESCS> ring_dma_type;
 
     /**
      * The available commands
@@ -49,6 +60,7 @@ public:
         READ,
         WRITE,
         FLUSH,
+        CACHE_STATS,
     };
 
     /**
@@ -66,6 +78,17 @@ public:
         char name[64];
     };
 
+    /**
+     * Statistics of the block cache in the storage service
+     */
+    struct CacheStats {
+        size_t blocks;
+        size_t used;
+        size_t block_size;
+        uint64_t hits;
+        uint64_t misses;
+    };
+
     /**
      * Completion message
      */
@@ -77,6 +100,19 @@ public:
         }
     };
 
+    /**
+     * A request in the submission ring. Errors are reported via the status of the completion
+     * message. If the DMA list does not fit into one slot, it is continued in the following
+     * <chained> slots, of which only the <dma> field is used.
+     */
+    struct Request {
+        Command cmd;
+        tag_type tag;
+        sector_type sector;
+        size_t chained;
+        ring_dma_type dma;
+    };
+
 private:
     Storage();
 };
@@ -98,8 +134,11 @@ public:
      */
     explicit StorageSession(Connection &con, DataSpace &ds, size_t drive)
         : PtClientSession(con),
-          _ctrlds(ExecEnv::PAGE_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW), _sm(0),
-          _cons(_ctrlds, _sm, true) {
+          _ctrlds(Storage::CTRLDS_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW), _sm(0),
+          _doorbell(0), _subspace(0), _compspace(0), _sublock(),
+          _cons(_ctrlds, _sm, true, 0, Storage::COMPLETION_RING_SIZE, &_compspace),
+          _subprod(_ctrlds, _doorbell, true, Storage::COMPLETION_RING_SIZE,
+                   Storage::SUBMISSION_RING_SIZE) {
         init(ds, drive);
     }
 
@@ -118,15 +157,28 @@ public:
     }
 
     /**
-     * Flushes the disk buffer
+     * Retrieves the statistics of the block cache of the storage service. If the service has
+     * no cache, all values are zero.
      *
-     * @param tag the tag to identify the command on completion
+     * @return the statistics
      */
-    void flush(tag_type tag) {
+    Storage::CacheStats get_cache_stats() {
+        Storage::CacheStats stats;
         UtcbFrame uf;
-        uf << Storage::FLUSH << tag;
+        uf << Storage::CACHE_STATS;
         pt().call(uf);
         uf.check_reply();
+        uf >> stats;
+        return stats;
+    }
+
+    /**
+     * Flushes the disk buffer
+     *
+     * @param tag the tag to identify the command on completion
+     */
+    void flush(tag_type tag) {
+        submit(Storage::FLUSH, tag, 0, nullptr);
     }
 
     /**
@@ -153,10 +205,7 @@ public:
      * @param dma describes what to transfer where
      */
     void read(tag_type tag, sector_type sector, const Storage::dma_type &dma) {
-        UtcbFrame uf;
-        uf << Storage::READ << tag << sector << dma;
-        pt().call(uf);
-        uf.check_reply();
+        submit(Storage::READ, tag, sector, &dma);
     }
 
     /**
@@ -184,18 +233,61 @@ public:
      * @param dma describes what to transfer where
      */
     void write(tag_type tag, sector_type sector, const Storage::dma_type &dma) {
-        UtcbFrame uf;
-        uf << Storage::WRITE << tag << sector << dma;
-        pt().call(uf);
-        uf.check_reply();
+        submit(Storage::WRITE, tag, sector, &dma);
     }
 
 private:
+    /**
+     * Puts the given command into the submission ring. The service is only notified if it is
+     * sleeping. If the ring is full, we block until the service has taken requests out of it.
+     * A DMA list that is too long for one slot is spread over multiple consecutive slots, which
+     * are published at once.
+     */
+    void submit(Storage::Command cmd, tag_type tag, sector_type sector,
+                const Storage::dma_type *dma) {
+        if(dma) {
+            // check the sector-range here to report that error immediately
+            size_t count = dma->bytecount() / _params.sector_size;
+            if(sector >= _params.sectors || sector + count > _params.sectors) {
+                VTHROW(Exception, E_ARGS_INVALID,
+                       "Sectors " << sector << ".." << (sector + count - 1) << " are invalid"
+                                  << " (available: 0.." << _params.sectors - 1 << ")");
+            }
+        }
+
+        size_t slots = 1;
+        if(dma && dma->count() > Storage::MAX_RING_DMA_DESCS)
+            slots = (dma->count() + Storage::MAX_RING_DMA_DESCS - 1) / Storage::MAX_RING_DMA_DESCS;
+
+        ScopedLock<UserSm> guard(&_sublock);
+        _subprod.wait_free(slots, _subspace);
+        Storage::Request *req = _subprod.slot(0);
+        req->cmd = cmd;
+        req->tag = tag;
+        req->sector = sector;
+        req->chained = slots - 1;
+        req->dma.clear();
+        if(dma) {
+            size_t i = 0;
+            for(Storage::dma_type::iterator it = dma->begin(); it != dma->end(); ++it, ++i) {
+                if(i > 0 && (i % Storage::MAX_RING_DMA_DESCS) == 0) {
+                    req = _subprod.slot(i / Storage::MAX_RING_DMA_DESCS);
+                    req->dma.clear();
+                }
+                req->dma.push(*it);
+            }
+        }
+        _subprod.commit(slots);
+    }
+
     void init(DataSpace &ds, size_t drive) {
         UtcbFrame uf;
         uf.delegate(_ctrlds.sel(), 0);
         uf.delegate(ds.sel(), 1);
         uf.delegate(_sm.sel(), 2);
+        uf.delegate(_doorbell.sel(), 3);
+        uf.delegate(_subspace.sel(), 4);
+        uf.delegate(_compspace.sel(), 5);
         uf << Storage::INIT << drive;
         pt().call(uf);
         uf.check_reply();
@@ -204,7 +296,14 @@ private:
 
     DataSpace _ctrlds;
     Sm _sm;
+    Sm _doorbell;
+    // to get notified about free slots in the submission ring and to notify the service about
+    // free slots in the completion ring
+    Sm _subspace;
+    Sm _compspace;
+    UserSm _sublock;
     Consumer<Storage::Packet> _cons;
+    Producer<Storage::Request> _subprod;
     Storage::Parameter _params;
 };
 
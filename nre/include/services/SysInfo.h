@@ -76,7 +76,7 @@ public:
     class Child {
         friend class SysInfoSession;
     public:
-        explicit Child() : _cmdline(), _virt(), _phys(), _threads() {
+        explicit Child() : _cmdline(), _virt(), _phys(), _threads(), _faults() {
         }
 
         /**
@@ -103,12 +103,19 @@ public:
         size_t threads() const {
             return _threads;
         }
+        /**
+         * @return the number of pagefaults that have been handled for this child
+         */
+        size_t faults() const {
+            return _faults;
+        }
 
     private:
         nre::String _cmdline;
         size_t _virt;
         size_t _phys;
         size_t _threads;
+        size_t _faults;
     };
 
     /**
@@ -202,7 +209,7 @@ public:
         uf >> found;
         if(!found)
             return false;
-        uf >> c._cmdline >> c._virt >> c._phys >> c._threads;
+        uf >> c._cmdline >> c._virt >> c._phys >> c._threads >> c._faults;
         return true;
     }
 };
@@ -19,7 +19,11 @@
 #include <arch/Types.h>
 #include <ipc/Connection.h>
 #include <ipc/PtClientSession.h>
+#include <mem/DataSpace.h>
 #include <utcb/UtcbFrame.h>
+#include <util/Math.h>
+#include <util/Sync.h>
+#include <util/Util.h>
 #include <Exception.h>
 #include <CPU.h>
 
@@ -38,7 +42,29 @@ public:
     enum Command {
         GET_SMS,
         PROG_TIMER,
-        GET_TIME
+        GET_TIME,
+        GET_CLOCK
+    };
+
+    /**
+     * The clock page that is exported by the timer service. It allows clients to determine the
+     * current time without IPC. The timer service updates it from time to time, protected by a
+     * sequence counter: it is odd during an update and incremented again afterwards. Thus, the
+     * reader has to retry if the counter is odd or has changed while reading the record.
+     */
+    struct ClockInfo {
+        volatile uint32_t seq;
+        uint32_t : 32;
+        // the TSC value at the last update
+        timevalue_t tsc_base;
+        // the timer ticks at tsc_base. the timer counts the ticks since 1970
+        timevalue_t ticks_base;
+        // the number of TSC clocks per timer tick, multiplied by cpt_res
+        timevalue_t clocks_per_tick;
+        timevalue_t cpt_res;
+        // the frequency of the timer and of the TSC
+        timevalue_t timer_freq;
+        timevalue_t tsc_freq;
     };
 
 private:
@@ -55,7 +81,8 @@ public:
      *
      * @param con the connection
      */
-    explicit TimerSession(Connection &con) : PtClientSession(con) {
+    explicit TimerSession(Connection &con) : PtClientSession(con), _clockds(get_clock()),
+        _clock(reinterpret_cast<const Timer::ClockInfo*>(_clockds.virt())) {
         get_sms();
     }
     /**
@@ -111,20 +138,49 @@ public:
     }
 
     /**
-     * Determines the current time
+     * Determines the current time. This is done by using the clock page of the timer service,
+     * i.e. without IPC.
      *
      * @param uptime the time since systemstart in microseconds (Timer::WALLCLOCK_FREQ)
      * @param unixts the current unix timestamp in microseconds (Timer::WALLCLOCK_FREQ)
      */
     void get_time(timevalue_t &uptime, timevalue_t &unixts) {
+        Timer::ClockInfo info;
+        timevalue_t tsc;
+        uint32_t seq;
+        do {
+            seq = _clock->seq;
+            Sync::memory_barrier();
+            info.tsc_base = _clock->tsc_base;
+            info.ticks_base = _clock->ticks_base;
+            info.clocks_per_tick = _clock->clocks_per_tick;
+            info.cpt_res = _clock->cpt_res;
+            info.timer_freq = _clock->timer_freq;
+            info.tsc_freq = _clock->tsc_freq;
+            tsc = Util::tsc();
+            Sync::memory_barrier();
+        }
+        while(EXPECT_FALSE((seq & 1) || seq != _clock->seq));
+
+        uptime = Math::muldiv128(tsc, Timer::WALLCLOCK_FREQ, info.tsc_freq);
+        // the TSCs of different CPUs might not be perfectly in sync
+        timevalue_t ticks = info.ticks_base;
+        if(tsc > info.tsc_base)
+            ticks += Math::muldiv128(tsc - info.tsc_base, info.cpt_res, info.clocks_per_tick);
+        unixts = Math::muldiv128(ticks, Timer::WALLCLOCK_FREQ, info.timer_freq);
+    }
+
+private:
+    DataSpace get_clock() {
+        ScopedCapSels cap;
         UtcbFrame uf;
-        uf << Timer::GET_TIME;
+        uf.delegation_window(Crd(cap.get(), 0, Crd::OBJ_ALL));
+        uf << Timer::GET_CLOCK;
         pt().call(uf);
         uf.check_reply();
-        uf >> uptime >> unixts;
+        return DataSpace(cap.release());
     }
 
-private:
     void get_sms() {
         UtcbFrame uf;
         ScopedCapSels caps(1 << CPU::order(), 1 << CPU::order());
@@ -138,6 +194,8 @@ private:
             _sms[it->log_id()] = new Sm(_caps + it->log_id(), true);
     }
 
+    DataSpace _clockds;
+    const Timer::ClockInfo *_clock;
     capsel_t _caps;
     Sm **_sms;
 };
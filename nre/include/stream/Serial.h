@@ -48,7 +48,7 @@ protected:
 
 /**
  * Serial outstream for all tasks except root. Uses a buffer to keap at most one line or
- * MAX_LINE_LEN local until it is sent to the log-service via a portal call.
+ * MAX_LINE_LEN local until it is appended to the ring-buffer of the log-service.
  */
 class Serial : public BaseSerial {
     class Init {
@@ -180,12 +180,26 @@ public:
         return _scs;
     }
 
+    /**
+     * @return the number of pagefaults that have been handled for this child
+     */
+    size_t faults() const {
+        return _faults;
+    }
+    /**
+     * @return whether all dataspaces of this child should be populated on the first fault
+     */
+    bool populate() const {
+        return _populate;
+    }
+
 private:
     explicit Child(ChildManager *cm, id_type id, const String &cmdline)
         : RCUObject(), _cm(cm), _id(id), _cmdline(cmdline), _started(), _pd(), _ec(),
           _pts(), _ptcount(), _regs(), _io(PortManager::USED), _scs(), _gsis(),
           _gsi_caps(CapSelSpace::get().allocate(Hip::MAX_GSIS)), _gsi_next(), _entry(),
-          _main(), _stack(), _utcb(), _hip(), _last_fault_addr(), _last_fault_cpu(), _sm() {
+          _main(), _stack(), _utcb(), _hip(), _last_fault_addr(), _last_fault_cpu(), _faults(),
+          _populate(), _sm() {
     }
     virtual ~Child() {
         for(size_t i = 0; i < _ptcount; ++i)
@@ -246,6 +260,8 @@ private:
     uintptr_t _hip;
     uintptr_t _last_fault_addr;
     cpu_t _last_fault_cpu;
+    size_t _faults;
+    bool _populate;
     UserSm _sm;
 };
 
@@ -44,8 +44,8 @@ public:
      * @param cpu the CPU for the main thread
      */
     explicit ChildConfig(size_t no, const String &cmdline, cpu_t cpu = CPU::current().log_id())
-        : _no(no), _last(false), _modaccess(OWN), _cpu(cpu), _cpus(), _entry(0), _waitcount(),
-          _waits(), _cmdline() {
+        : _no(no), _last(false), _populate(false), _modaccess(OWN), _cpu(cpu), _cpus(), _entry(0),
+          _waitcount(), _waits(), _reqcount(), _requires(), _cmdline() {
         parse(cmdline);
     }
     virtual ~ChildConfig() {
@@ -63,6 +63,12 @@ public:
     bool last() const {
         return _last;
     }
+    /**
+     * @return whether the memory of the child should be mapped completely on the first fault
+     */
+    bool populate() const {
+        return _populate;
+    }
 
     /**
      * @return the number of waits
@@ -78,6 +84,20 @@ public:
         return _waits[i];
     }
 
+    /**
+     * @return the number of services this child requires before it can be started
+     */
+    size_t requirements() const {
+        return _reqcount;
+    }
+    /**
+     * @param i the requirement index
+     * @return the name of the required service
+     */
+    const String &requirement(size_t i) const {
+        return _requires[i];
+    }
+
     /**
      * @return the commandline
      */
@@ -145,8 +165,12 @@ private:
                     _modaccess = ALL;
                 else if(strncmp(start, "lastmod", 7) == 0)
                     _last = true;
+                else if(strncmp(start, "populate", 8) == 0)
+                    _populate = true;
                 else if(strncmp(start, "provides=", 9) == 0 && _waitcount < MAX_WAITS)
                     _waits[_waitcount++] = String(start + 9, len - 9);
+                else if(strncmp(start, "requires=", 9) == 0 && _reqcount < MAX_WAITS)
+                    _requires[_reqcount++] = String(start + 9, len - 9);
                 else {
                     if(pos + len + 1 >= sizeof(buffer))
                         len = sizeof(buffer) - (pos + 2);
@@ -162,12 +186,15 @@ private:
 
     size_t _no;
     bool _last;
+    bool _populate;
     ModuleAccess _modaccess;
     cpu_t _cpu;
     CPUSet _cpus;
     uintptr_t _entry;
     size_t _waitcount;
     String _waits[MAX_WAITS];
+    size_t _reqcount;
+    String _requires[MAX_WAITS];
     String _cmdline;
 };
 
@@ -22,6 +22,8 @@
 #include <subsystem/ServiceRegistry.h>
 #include <subsystem/ChildConfig.h>
 #include <mem/DataSpaceManager.h>
+#include <collection/SList.h>
+#include <arch/Elf.h>
 #include <util/Sync.h>
 #include <Exception.h>
 
@@ -90,6 +92,7 @@ public:
      * Some settings
      */
     static const size_t MAX_CHILDS          = 32;
+    static_assert(MAX_CHILDS <= ServiceRegistry::MAX_CLIENTS, "Too many childs for the registry");
     static const size_t MAX_CMDLINE_LEN     = 256;
     static const size_t MAX_MODAUX_LEN      = ExecEnv::PAGE_SIZE;
 
@@ -112,11 +115,37 @@ public:
      * @param size the size of the ELF file
      * @param config the config to use. this allows you to specify the access to the modules, the
      *  presented CPUs and other things
+     * @param persistent whether the ELF file stays at <addr> as long as the child exists. if so,
+     *  the writable segments are copied on demand. otherwise, only their zero-filled part is
+     *  initialized on demand
      * @return the id of the created child
      * @throws ELFException if the ELF is invalid
      * @throws Exception if something else failed
      */
-    Child::id_type load(uintptr_t addr, size_t size, const ChildConfig &config);
+    Child::id_type load(uintptr_t addr, size_t size, const ChildConfig &config,
+                        bool persistent = false);
+    /**
+     * Like load(), but doesn't wait until the services of the child are registered. This allows
+     * you to start multiple childs concurrently. The arguments are the same as for load().
+     */
+    Child::id_type start(uintptr_t addr, size_t size, const ChildConfig &config,
+                         bool persistent = false);
+
+    /**
+     * @param name the service name
+     * @return true if the service with given name is registered
+     */
+    bool has_service(const String &name) {
+        ScopedLock<UserSm> guard(&_sm);
+        return _registry.find(name) != nullptr;
+    }
+    /**
+     * Blocks until a service is registered. Note that registrations are counted, i.e. if one
+     * happened since the last call, it returns immediately.
+     */
+    void wait_for_service() {
+        _regsm.down();
+    }
 
     /**
      * @return the number of childs
@@ -191,6 +220,32 @@ public:
     }
 
 private:
+    /**
+     * A read-only LOAD segment that has been loaded for a module. It is kept as long as one
+     * instance of the module still uses it, so that further instances can share it.
+     */
+    struct SharedSegment : public SListItem {
+        explicit SharedSegment(size_t modsize, const ElfPh *ph, const DataSpace &ds)
+            : SListItem(), modsize(modsize), offset(ph->p_offset), vaddr(ph->p_vaddr),
+              filesz(ph->p_filesz), memsz(ph->p_memsz), flags(ph->p_flags), sel(ds.sel()),
+              unmapsel(ds.unmapsel()) {
+        }
+
+        bool matches(size_t size, const ElfPh *ph) const {
+            return modsize == size && offset == ph->p_offset && vaddr == ph->p_vaddr &&
+                   filesz == ph->p_filesz && memsz == ph->p_memsz && flags == ph->p_flags;
+        }
+
+        size_t modsize;
+        size_t offset;
+        uintptr_t vaddr;
+        size_t filesz;
+        size_t memsz;
+        uint flags;
+        capsel_t sel;
+        capsel_t unmapsel;
+    };
+
     size_t free_slot() const {
         ScopedLock<UserSm> guard(&_slotsm);
         for(size_t i = 0; i < MAX_CHILDS; ++i) {
@@ -220,17 +275,24 @@ private:
         return (pid - _portal_caps) % Hip::get().service_caps();
     }
 
-    const ServiceRegistry::Service *get_service(const String &name) {
+    size_t slot(const Child *c) const {
+        return (c->id() - _portal_caps) / per_child_caps();
+    }
+
+    const ServiceRegistry::Service *get_service(Child *c, const String &name) {
         ScopedLock<UserSm> guard(&_sm);
-        const ServiceRegistry::Service* s = registry().find(name);
+        ServiceRegistry::Service* s = _registry.find(name);
         if(!s) {
             if(!_startup_info.child)
                 VTHROW(ChildException, E_NOT_FOUND, "Unable to find service '" << name << "'");
             BitField<Hip::MAX_CPUS> available;
             capsel_t pts = get_parent_service(name.str(), available);
-            s = _registry.reg(0, name, pts, 1 << CPU::order(), available);
+            _registry.reg(0, name, pts, 1 << CPU::order(), available);
+            s = _registry.find(name);
             _regsm.up();
         }
+        // remember it to notify only the services that the child might have sessions with
+        s->clients().set(slot(c));
         return s;
     }
     capsel_t reg_service(Child *c, capsel_t pts, const String& name,
@@ -244,15 +306,26 @@ private:
         ScopedLock<UserSm> guard(&_sm);
         _registry.unreg(c, name);
     }
-    void notify_services() {
+    void notify_services(size_t slot, bool died) {
+        bool parent = false;
         {
             ScopedLock<UserSm> guard(&_sm);
-            for(auto it = _registry.begin(); it != _registry.end(); ++it)
-                it->sm().up();
+            for(auto it = _registry.begin(); it != _registry.end(); ++it) {
+                if(it->clients().is_set(slot)) {
+                    it->sm().up();
+                    // the services of our parent need to be notified by our parent
+                    if(_startup_info.child && it->child() == nullptr)
+                        parent = true;
+                    if(died)
+                        it->clients().clear(slot);
+                }
+            }
+        }
+        if(parent) {
+            UtcbFrame uf;
+            uf << Service::CLIENT_DIED;
+            CPU::current().srv_pt().call(uf);
         }
-        UtcbFrame uf;
-        uf << Service::CLIENT_DIED;
-        CPU::current().srv_pt().call(uf);
     }
 
     void term_child(capsel_t pid, UtcbExcFrameRef &uf);
@@ -266,6 +339,9 @@ private:
     void map(UtcbFrameRef &uf, Child *c, DataSpace::RequestType type);
     void switch_to(UtcbFrameRef &uf, Child *c);
     void unmap(UtcbFrameRef &uf, Child *c);
+    const DataSpace *join_segment(uintptr_t addr, size_t size, const ElfPh *ph);
+    void add_segment(size_t size, const ElfPh *ph, const DataSpace &ds);
+    void release_ds(DataSpaceDesc &desc, capsel_t sel);
 
     ChildManager(const ChildManager&);
     ChildManager& operator=(const ChildManager&);
@@ -274,9 +350,11 @@ private:
     Child *_childs[MAX_CHILDS];
     capsel_t _portal_caps;
     DataSpaceManager<DataSpace> _dsm;
+    SList<SharedSegment> _segments;
+    // protects _segments and makes sure that segments are not destroyed while being joined
+    UserSm _segsm;
     ServiceRegistry _registry;
     UserSm _sm;
-    UserSm _switchsm;
     mutable UserSm _slotsm;
     Sm _regsm;
     Sm _diesm;
@@ -25,6 +25,7 @@
 #include <bits/MaskField.h>
 #include <util/Math.h>
 #include <Exception.h>
+#include <cstring>
 #include <Assert.h>
 
 namespace nre {
@@ -52,19 +53,31 @@ public:
         RWX = R | W | X,
         // indicates that the memory has been requested by us, i.e. we haven't just joined the DS
         OWN = 1 << 4,
+        POPULATE = DataSpaceDesc::POPULATE,
     };
 
     /**
      * A dataspace in the address space of the child including administrative information.
      */
     class DS : public SListItem {
+        // the number of pages to map at least and at most for a pagefault
+        static const size_t MIN_FAULT_WINDOW    = 32;
+        static const size_t MAX_FAULT_WINDOW    = 4096;
+
     public:
         /**
          * Creates the dataspace with given descriptor and cap
          */
         explicit DS(const DataSpaceDesc &desc, capsel_t cap)
             : SListItem(), _desc(desc), _cap(cap),
-              _perms(Math::blockcount<size_t>(desc.size(), ExecEnv::PAGE_SIZE) * 4) {
+              _perms(Math::blockcount<size_t>(desc.size(), ExecEnv::PAGE_SIZE) * 4),
+              _next_fault(), _window(), _src(), _srcsize(), _init(), _uninit() {
+        }
+        /**
+         * Destructor
+         */
+        ~DS() {
+            delete _init;
         }
 
         /**
@@ -127,18 +140,120 @@ public:
             return pages;
         }
         /**
-         * Sets the permissions of all pages to <perms>
+         * Sets the permissions of all pages to <perms>. This resets the fault-around state as
+         * well, i.e. the next fault is treated as the first one.
          *
          * @param perms the new permissions
          */
         void all_perms(uint perms) {
             _perms.set_all(perms);
+            _next_fault = 0;
+            _window = 0;
+        }
+
+        /**
+         * Determines the pages to map for a pagefault at <pfpage>. If the dataspace should be
+         * populated, the first fault maps the whole dataspace. Otherwise, the window starts with
+         * MIN_FAULT_WINDOW pages (a pagetable for BIGPAGES) and is doubled for each fault that
+         * directly follows the previously mapped pages, up to MAX_FAULT_WINDOW pages.
+         *
+         * @param pfpage the page that caused the fault; will be set to the first page to map
+         * @return the number of pages to map
+         */
+        size_t fault_window(uintptr_t &pfpage) {
+            size_t min = MIN_FAULT_WINDOW;
+            if(_desc.flags() & DataSpaceDesc::BIGPAGES) {
+                min = Math::max<size_t>(min, ExecEnv::PT_ENTRY_COUNT);
+                // take care that we start at the beginning (note that this assumes that it is
+                // properly aligned, which is made sure by root. otherwise we might leave the ds
+                pfpage &= ~(ExecEnv::BIG_PAGE_SIZE - 1);
+            }
+
+            if(_window == 0 && (_desc.flags() & POPULATE)) {
+                pfpage = _desc.virt();
+                _window = _desc.size() / ExecEnv::PAGE_SIZE;
+            }
+            else if(_window != 0 && pfpage == _next_fault)
+                _window = Math::min(Math::max(_window * 2, min), MAX_FAULT_WINDOW);
+            else
+                _window = min;
+            return _window;
+        }
+        /**
+         * Tells the dataspace that <pages> pages starting at <pfpage> have been mapped
+         */
+        void faulted(uintptr_t pfpage, size_t pages) {
+            _next_fault = pfpage + pages * ExecEnv::PAGE_SIZE;
+        }
+
+        /**
+         * Lets the dataspace initialize its content on demand instead of up front. That is, each
+         * page is filled with the corresponding part of <src>...<src>+<size> and zeroed behind
+         * that, before it is mapped for the first time. This is kept across remaps, i.e. pages
+         * are initialized at most once.
+         *
+         * @param src the address of the content in the parent (=us)
+         * @param size the number of bytes at <src>
+         * @param skip the number of bytes at the beginning that are already initialized
+         */
+        void init_on_demand(uintptr_t src, size_t size, size_t skip = 0) {
+            size_t pages = _desc.size() / ExecEnv::PAGE_SIZE;
+            size_t done = Math::min(Math::blockcount<size_t>(skip, ExecEnv::PAGE_SIZE), pages);
+            if(done == pages)
+                return;
+            _src = src;
+            _srcsize = size;
+            _init = new MaskField<1>(pages);
+            _init->clear_all();
+            for(size_t i = 0; i < done; ++i)
+                _init->set(i, 1);
+            _uninit = pages - done;
+        }
+        /**
+         * Initializes the pages <addr>...<addr>+<pages>*PAGE_SIZE that haven't been initialized
+         * yet, if init_on_demand() has been used.
+         *
+         * @param addr the virtual address of the first page
+         * @param pages the number of pages
+         */
+        void init_pages(uintptr_t addr, size_t pages) {
+            if(!_init)
+                return;
+            size_t first = (addr - _desc.virt()) / ExecEnv::PAGE_SIZE;
+            for(size_t i = first; i < first + pages; ++i) {
+                if(_init->get(i))
+                    continue;
+                size_t off = i * ExecEnv::PAGE_SIZE;
+                size_t amount = 0;
+                if(off < _srcsize)
+                    amount = Math::min<size_t>(_srcsize - off, ExecEnv::PAGE_SIZE);
+                char *dst = reinterpret_cast<char*>(_desc.origin() + off);
+                if(amount)
+                    memcpy(dst, reinterpret_cast<void*>(_src + off), amount);
+                memset(dst + amount, 0, ExecEnv::PAGE_SIZE - amount);
+                _init->set(i, 1);
+                _uninit--;
+            }
+            // everything is initialized, so we don't need to track it anymore
+            if(_uninit == 0) {
+                delete _init;
+                _init = nullptr;
+            }
         }
 
     private:
+        DS(const DS&);
+        DS& operator=(const DS&);
+
         DataSpaceDesc _desc;
         capsel_t _cap;
         MaskField<4> _perms;
+        uintptr_t _next_fault;
+        size_t _window;
+        uintptr_t _src;
+        size_t _srcsize;
+        MaskField<1> *_init;
+        size_t _uninit;
     };
 
     typedef SList<DS>::const_iterator iterator;
@@ -241,11 +356,13 @@ public:
      * @param addr the virtual address where to map it to in the child
      * @param flags the flags to use (desc.flags() is ignored)
      * @param sel the selector for the dataspace
+     * @return the added dataspace
      */
-    void add(const DataSpaceDesc& desc, uintptr_t addr, uint flags, capsel_t sel = ObjCap::INVALID) {
+    DS *add(const DataSpaceDesc& desc, uintptr_t addr, uint flags, capsel_t sel = ObjCap::INVALID) {
         DS *ds = new DS(DataSpaceDesc(desc.size(), desc.type(), flags, desc.phys(), addr,
                                       desc.virt()), sel);
         _list.insert(ds);
+        return ds;
     }
 
     /**
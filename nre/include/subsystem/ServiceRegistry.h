@@ -36,6 +36,9 @@ public:
  */
 class ServiceRegistry {
 public:
+    // the max. number of child slots whose usage of a service is tracked
+    static const size_t MAX_CLIENTS     = 32;
+
     /**
      * A service in the registry
      */
@@ -54,7 +57,7 @@ public:
         explicit Service(Child *child, const String &name, capsel_t pts, size_t count,
                          const BitField<Hip::MAX_CPUS> &available)
             : SListItem(), _child(child), _name(name), _pts(pts), _count(count), _sm(0),
-              _available(available) {
+              _available(available), _clients() {
         }
         /**
          * The destructor revokes the caps and frees the selectors
@@ -98,6 +101,12 @@ public:
         const Sm &sm() const {
             return _sm;
         }
+        /**
+         * @return the slots of the childs that have requested this service
+         */
+        BitField<MAX_CLIENTS> &clients() {
+            return _clients;
+        }
 
     private:
         Child *_child;
@@ -106,6 +115,7 @@ public:
         size_t _count;
         Sm _sm;
         BitField<Hip::MAX_CPUS> _available;
+        BitField<MAX_CLIENTS> _clients;
     };
 
     typedef SList<Service>::iterator iterator;
@@ -191,6 +201,13 @@ public:
     const Service* find(const String &name) const {
         return search(name);
     }
+    /**
+     * @param name the service name
+     * @return the service with given name
+     */
+    Service* find(const String &name) {
+        return search(name);
+    }
     /**
      * Removes all services from the given child
      *
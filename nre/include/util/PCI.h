@@ -79,14 +79,23 @@ public:
     }
 
     /**
-     * Program the nr-th MSI/MSI-X vector of the given device.
+     * Determines the number of MSI-X vectors of the given device.
+     *
+     * @return the number of vectors (0 if the device does not support MSI-X)
      */
-    Gsi *get_gsi_msi(BDF bdf, uint nr, void *msix_table = nullptr);
+    size_t get_msix_count(BDF bdf);
 
     /**
-     * Returns the gsi and enables them.
+     * Program the nr-th MSI/MSI-X vector of the given device. The interrupt is routed to <cpu>.
      */
-    Gsi *get_gsi(BDF bdf, uint nr, bool /*level*/ = false, void *msix_table = nullptr);
+    Gsi *get_gsi_msi(BDF bdf, uint nr, void *msix_table = nullptr,
+                     cpu_t cpu = CPU::current().log_id());
+
+    /**
+     * Returns the gsi and enables them. The interrupt is routed to <cpu>.
+     */
+    Gsi *get_gsi(BDF bdf, uint nr, bool /*level*/ = false, void *msix_table = nullptr,
+                 cpu_t cpu = CPU::current().log_id());
 
 private:
     void init_msix_table(void *addr, BDF bdf, value_type msix_offset, uint nr, Gsi *gsi) {
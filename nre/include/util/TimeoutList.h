@@ -18,118 +18,136 @@
 #pragma once
 
 #include <arch/Types.h>
-#include <Exception.h>
+#include <util/Math.h>
 #include <Assert.h>
 
 namespace nre {
 
-class TimeoutListException : public Exception {
-public:
-    explicit TimeoutListException(ErrorCode code = E_FAILURE, const String &msg = String()) throw()
-        : Exception(code, msg) {
-    }
-};
-
 /**
- * Keeping track of the timeouts.
+ * Keeping track of the timeouts. The timeouts are identified by numbers (starting with 1), which
+ * are handed out by alloc(). The armed ones are kept in a binary min-heap, so that arming and
+ * cancelling costs O(log n) and the next timeout can be determined in O(1). The number of
+ * timeouts is not limited; the list grows on demand.
+ *
+ * Note that the list is not thread-safe.
  */
-template<unsigned ENTRIES, typename DATA>
+template<typename DATA>
 class TimeoutList {
-    class TimeoutEntry {
-        friend class TimeoutList<ENTRIES, DATA>;
-        TimeoutEntry *_next;
-        TimeoutEntry *_prev;
-        timevalue_t _timeout;
-        DATA * data;
-        bool _free;
+    static const size_t NONE            = static_cast<size_t>(-1);
+
+    struct TimeoutEntry {
+        timevalue_t timeout;
+        DATA *data;
+        // the position in the heap or NONE if it is not armed
+        size_t pos;
+        // the next free entry, if this one is free
+        size_t next_free;
+        bool free;
     };
 
 public:
-    explicit TimeoutList() : _entries() {
-        for(size_t i = 0; i < ENTRIES; i++) {
-            _entries[i]._prev = _entries + i;
-            _entries[i]._next = _entries + i;
-            _entries[i].data = nullptr;
-            _entries[i]._free = true;
-        }
-        _entries[0]._timeout = ~0ULL;
+    static const size_t DEFAULT_CAPACITY    = 32;
+
+    /**
+     * Creates an empty list
+     *
+     * @param capacity the number of timeouts to reserve space for initially
+     */
+    explicit TimeoutList(size_t capacity = DEFAULT_CAPACITY)
+        : _entries(), _heap(), _capacity(0), _count(0), _free(NONE) {
+        grow(Math::max<size_t>(capacity, 2));
+    }
+    ~TimeoutList() {
+        delete[] _entries;
+        delete[] _heap;
     }
 
     /**
      * Alloc a new timeout object.
+     *
+     * @param data the data to associate with it
+     * @return the number of the timeout
      */
     size_t alloc(DATA *data = nullptr) {
-        for(size_t i = 1; i < ENTRIES; i++) {
-            if(!_entries[i]._free)
-                continue;
-            _entries[i].data = data;
-            _entries[i]._free = false;
-            return i;
-        }
-        throw TimeoutListException(E_CAPACITY, "No free timeout slots");
+        if(_free == NONE)
+            grow(_capacity * 2);
+        size_t nr = _free;
+        TimeoutEntry &e = _entries[nr];
+        _free = e.next_free;
+        e.free = false;
+        e.data = data;
+        e.pos = NONE;
+        return nr;
     }
 
     /**
      * Dealloc a timeout object.
      */
     bool dealloc(size_t nr, bool withcancel = false) {
-        assert(nr >= 1 && nr <= ENTRIES - 1);
-        if(_entries[nr]._free)
+        assert(nr >= 1 && nr < _capacity);
+        if(_entries[nr].free)
             return false;
 
-        // should only be done when no no concurrent access happens ...
         if(withcancel)
             cancel(nr);
-        _entries[nr]._free = true;
+        assert(_entries[nr].pos == NONE);
+        _entries[nr].free = true;
         _entries[nr].data = nullptr;
+        _entries[nr].next_free = _free;
+        _free = nr;
         return true;
     }
 
     /**
      * Cancel a programmed timeout.
+     *
+     * @return true if it was armed
      */
     bool cancel(size_t nr) {
-        assert(nr >= 1 && nr <= ENTRIES - 1);
-        TimeoutEntry *current = _entries + nr;
-        if(current->_next == current)
+        assert(nr >= 1 && nr < _capacity);
+        size_t pos = _entries[nr].pos;
+        if(pos == NONE)
             return false;
-        bool res = _entries[0]._next != current;
-        current->_next->_prev = current->_prev;
-        current->_prev->_next = current->_next;
-        current->_next = current->_prev = current;
-        return res;
+        remove(pos);
+        return true;
     }
 
     /**
-     * Request a new timeout.
+     * Request a new timeout. If it is already armed, it is moved to the given time.
+     *
+     * @return true if the next timeout did not change
      */
     bool request(size_t nr, timevalue_t to) {
-        assert(nr >= 1 && nr <= ENTRIES - 1);
+        assert(nr >= 1 && nr < _capacity && !_entries[nr].free);
         timevalue_t old = timeout();
-        TimeoutEntry *current = _entries + nr;
-        cancel(nr);
-
-        // keep a sorted list here
-        TimeoutEntry *t = _entries;
-        do {
-            t = t->_next;
+        TimeoutEntry &e = _entries[nr];
+        if(e.pos == NONE) {
+            e.timeout = to;
+            e.pos = _count++;
+            _heap[e.pos] = nr;
+            sift_up(e.pos);
+        }
+        else {
+            timevalue_t prev = e.timeout;
+            e.timeout = to;
+            if(to < prev)
+                sift_up(e.pos);
+            else
+                sift_down(e.pos);
         }
-        while(t->_timeout < to);
-
-        current->_timeout = to;
-        current->_next = t;
-        current->_prev = t->_prev;
-        t->_prev->_next = current;
-        t->_prev = current;
         return timeout() == old;
     }
 
     /**
      * Get the head of the queue.
+     *
+     * @param now the current time
+     * @param data if not null, the data of the timeout is stored there
+     * @return the number of the next timeout, if it is due, or 0
      */
     size_t trigger(timevalue_t now, DATA **data = nullptr) {
-        if(now >= timeout()) {
-            size_t i = _entries[0]._next - _entries;
+        if(_count > 0 && now >= timeout()) {
+            size_t i = _heap[0];
             if(data)
                 *data = _entries[i].data;
             return i;
@@ -137,13 +155,106 @@ public:
         return 0;
     }
 
-    timevalue_t timeout() {
-        assert(_entries[0]._next);
-        return _entries[0]._next->_timeout;
+    /**
+     * Cancels all timeouts that are due at <now> and calls <func>(nr, data) for each of them.
+     * Note that the timeout is cancelled before <func> is called, so that it may request it again.
+     *
+     * @param now the current time
+     * @param func the function to call
+     * @return the number of expired timeouts
+     */
+    template<typename FUNC>
+    size_t expire(timevalue_t now, FUNC func) {
+        size_t n = 0;
+        while(_count > 0 && now >= _entries[_heap[0]].timeout) {
+            size_t nr = _heap[0];
+            remove(0);
+            func(nr, _entries[nr].data);
+            n++;
+        }
+        return n;
+    }
+
+    /**
+     * @return the next timeout or ~0ULL if there is none
+     */
+    timevalue_t timeout() const {
+        return _count > 0 ? _entries[_heap[0]].timeout : ~0ULL;
     }
 
 private:
-    TimeoutEntry _entries[ENTRIES];
+    TimeoutList(const TimeoutList&);
+    TimeoutList& operator=(const TimeoutList&);
+
+    void grow(size_t capacity) {
+        TimeoutEntry *entries = new TimeoutEntry[capacity];
+        size_t *heap = new size_t[capacity];
+        for(size_t i = 0; i < _capacity; ++i)
+            entries[i] = _entries[i];
+        for(size_t i = 0; i < _count; ++i)
+            heap[i] = _heap[i];
+        // put the new ones into the freelist; entry 0 is never used
+        for(size_t i = capacity - 1; i >= Math::max<size_t>(_capacity, 1); --i) {
+            entries[i].free = true;
+            entries[i].data = nullptr;
+            entries[i].pos = NONE;
+            entries[i].next_free = _free;
+            _free = i;
+        }
+        delete[] _entries;
+        delete[] _heap;
+        _entries = entries;
+        _heap = heap;
+        _capacity = capacity;
+    }
+
+    void remove(size_t pos) {
+        _entries[_heap[pos]].pos = NONE;
+        if(--_count != pos) {
+            set(pos, _heap[_count]);
+            sift_down(pos);
+            sift_up(pos);
+        }
+    }
+    void set(size_t pos, size_t nr) {
+        _heap[pos] = nr;
+        _entries[nr].pos = pos;
+    }
+    void sift_up(size_t pos) {
+        size_t nr = _heap[pos];
+        timevalue_t to = _entries[nr].timeout;
+        while(pos > 0) {
+            size_t parent = (pos - 1) / 2;
+            if(_entries[_heap[parent]].timeout <= to)
+                break;
+            set(pos, _heap[parent]);
+            pos = parent;
+        }
+        set(pos, nr);
+    }
+    void sift_down(size_t pos) {
+        size_t nr = _heap[pos];
+        timevalue_t to = _entries[nr].timeout;
+        while(true) {
+            size_t child = pos * 2 + 1;
+            if(child >= _count)
+                break;
+            size_t right = child + 1;
+            if(right < _count && _entries[_heap[right]].timeout < _entries[_heap[child]].timeout)
+                child = right;
+            if(to <= _entries[_heap[child]].timeout)
+                break;
+            set(pos, _heap[child]);
+            pos = child;
+        }
+        set(pos, nr);
+    }
+
+    TimeoutEntry *_entries;
+    size_t *_heap;
+    size_t _capacity;
+    size_t _count;
+    size_t _free;
 };
 
 }
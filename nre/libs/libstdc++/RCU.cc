@@ -15,6 +15,10 @@
  */
 
 #include <arch/Startup.h>
+#include <kobj/GlobalThread.h>
+#include <kobj/Sm.h>
+#include <util/Atomic.h>
+#include <CPU.h>
 #include <RCU.h>
 
 namespace nre {
@@ -34,5 +38,37 @@ RCULock RCU::_lock;
 UserSm RCU::_sm INIT_PRIO_RCU;
 UserSm RCU::_ecsm INIT_PRIO_RCU;
 Init Init::init INIT_PRIO_RCU;
+volatile bool RCU::_waiting = false;
+static Sm *reclaim_sm = nullptr;
+
+void RCU::grace_period_end() {
+    // only the first reader wakes up the reclaim thread
+    if(Atomic::cmpnswap(&_waiting, true, false))
+        reclaim_sm->up();
+}
+
+void RCU::wait_for_readers() {
+    if(!_objs || _waiting)
+        return;
+
+    // the reclaim thread is created when it's needed for the first time
+    if(EXPECT_FALSE(!reclaim_sm)) {
+        reclaim_sm = new Sm(0);
+        GlobalThread::create(reclaim_thread, CPU::current().log_id(), "rcu-reclaim")->start();
+    }
+
+    _waiting = true;
+    Sync::memory_barrier();
+    // the readers might have left their critical section before they saw <_waiting>
+    if(deletable())
+        grace_period_end();
+}
+
+void RCU::reclaim_thread(void*) {
+    while(1) {
+        reclaim_sm->down();
+        gc(false);
+    }
+}
 
 }
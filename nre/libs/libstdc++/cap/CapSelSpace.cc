@@ -16,9 +16,184 @@
 
 #include <arch/Startup.h>
 #include <cap/CapSelSpace.h>
+#include <kobj/Thread.h>
+#include <util/Math.h>
 
 namespace nre {
 
 CapSelSpace CapSelSpace::_inst INIT_PRIO_CAPSPACE;
 
+CapSelSpace::CapSelSpace()
+    : _lck(), _off(Hip::get().object_caps()), _lists(), _unused(), _unused_count(INIT_BLOCKS),
+      _growing(false), _blocks() {
+    for(size_t i = 0; i < INIT_BLOCKS; ++i) {
+        _blocks[i].next = _unused;
+        _unused = _blocks + i;
+    }
+}
+
+CapSelSpace::ThreadCache *CapSelSpace::cache() {
+    Thread *t = Thread::current();
+    return t ? &t->_capsels : nullptr;
+}
+
+capsel_t CapSelSpace::allocate(uint count, uint align) {
+    if(count == 1 && align == 1) {
+        ThreadCache *c = cache();
+        if(c && c->count != ThreadCache::DISABLED && c->count > 0)
+            return c->sels[--c->count];
+    }
+
+    ScopedLock<SpinLock> lock(&_lck);
+    // a free block of 2^order selectors fulfills both the size and the alignment
+    uint order = Math::next_pow2_shift(Math::max(count, align));
+    capsel_t res;
+    if(order < ORDERS && take(order, res)) {
+        add_range(res + count, (1U << order) - count);
+        return res;
+    }
+
+    res = (_off + align - 1) & ~(align - 1);
+    if(res + count < res || res + count > Hip::get().cfg_cap)
+        throw CapException(E_NO_CAP_SELS);
+    _off = res + count;
+    return res;
+}
+
+void CapSelSpace::free(capsel_t base, uint count) {
+    if(count == 1 && base >= Hip::get().object_caps()) {
+        ThreadCache *c = cache();
+        if(c && c->count < ThreadCache::SIZE) {
+            c->sels[c->count++] = base;
+            return;
+        }
+    }
+
+    {
+        ScopedLock<SpinLock> lock(&_lck);
+        add_range(base, count);
+    }
+    if(EXPECT_FALSE(_unused_count < MIN_BLOCKS))
+        grow();
+}
+
+void CapSelSpace::flush(ThreadCache &cache) {
+    {
+        ScopedLock<SpinLock> lock(&_lck);
+        if(cache.count != ThreadCache::DISABLED) {
+            for(uint i = 0; i < cache.count; ++i)
+                add_range(cache.sels[i], 1);
+        }
+        cache.count = ThreadCache::DISABLED;
+    }
+    if(EXPECT_FALSE(_unused_count < MIN_BLOCKS))
+        grow();
+}
+
+bool CapSelSpace::take(uint order, capsel_t &base) {
+    for(uint o = order; o < ORDERS; ++o) {
+        Block *b = _lists[o];
+        if(b) {
+            _lists[o] = b->next;
+            base = b->base;
+            b->next = _unused;
+            _unused = b;
+            _unused_count++;
+            // split it until it has the requested size; the upper halves stay free
+            while(o > order) {
+                o--;
+                push(base + (1U << o), o);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void CapSelSpace::add_range(capsel_t base, uint count) {
+    // ignore selectors that have never been handed out by us
+    if(count == 0 || base < Hip::get().object_caps() || base + count < base || base + count > _off)
+        return;
+
+    // if it's at the end, simply give it back to the not yet used part
+    if(base + count == _off) {
+        _off = base;
+        return;
+    }
+
+    // split the range into naturally aligned power-of-two blocks
+    while(count > 0) {
+        uint order = Math::bit_scan_reverse(count);
+        if(base)
+            order = Math::min<uint>(order, Math::bit_scan_forward(base));
+        push(base, order);
+        base += 1U << order;
+        count -= 1U << order;
+    }
+}
+
+void CapSelSpace::push(capsel_t base, uint order) {
+    // merge it with its buddy as long as that is free as well. otherwise, the space would
+    // fragment into single selectors over time, so that aligned blocks could never be reused.
+    // the lists are short, because they are limited by the number of block descriptors.
+    while(order + 1 < ORDERS) {
+        capsel_t buddy = base ^ (1U << order);
+        Block **prev = _lists + order;
+        while(*prev && (*prev)->base != buddy)
+            prev = &(*prev)->next;
+        if(!*prev)
+            break;
+        Block *bud = *prev;
+        *prev = bud->next;
+        bud->next = _unused;
+        _unused = bud;
+        _unused_count++;
+        base &= ~(1U << order);
+        order++;
+    }
+
+    // if it's at the end now, give it back to the not yet used part
+    if(base + (1U << order) == _off) {
+        _off = base;
+        return;
+    }
+
+    Block *b = _unused;
+    // if we have no free descriptors anymore, the selectors are lost
+    if(!b)
+        return;
+    _unused = b->next;
+    _unused_count--;
+    b->base = base;
+    b->next = _lists[order];
+    _lists[order] = b;
+}
+
+void CapSelSpace::grow() {
+    {
+        ScopedLock<SpinLock> lock(&_lck);
+        if(_growing || _unused_count >= MIN_BLOCKS)
+            return;
+        _growing = true;
+    }
+
+    // we can't call malloc with the lock held, because it might need selectors itself
+    Block *blocks = nullptr;
+    try {
+        blocks = new Block[GROW_BLOCKS];
+    }
+    catch(...) {
+        // we'll try it again next time
+    }
+
+    ScopedLock<SpinLock> lock(&_lck);
+    for(size_t i = 0; blocks && i < GROW_BLOCKS; ++i) {
+        blocks[i].next = _unused;
+        _unused = blocks + i;
+    }
+    if(blocks)
+        _unused_count += GROW_BLOCKS;
+    _growing = false;
+}
+
 }
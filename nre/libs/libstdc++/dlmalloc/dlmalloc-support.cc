@@ -19,8 +19,11 @@
 #include <cap/CapSelSpace.h>
 #include <mem/DataSpace.h>
 #include <kobj/Pd.h>
+#include <kobj/Thread.h>
+#include <collection/Treap.h>
 #include <stream/Serial.h>
 #include <cstring>
+#include <new>
 #include <Syscalls.h>
 #include <util/Atomic.h>
 #include "dlmalloc-config.h"
@@ -35,9 +38,15 @@ EXTERN_C void* dlmemalign(size_t, size_t);
 EXTERN_C void* dlmalloc(size_t);
 EXTERN_C void* dlrealloc(void*, size_t);
 EXTERN_C void dlfree(void*);
+EXTERN_C size_t dlmalloc_usable_size(void*);
+EXTERN_C size_t dlmalloc_batch(size_t, void**, size_t);
+EXTERN_C size_t dlbulk_free(void**, size_t);
 
 EXTERN_C void dlmalloc_init();
+EXTERN_C void dlmalloc_thread_exit(Thread *t);
 EXTERN_C void dlmalloc_init_locks(void);
+EXTERN_C void dlmalloc_lock(void);
+EXTERN_C void dlmalloc_unlock(void);
 EXTERN_C void* malloc(size_t);
 EXTERN_C void* realloc(void*, size_t);
 EXTERN_C void free(void*);
@@ -45,6 +54,9 @@ EXTERN_C void free(void*);
 static void* startup_malloc(size_t size);
 static void startup_free(void *ptr);
 
+static void* cached_malloc(size_t size);
+static void cached_free(void *ptr);
+
 static malloc_func malloc_ptr = startup_malloc;
 static realloc_func realloc_ptr = 0;
 static free_func free_ptr = startup_free;
@@ -77,39 +89,302 @@ void semaphore_up(DlMallocSm *lk) {
 
 // Backend allocator
 
+/**
+ * We have to remember the selectors and the descriptor of each dataspace we create for dlmalloc to
+ * be able to destroy them in munmap. Since we can't use dynamic memory here, the mappings are
+ * stored in pages that we request separately.
+ */
+struct Mapping : public TreapNode<uintptr_t> {
+    explicit Mapping() : TreapNode<uintptr_t>(0), desc(), sel(), unmapsel(), next() {
+    }
+
+    DataSpaceDesc desc;
+    capsel_t sel;
+    capsel_t unmapsel;
+    Mapping *next;
+};
+
+// note that mmap and munmap are always called with the lock of dlmalloc held. creating and
+// destroying dataspaces requires IPC, which we don't want to do while holding the lock. thus, mmap
+// releases the lock meanwhile (dlmalloc reads its state again after mmap returns) and munmap only
+// puts the mappings into the dead list, which is destroyed later in free and realloc. the mappings
+// are only accessed with the lock held.
+static Treap<Mapping> *mappings = nullptr;
+static Mapping *free_mappings = nullptr;
+static Mapping *volatile dead_mappings = nullptr;
+
+static Treap<Mapping> &get_mappings() {
+    // mmap might be called before the static constructors have been run
+    static char mem[sizeof(Treap<Mapping>)] ALIGNED(sizeof(word_t));
+    if(EXPECT_FALSE(!mappings))
+        mappings = new (mem) Treap<Mapping>();
+    return *mappings;
+}
+
+static Mapping *alloc_mapping() {
+    if(!free_mappings) {
+        DataSpaceDesc desc(ExecEnv::PAGE_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW);
+        dlmalloc_unlock();
+        try {
+            DataSpace::create(desc);
+        }
+        catch(...) {
+            dlmalloc_lock();
+            throw;
+        }
+        dlmalloc_lock();
+        Mapping *m = reinterpret_cast<Mapping*>(desc.virt());
+        for(size_t i = 0; i < ExecEnv::PAGE_SIZE / sizeof(Mapping); ++i) {
+            new (m + i) Mapping();
+            m[i].next = free_mappings;
+            free_mappings = m + i;
+        }
+    }
+    Mapping *m = free_mappings;
+    free_mappings = m->next;
+    return m;
+}
+
+static void free_mapping(Mapping *m) {
+    m->next = free_mappings;
+    free_mappings = m;
+}
+
+static void destroy_dead_mappings() {
+    dlmalloc_lock();
+    Mapping *dead = dead_mappings;
+    dead_mappings = nullptr;
+    dlmalloc_unlock();
+
+    Mapping *m = dead;
+    for(; m; m = m->next) {
+        try {
+            DataSpace::destroy(m->desc, m->sel, m->unmapsel);
+        }
+        catch(...) {
+            // there is nothing we can do about it
+        }
+    }
+
+    dlmalloc_lock();
+    while(dead) {
+        m = dead;
+        dead = dead->next;
+        free_mapping(m);
+    }
+    dlmalloc_unlock();
+}
+
 void *mmap(void *, size_t size, int prot, int, int, off_t) {
-    DataSpaceDesc desc(size, DataSpaceDesc::ANONYMOUS, prot);
-    DataSpace::create(desc);
-    memset(reinterpret_cast<void*>(desc.virt()), 0, desc.size());
-    return reinterpret_cast<void*>(desc.virt());
+    // we can't throw exceptions through dlmalloc
+    try {
+        Mapping *m = alloc_mapping();
+        m->desc = DataSpaceDesc(size, DataSpaceDesc::ANONYMOUS, prot);
+        dlmalloc_unlock();
+        try {
+            DataSpace::create(m->desc, &m->sel, &m->unmapsel);
+            // the memory we get from our parent is not cleared, but dlmalloc assumes that
+            memset(reinterpret_cast<void*>(m->desc.virt()), 0, m->desc.size());
+        }
+        catch(...) {
+            dlmalloc_lock();
+            free_mapping(m);
+            throw;
+        }
+        dlmalloc_lock();
+        m->key(m->desc.virt());
+        get_mappings().insert(m);
+        return reinterpret_cast<void*>(m->desc.virt());
+    }
+    catch(...) {
+        return reinterpret_cast<void*>(-1);
+    }
 }
 
-int munmap(void *, size_t) {
-    // TODO implement me
+int munmap(void *start, size_t size) {
+    // dlmalloc may merge adjacent mappings to one segment and may try to release parts of a
+    // segment. we can only destroy complete dataspaces, so that we refuse it if the range isn't
+    // covered by complete dataspaces.
+    uintptr_t begin = reinterpret_cast<uintptr_t>(start);
+    uintptr_t end = begin + size;
+    for(uintptr_t addr = begin; addr < end; ) {
+        Mapping *m = get_mappings().find(addr);
+        if(!m || addr + m->desc.size() > end)
+            return -1;
+        addr += m->desc.size();
+    }
+
+    for(uintptr_t addr = begin; addr < end; ) {
+        Mapping *m = get_mappings().find(addr);
+        addr += m->desc.size();
+        get_mappings().remove(m);
+        m->next = dead_mappings;
+        dead_mappings = m;
+    }
     return 0;
 }
 
+// Per-thread caches
+
+/**
+ * Every thread has a cache of free chunks for small sizes, which allows to allocate and free them
+ * without taking the global lock of dlmalloc. Chunks are not owned by a thread, i.e. whoever frees
+ * a chunk puts it into its own cache. If a cache runs empty, it is refilled with a batch of chunks
+ * and if it gets too large, a part of it is given back to dlmalloc, both with one acquisition of
+ * the lock.
+ * There is no remote-free list to return chunks to the allocating thread, because a chunk doesn't
+ * know which thread allocated it. Instead, the cache is bounded: each bin holds at most
+ * MAX_CHUNKS chunks and all bins together at most MAX_BYTES. Thus, if one thread allocates and
+ * another one frees, the chunks don't pile up in the cache of the latter, but flow back via
+ * dlmalloc in batches.
+ */
+struct ThreadCache {
+    static const size_t GRANULARITY     = 16;
+    static const size_t CLASSES         = 16;
+    static const size_t REFILL          = 16;
+    static const size_t MAX_CHUNKS      = 32;
+    static const size_t MAX_BYTES       = 32 * 1024;
+
+    struct FreeChunk {
+        FreeChunk *next;
+    };
+    struct Bin {
+        FreeChunk *head;
+        size_t count;
+    };
+
+    // bin i holds chunks that have room for at least i * GRANULARITY bytes
+    Bin bins[CLASSES + 1];
+    // the number of bytes in all bins (by their class size)
+    size_t bytes;
+};
+
+// marks the cache of a thread that is being destroyed
+static ThreadCache *const NO_CACHE = reinterpret_cast<ThreadCache*>(-1);
+
+static ThreadCache *get_cache() {
+    Thread *t = Thread::current();
+    ThreadCache *cache = t->get_tls<ThreadCache*>(Thread::TLS_MALLOC);
+    if(EXPECT_FALSE(!cache)) {
+        cache = static_cast<ThreadCache*>(dlmalloc(sizeof(ThreadCache)));
+        if(!cache)
+            return nullptr;
+        memset(cache, 0, sizeof(ThreadCache));
+        t->set_tls<ThreadCache*>(Thread::TLS_MALLOC, cache);
+    }
+    else if(EXPECT_FALSE(cache == NO_CACHE))
+        return nullptr;
+    return cache;
+}
+
+static bool refill(ThreadCache *cache, ThreadCache::Bin *bin, size_t size) {
+    void *chunks[ThreadCache::REFILL];
+    size_t n = dlmalloc_batch(size, chunks, ThreadCache::REFILL);
+    for(size_t i = 0; i < n; ++i) {
+        ThreadCache::FreeChunk *c = static_cast<ThreadCache::FreeChunk*>(chunks[i]);
+        c->next = bin->head;
+        bin->head = c;
+    }
+    bin->count += n;
+    cache->bytes += n * size;
+    return n > 0;
+}
+
+static void drain(ThreadCache *cache, ThreadCache::Bin *bin, size_t count) {
+    void *chunks[ThreadCache::MAX_CHUNKS];
+    size_t n;
+    for(n = 0; n < count && bin->head; ++n) {
+        chunks[n] = bin->head;
+        bin->head = bin->head->next;
+    }
+    bin->count -= n;
+    cache->bytes -= n * (bin - cache->bins) * ThreadCache::GRANULARITY;
+    dlbulk_free(chunks, n);
+}
+
+static void* cached_malloc(size_t size) {
+    size_t cls = (size + ThreadCache::GRANULARITY - 1) / ThreadCache::GRANULARITY;
+    if(cls > ThreadCache::CLASSES)
+        return dlmalloc(size);
+    if(cls == 0)
+        cls = 1;
+
+    ThreadCache *cache = get_cache();
+    if(EXPECT_FALSE(!cache))
+        return dlmalloc(size);
+    ThreadCache::Bin *bin = cache->bins + cls;
+    if(EXPECT_FALSE(!bin->head && !refill(cache, bin, cls * ThreadCache::GRANULARITY)))
+        return nullptr;
+    ThreadCache::FreeChunk *c = bin->head;
+    bin->head = c->next;
+    bin->count--;
+    cache->bytes -= cls * ThreadCache::GRANULARITY;
+    return c;
+}
+
+static void cached_free(void *ptr) {
+    if(!ptr)
+        return;
+
+    size_t cls = dlmalloc_usable_size(ptr) / ThreadCache::GRANULARITY;
+    ThreadCache *cache;
+    if(cls == 0 || cls > ThreadCache::CLASSES || !(cache = get_cache())) {
+        dlfree(ptr);
+        return;
+    }
+
+    ThreadCache::Bin *bin = cache->bins + cls;
+    ThreadCache::FreeChunk *c = static_cast<ThreadCache::FreeChunk*>(ptr);
+    c->next = bin->head;
+    bin->head = c;
+    cache->bytes += cls * ThreadCache::GRANULARITY;
+    bin->count++;
+    if(EXPECT_FALSE(bin->count > ThreadCache::MAX_CHUNKS || cache->bytes > ThreadCache::MAX_BYTES))
+        drain(cache, bin, (bin->count + 1) / 2);
+}
+
 // External interface
 
 void dlmalloc_init() {
     dlmalloc_init_locks();
-    malloc_ptr = dlmalloc;
+    malloc_ptr = cached_malloc;
     realloc_ptr = dlrealloc;
-    free_ptr = dlfree;
+    free_ptr = cached_free;
+}
+
+void dlmalloc_thread_exit(Thread *t) {
+    ThreadCache *cache = t->get_tls<ThreadCache*>(Thread::TLS_MALLOC);
+    // the thread object itself might be freed afterwards, which should not create a new cache
+    t->set_tls<ThreadCache*>(Thread::TLS_MALLOC, NO_CACHE);
+    if(!cache || cache == NO_CACHE)
+        return;
+    for(size_t i = 1; i <= ThreadCache::CLASSES; ++i) {
+        while(cache->bins[i].head)
+            drain(cache, cache->bins + i, ThreadCache::MAX_CHUNKS);
+    }
+    dlfree(cache);
+    if(dead_mappings)
+        destroy_dead_mappings();
 }
 
 void* malloc(size_t size) {
     return malloc_ptr(size);
 }
 void* realloc(void *p, size_t size) {
-    return realloc_ptr(p, size);
+    void *res = realloc_ptr(p, size);
+    if(EXPECT_FALSE(dead_mappings))
+        destroy_dead_mappings();
+    return res;
 }
 void free(void *p) {
     char *addr = reinterpret_cast<char*>(p);
     if(addr >= startup_heap && addr < startup_heap + sizeof(startup_heap))
         startup_free(p);
-    else
+    else {
         free_ptr(p);
+        if(EXPECT_FALSE(dead_mappings))
+            destroy_dead_mappings();
+    }
 }
 
 // startup malloc implementation
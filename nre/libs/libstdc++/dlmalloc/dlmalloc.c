@@ -2626,6 +2626,10 @@ static struct malloc_state _gm_;
 #define gm                 (&_gm_)
 #define is_global(M)       ((M) == &_gm_)
 
+/* Lets mmap release the lock of the global malloc_state while it creates memory */
+void dlmalloc_unlock(void) { RELEASE_LOCK(&gm->mutex); }
+void dlmalloc_lock(void) { ACQUIRE_LOCK(&gm->mutex); }
+
 #endif /* !ONLY_MSPACES */
 
 #define is_initialized(M)  ((M)->top != 0)
@@ -4520,7 +4524,8 @@ static void* tmalloc_small(mstate m, size_t nb) {
 
 #if !ONLY_MSPACES
 
-void* dlmalloc(size_t bytes) {
+/* NRE: the body of dlmalloc, which expects that the lock of gm is held */
+static void* malloc_locked(size_t bytes) {
   /*
      Basic algorithm:
      If a small request (< 256 bytes minus per-chunk overhead):
@@ -4544,11 +4549,7 @@ void* dlmalloc(size_t bytes) {
      The ugly goto's here ensure that postaction occurs along all paths.
   */
 
-#if USE_LOCKS
-  ensure_initialization(); /* initialize in sys_alloc if not using locks */
-#endif
-
-  if (!PREACTION(gm)) {
+  {
     void* mem;
     size_t nb;
     if (bytes <= MAX_SMALL_REQUEST) {
@@ -4649,6 +4650,17 @@ void* dlmalloc(size_t bytes) {
     mem = sys_alloc(gm, nb);
 
   postaction:
+    return mem;
+  }
+}
+
+void* dlmalloc(size_t bytes) {
+#if USE_LOCKS
+  ensure_initialization(); /* initialize in sys_alloc if not using locks */
+#endif
+
+  if (!PREACTION(gm)) {
+    void* mem = malloc_locked(bytes);
     POSTACTION(gm);
     return mem;
   }
@@ -4656,6 +4668,27 @@ void* dlmalloc(size_t bytes) {
   return 0;
 }
 
+/*
+  NRE: allocates up to n chunks of the given size with taking the lock only once and stores
+  them in chunks. Returns the number of allocated chunks. In contrast to independent_comalloc,
+  the chunks are ordinary ones and the flags of gm are not touched without the lock.
+*/
+size_t dlmalloc_batch(size_t bytes, void** chunks, size_t n) {
+  size_t i = 0;
+#if USE_LOCKS
+  ensure_initialization();
+#endif
+
+  if (!PREACTION(gm)) {
+    for (; i < n; ++i) {
+      if ((chunks[i] = malloc_locked(bytes)) == 0)
+        break;
+    }
+    POSTACTION(gm);
+  }
+  return i;
+}
+
 /* ---------------------------- free --------------------------- */
 
 void dlfree(void* mem) {
@@ -21,54 +21,84 @@ namespace nre {
 
 ServiceSession *Service::new_session(capsel_t cap) {
     ScopedLock<UserSm> guard(&_sm);
-    for(size_t i = 0; i < MAX_SESSIONS; ++i) {
-        if(_sessions[i] == nullptr) {
-            LOG(SERVICES, "Creating session " << i << " (caps=" << _caps + (i << CPU::order()) << ")\n");
-            add_session(create_session(i, cap, _caps + (i << CPU::order()), _func));
-            return _sessions[i];
+    ChunkTable *t = _chunks;
+    size_t i;
+    for(i = 0; i < t->count; ++i) {
+        if(t->chunks[i]->used < CHUNK_SIZE)
+            break;
+    }
+
+    // all chunks are full, so add a new one. the table is replaced by a copy with one more entry
+    if(i == t->count) {
+        ScopedPtr<Chunk> c(new Chunk());
+        ChunkTable *nt = new ChunkTable(t->count + 1);
+        for(size_t j = 0; j < t->count; ++j) {
+            nt->chunks[j] = t->chunks[j];
+            nt->insert(t->chunks[j]);
+        }
+        nt->chunks[i] = c.release();
+        nt->insert(nt->chunks[i]);
+        rcu_assign_pointer(_chunks, nt);
+        RCU::invalidate(t);
+        t = nt;
+    }
+
+    Chunk *c = t->chunks[i];
+    for(size_t j = 0; j < CHUNK_SIZE; ++j) {
+        if(c->sessions[j] == nullptr) {
+            size_t id = (i << CHUNK_ORDER) + j;
+            capsel_t caps = c->caps + (j << CPU::order());
+            LOG(SERVICES, "Creating session " << id << " (caps=" << caps << ")\n");
+            ServiceSession *sess = create_session(id, cap, caps, _func);
+            add_session(sess);
+            return sess;
         }
     }
+    // not reachable, because the chunk has a free slot
     throw ServiceException(E_CAPACITY, "No free sessions");
 }
 
 void Service::check_sessions() {
-    capsel_t sid;
+    capsel_t dead[MAX_DEAD];
+    size_t count;
     do {
-        // find a session that should be destroyed
-        sid = ObjCap::INVALID;
+        // find the sessions that should be destroyed
+        count = 0;
         {
             ScopedLock<RCULock> guard(&RCU::lock());
-            for(auto it = sessions_begin<ServiceSession>(); it != sessions_end<ServiceSession>(); ++it) {
+            for(auto it = sessions_begin<ServiceSession>();
+                count < MAX_DEAD && it != sessions_end<ServiceSession>(); ++it) {
                 // if the capability is NULL, it has been revoked which means that the client is dead
                 Crd crd = Syscalls::lookup(Crd(it->cap(), 0, Crd::OBJ));
-                if(crd.is_null()) {
-                    sid = it->portal_caps();
-                    break;
-                }
+                if(crd.is_null())
+                    dead[count++] = it->portal_caps();
             }
         }
 
         // note that we can't hold the RCULock while destroying a session, which makes this a
         // bit more complicated
-        if(sid != ObjCap::INVALID) {
+        for(size_t i = 0; i < count; ++i) {
             try {
-                destroy_session(sid);
+                destroy_session(dead[i]);
             }
             catch(...) {
                 // ignore
             }
         }
     }
-    while(sid != ObjCap::INVALID);
+    while(count == MAX_DEAD);
+
+    // delete the sessions that nobody can access anymore. the remaining ones are deleted by the
+    // RCU reclaim thread as soon as the grace period is over
+    RCU::gc(false);
 }
 
 void Service::destroy_session(capsel_t pid) {
     ScopedLock<UserSm> guard(&_sm);
-    size_t i = (pid - _caps) >> CPU::order();
-    LOG(SERVICES, "Destroying session " << i << "\n");
-    ServiceSession *sess = _sessions[i];
+    ServiceSession *sess = session_by_pt(pid);
     if(!sess)
-        VTHROW(ServiceException, E_NOT_FOUND, "Session " << i << " does not exist");
+        VTHROW(ServiceException, E_NOT_FOUND, "Session for portal " << pid << " does not exist");
+    LOG(SERVICES, "Destroying session " << sess->id() << "\n");
     remove_session(sess);
 }
 
@@ -29,8 +29,9 @@ ServiceCPUHandler::ServiceCPUHandler(Service* s, capsel_t pt, cpu_t cpu)
       _pt(_service_ec, pt, portal), _sm() {
     _service_ec->set_tls<Service*>(Thread::TLS_PARAM, s);
     UtcbFrameRef ecuf(_service_ec->utcb());
-    // for session-identification
-    ecuf.accept_translates(s->_caps, Service::MAX_SESSIONS_ORDER + CPU::order());
+    // for session-identification. the session portals are spread over multiple selector ranges,
+    // so that we accept translations into our whole selector space
+    ecuf.accept_translates();
     ecuf.accept_delegates(0);
 }
 
@@ -20,7 +20,8 @@
 namespace nre {
 
 ServiceSession::ServiceSession(Service *s, size_t id, capsel_t cap, capsel_t pts, Pt::portal_func func)
-    : RCUObject(), _id(id), _cap(cap), _caps(pts), _pts(new Pt *[CPU::count()]) {
+    : RCUObject(), _id(id), _cap(cap), _caps(pts), _pts(new Pt *[CPU::count()]), _prev(),
+      _next() {
     for(uint i = 0; i < CPU::count(); ++i) {
         _pts[i] = nullptr;
         if(s->available().is_set(i)) {
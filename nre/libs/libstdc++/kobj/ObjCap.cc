@@ -32,8 +32,9 @@ ObjCap::~ObjCap() {
                 // ignore it
             }
         }
-        if(!(_sel & KEEP_SEL_BIT))
-            CapSelSpace::get().free(_sel);
+        // if we keep the capability, the selector is still in use and can't be reused
+        if(!(_sel & KEEP_BITS))
+            CapSelSpace::get().free(sel());
     }
 }
 
@@ -27,8 +27,8 @@ namespace nre {
 
 Pd Pd::_cur INIT_PRIO_PD (CapSelSpace::INIT_PD);
 
-// don't revoke our own Pd
-Pd::Pd(capsel_t cap) : ObjCap(cap, ObjCap::KEEP_CAP_BIT) {
+// don't revoke our own Pd. the selector is a fixed one, so that we don't own it either
+Pd::Pd(capsel_t cap) : ObjCap(cap, ObjCap::KEEP_CAP_BIT | ObjCap::KEEP_SEL_BIT) {
     if(_startup_info.child) {
         // grab our initial caps (pd, ec, sc) from parent
         UtcbFrame uf;
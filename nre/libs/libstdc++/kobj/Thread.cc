@@ -23,20 +23,23 @@
 #include <CPU.h>
 #include <RCU.h>
 
+EXTERN_C void dlmalloc_thread_exit(nre::Thread *t);
+
 namespace nre {
 
-// slot 0 is reserved
-size_t Thread::_tls_idx = 1;
+// slot 0 and 1 are reserved
+size_t Thread::_tls_idx = 2;
 
 Thread::Thread(Pd *pd, Syscalls::ECType type, ExecEnv::startup_func start, uintptr_t ret, cpu_t cpu,
                capsel_t evb, uintptr_t stack, uintptr_t uaddr)
     : Ec(cpu, evb, create(this, pd, type, cpu, evb, start, ret, uaddr, stack, _flags)),
-      SListItem(), _rcu_counter(0), _utcb_addr(uaddr), _stack_addr(stack), _tls() {
+      SListItem(), _rcu_counter(0), _utcb_addr(uaddr), _stack_addr(stack), _tls(),
+      _capsels() {
 }
 
 Thread::Thread(cpu_t cpu, capsel_t evb, capsel_t cap, uintptr_t stack, uintptr_t uaddr)
     : Ec(cpu, evb, cap), SListItem(), _rcu_counter(0), _utcb_addr(uaddr), _stack_addr(stack),
-      _flags(), _tls() {
+      _flags(), _tls(), _capsels() {
 }
 
 capsel_t Thread::create(Thread *t, Pd *pd, Syscalls::ECType type, cpu_t cpu, capsel_t evb,
@@ -70,7 +73,11 @@ capsel_t Thread::create(Thread *t, Pd *pd, Syscalls::ECType type, cpu_t cpu, cap
 }
 
 Thread::~Thread() {
+    // give the cached memory back to the allocator
+    dlmalloc_thread_exit(this);
     RCU::remove(this);
+    // the same for the cached selectors
+    CapSelSpace::get().flush(_capsels);
 }
 
 }
@@ -85,28 +85,41 @@ void DataSpace::join() {
 void DataSpace::destroy() {
     if(_unmapsel != ObjCap::INVALID) {
         assert(_sel != ObjCap::INVALID);
-        UtcbFrame uf;
-
-        // don't do that in the root-task. we allocate all memory at the beginning and simply manage
-        // the usage of it. therefore, we never revoke it.
-        if(_startup_info.child) {
-            // ensure that the range is unmapped from our address space. this might not happen immediatly
-            // otherwise because the ds might still be in use by somebody else. thus, the parent won't
-            // revoke the memory in this case. but the parent might try to reuse the addresses in our
-            // address space
-            CapRange(_desc.virt() >> ExecEnv::PAGE_SHIFT,
-                     _desc.size() >> ExecEnv::PAGE_SHIFT, Crd::MEM_ALL).revoke(true);
-        }
-
-        uf.translate(_unmapsel);
-        uf << DESTROY << _desc;
-        CPU::current().ds_pt().call(uf);
-
-        CapSelSpace::get().free(_unmapsel);
-        CapSelSpace::get().free(_sel);
+        destroy(_desc, _sel, _unmapsel);
     }
 }
 
+void DataSpace::destroy(const DataSpaceDesc &desc, capsel_t sel, capsel_t unmapsel) {
+    UtcbFrame uf;
+
+    // don't do that in the root-task. we allocate all memory at the beginning and simply manage
+    // the usage of it. therefore, we never revoke it.
+    if(_startup_info.child) {
+        // ensure that the range is unmapped from our address space. this might not happen immediatly
+        // otherwise because the ds might still be in use by somebody else. thus, the parent won't
+        // revoke the memory in this case. but the parent might try to reuse the addresses in our
+        // address space
+        CapRange(desc.virt() >> ExecEnv::PAGE_SHIFT,
+                 desc.size() >> ExecEnv::PAGE_SHIFT, Crd::MEM_ALL).revoke(true);
+    }
+
+    uf.translate(unmapsel);
+    uf << DESTROY << desc;
+    CPU::current().ds_pt().call(uf);
+
+    // the parent does only drop a reference if the dataspace is still used by others. thus, our
+    // caps might still be there, but the selectors are reused.
+    try {
+        Syscalls::revoke(Crd(unmapsel, 0, Crd::OBJ_ALL), true);
+        Syscalls::revoke(Crd(sel, 0, Crd::OBJ_ALL), true);
+    }
+    catch(...) {
+        // ignore it
+    }
+    CapSelSpace::get().free(unmapsel);
+    CapSelSpace::get().free(sel);
+}
+
 void DataSpace::touch() {
     uint *addr = reinterpret_cast<uint*>(_desc.virt());
     uint *end = reinterpret_cast<uint*>(_desc.virt() + _desc.size());
@@ -61,7 +61,7 @@ void Child::release_regs() {
     for(auto it = _regs.begin(); it != _regs.end(); ++it) {
         DataSpaceDesc desc = it->desc();
         if(it->cap() != ObjCap::INVALID && desc.type() != DataSpaceDesc::VIRTUAL)
-            _cm->_dsm.release(desc, it->cap());
+            _cm->release_ds(desc, it->cap());
     }
 }
 
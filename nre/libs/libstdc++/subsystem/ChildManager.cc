@@ -30,7 +30,7 @@ namespace nre {
 ChildManager::ChildManager()
     : _child_count(), _childs(),
       _portal_caps(CapSelSpace::get().allocate(MAX_CHILDS * per_child_caps(), per_child_caps())),
-      _dsm(), _registry(), _sm(), _switchsm(), _slotsm(), _regsm(0), _diesm(0), _ecs(), _regecs() {
+      _dsm(), _segments(), _segsm(), _registry(), _sm(), _slotsm(), _regsm(0), _diesm(0), _ecs(), _regecs() {
     _ecs = new LocalThread *[CPU::count()];
     _regecs = new LocalThread *[CPU::count()];
     for(auto it = CPU::begin(); it != CPU::end(); ++it) {
@@ -62,8 +62,12 @@ ChildManager::~ChildManager() {
     }
     delete[] _ecs;
     delete[] _regecs;
-    CapSelSpace::get().free(MAX_CHILDS * per_child_caps());
+    CapSelSpace::get().free(_portal_caps, MAX_CHILDS * per_child_caps());
     RCU::gc(true);
+    for(auto it = _segments.begin(); it != _segments.end(); ) {
+        auto old = it++;
+        delete &*old;
+    }
 }
 
 void ChildManager::prepare_stack(Child *c, uintptr_t &sp, uintptr_t csp) {
@@ -175,7 +179,26 @@ void ChildManager::build_hip(Child *c, const ChildConfig &config) {
     c->reglist().add(ds.desc(), c->_hip, ChildMemory::R | ChildMemory::OWN, ds.unmapsel());
 }
 
-Child::id_type ChildManager::load(uintptr_t addr, size_t size, const ChildConfig &config) {
+Child::id_type ChildManager::load(uintptr_t addr, size_t size, const ChildConfig &config,
+                                  bool persistent) {
+    Child::id_type id = start(addr, size, config, persistent);
+
+    // wait until all services are registered
+    while(1) {
+        size_t services_present = 0;
+        for(size_t i = 0; i < config.waits(); ++i) {
+            if(has_service(config.wait(i)))
+                services_present++;
+        }
+        if(services_present == config.waits())
+            break;
+        wait_for_service();
+    }
+    return id;
+}
+
+Child::id_type ChildManager::start(uintptr_t addr, size_t size, const ChildConfig &config,
+                                   bool persistent) {
     ElfEh *elf = reinterpret_cast<ElfEh*>(addr);
 
     // check ELF
@@ -199,6 +222,7 @@ Child::id_type ChildManager::load(uintptr_t addr, size_t size, const ChildConfig
     size_t idx = free_slot();
     capsel_t pts = _portal_caps + idx * per_child_caps();
     Child *c = new Child(this, pts, config.cmdline());
+    c->_populate = config.populate();
     try {
         // we have to create the portals first to be able to delegate them to the new Pd
         c->_ptcount = CPU::count() * (ARRAY_SIZE(exc) + Portals::COUNT - 1);
@@ -248,16 +272,37 @@ Child::id_type ChildManager::load(uintptr_t addr, size_t size, const ChildConfig
                 perms |= ChildMemory::W;
             if(ph->p_flags & PF_X)
                 perms |= ChildMemory::X;
-
-            size_t dssize = Math::round_up<size_t>(ph->p_memsz, ExecEnv::PAGE_SIZE);
-            // TODO leak, if reglist().add throws
-            const DataSpace &ds = _dsm.create(
-                DataSpaceDesc(dssize, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RWX));
-            // TODO actually it would be better to do that later
-            memcpy(reinterpret_cast<void*>(ds.virt()),
-                   reinterpret_cast<void*>(addr + ph->p_offset), ph->p_filesz);
-            memset(reinterpret_cast<void*>(ds.virt() + ph->p_filesz), 0, ph->p_memsz - ph->p_filesz);
-            c->reglist().add(ds.desc(), ph->p_vaddr, perms, ds.unmapsel());
+            if(c->populate())
+                perms |= ChildMemory::POPULATE;
+
+            // read-only segments are shared between all instances of the same module
+            bool shared = !(ph->p_flags & PF_W);
+            const DataSpace *ds = shared ? join_segment(addr, size, ph) : nullptr;
+            size_t skip = 0;
+            if(ds)
+                perms &= ~ChildMemory::OWN;
+            else {
+                size_t dssize = Math::round_up<size_t>(ph->p_memsz, ExecEnv::PAGE_SIZE);
+                // TODO leak, if reglist().add throws
+                ds = &_dsm.create(
+                    DataSpaceDesc(dssize, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RWX));
+                // shared segments are compared with the module and therefore need their content.
+                // the others are initialized on the first fault, as far as possible
+                if(shared || !persistent) {
+                    skip = Math::round_up<size_t>(ph->p_filesz, ExecEnv::PAGE_SIZE);
+                    if(shared)
+                        skip = dssize;
+                    memcpy(reinterpret_cast<void*>(ds->virt()),
+                           reinterpret_cast<void*>(addr + ph->p_offset), ph->p_filesz);
+                    memset(reinterpret_cast<void*>(ds->virt() + ph->p_filesz), 0,
+                           Math::min<size_t>(skip, ph->p_memsz) - ph->p_filesz);
+                }
+                if(shared)
+                    add_segment(size, ph, *ds);
+            }
+            ChildMemory::DS *cds = c->reglist().add(ds->desc(), ph->p_vaddr, perms, ds->unmapsel());
+            if(!shared)
+                cds->init_on_demand(addr + ph->p_offset, ph->p_filesz, skip);
         }
 
         // utcb
@@ -291,20 +336,6 @@ Child::id_type ChildManager::load(uintptr_t addr, size_t size, const ChildConfig
     }
 
     _child_count++;
-
-    // wait until all services are registered
-    if(config.waits() > 0) {
-        size_t services_present;
-        do {
-            _regsm.down();
-            services_present = 0;
-            for(size_t i = 0; i < config.waits(); ++i) {
-                if(_registry.find(config.wait(i)))
-                    services_present++;
-            }
-        }
-        while(services_present < config.waits());
-    }
     return c->id();
 }
 
@@ -411,7 +442,7 @@ void ChildManager::Portals::service(capsel_t pid) {
                 uf.finish_input();
 
                 LOG(SERVICES, "Child '" << c->cmdline() << "' gets " << name << "\n");
-                const ServiceRegistry::Service* s = cm->get_service(name);
+                const ServiceRegistry::Service* s = cm->get_service(c, name);
 
                 uf.delegate(CapRange(s->pts(), CPU::count(), Crd::OBJ_ALL));
                 uf << E_SUCCESS << s->available();
@@ -422,7 +453,7 @@ void ChildManager::Portals::service(capsel_t pid) {
                 uf.finish_input();
 
                 LOG(SERVICES, "Child '" << c->cmdline() << "' says clients died\n");
-                cm->notify_services();
+                cm->notify_services(cm->slot(c), false);
 
                 uf << E_SUCCESS;
             }
@@ -683,6 +714,9 @@ void ChildManager::map(UtcbFrameRef &uf, Child *c, DataSpace::RequestType type)
         // add it to the regions of the child
         uint flags = ds.flags();
         try {
+            // the child or its config may want to have it mapped completely on the first fault
+            if(c->populate() || (type != DataSpace::JOIN && (desc.flags() & ChildMemory::POPULATE)))
+                flags |= ChildMemory::POPULATE;
             // only create creations and non-device-memory
             if(type != DataSpace::JOIN && desc.phys() == 0)
                 flags |= ChildMemory::OWN;
@@ -698,7 +732,7 @@ void ChildManager::map(UtcbFrameRef &uf, Child *c, DataSpace::RequestType type)
             c->reglist().add(ds.desc(), addr, flags, ds.unmapsel());
         }
         catch(...) {
-            _dsm.release(desc, ds.unmapsel());
+            release_ds(desc, ds.unmapsel());
             throw;
         }
 
@@ -723,16 +757,32 @@ void ChildManager::switch_to(UtcbFrameRef &uf, Child *c) {
     capsel_t dstsel = uf.get_translated(0).offset();
     uf.finish_input();
 
-    {
-        // note that we need another lock here since it may also involve childs of c (c may have
-        // delegated it and if they cause a pagefault during this operation, we might get mixed
-        // results)
-        ScopedLock<UserSm> guard_switch(&_switchsm);
+    // lock all childs, because the switch may also involve childs of c (c may have delegated it).
+    // if they would cause a pagefault during this operation, we might get mixed results. the
+    // locks are always taken in the order of the slots, so that concurrent switches can't
+    // deadlock. pagefaults only take the lock of the faulting child and thus, faults of
+    // different childs are handled in parallel.
+    Child *locked[MAX_CHILDS];
+    size_t count = 0;
+    for(size_t i = 0; i < MAX_CHILDS; ++i) {
+        Child *ch = rcu_dereference(_childs[i]);
+        if(ch) {
+            ch->_sm.down();
+            locked[count++] = ch;
+        }
+    }
+
+    try {
+        // c might have been removed in the meanwhile
+        size_t idx;
+        for(idx = 0; idx < count && locked[idx] != c; ++idx)
+            ;
+        if(idx == count)
+            throw ChildException(E_NOT_FOUND, "Child does not exist anymore");
 
         uintptr_t srcorg, dstorg;
         {
             // first do the stuff for the child that requested the switch
-            ScopedLock<UserSm> guard_regs(&c->_sm);
             ChildMemory::DS *src, *dst;
             src = c->reglist().find(srcsel);
             dst = c->reglist().find(dstsel);
@@ -774,12 +824,11 @@ void ChildManager::switch_to(UtcbFrameRef &uf, Child *c) {
         }
 
         // now change the mapping for all other childs that have one of these dataspaces
-        for(size_t x = 0, i = 0; i < MAX_CHILDS && x < _child_count; ++i) {
-            Child *ch = rcu_dereference(_childs[i]);
-            if(ch == 0 || ch == c)
+        for(size_t i = 0; i < count; ++i) {
+            Child *ch = locked[i];
+            if(ch == c)
                 continue;
 
-            ScopedLock<UserSm> guard_regs(&ch->_sm);
             DataSpaceDesc dummy;
             ChildMemory::DS *src, *dst;
             src = ch->reglist().find(srcsel);
@@ -796,19 +845,60 @@ void ChildManager::switch_to(UtcbFrameRef &uf, Child *c) {
             }
             if(dst) {
                 dst->desc().origin(srcorg);
-                src->all_perms(0);
+                dst->all_perms(0);
             }
-            x++;
         }
 
         // now swap the origins also in the dataspace-manager (otherwise clients that join
         // afterwards will receive the wrong location)
         _dsm.swap(srcsel, dstsel);
     }
+    catch(...) {
+        for(size_t i = 0; i < count; ++i)
+            locked[i]->_sm.up();
+        throw;
+    }
+    for(size_t i = 0; i < count; ++i)
+        locked[i]->_sm.up();
 
     uf << E_SUCCESS;
 }
 
+const DataSpace *ChildManager::join_segment(uintptr_t addr, size_t size, const ElfPh *ph) {
+    ScopedLock<UserSm> guard(&_segsm);
+    for(auto it = _segments.begin(); it != _segments.end(); ++it) {
+        if(!it->matches(size, ph))
+            continue;
+        // the modules might still differ, so compare the content as well. note that the
+        // dataspace can't be destroyed meanwhile since we hold _segsm
+        const DataSpace &ds = _dsm.join(it->sel);
+        if(memcmp(reinterpret_cast<void*>(ds.virt()),
+                  reinterpret_cast<void*>(addr + ph->p_offset), ph->p_filesz) == 0)
+            return &ds;
+        DataSpaceDesc desc;
+        _dsm.release(desc, ds.unmapsel());
+    }
+    return nullptr;
+}
+
+void ChildManager::add_segment(size_t size, const ElfPh *ph, const DataSpace &ds) {
+    ScopedLock<UserSm> guard(&_segsm);
+    _segments.append(new SharedSegment(size, ph, ds));
+}
+
+void ChildManager::release_ds(DataSpaceDesc &desc, capsel_t sel) {
+    ScopedLock<UserSm> guard(&_segsm);
+    if(_dsm.release(desc, sel)) {
+        for(auto it = _segments.begin(); it != _segments.end(); ++it) {
+            if(it->unmapsel == sel) {
+                _segments.remove(&*it);
+                delete &*it;
+                break;
+            }
+        }
+    }
+}
+
 void ChildManager::unmap(UtcbFrameRef &uf, Child *c) {
     capsel_t sel = 0;
     DataSpaceDesc desc;
@@ -825,7 +915,7 @@ void ChildManager::unmap(UtcbFrameRef &uf, Child *c) {
     else {
         LOG(DATASPACES, "Child '" << c->cmdline() << "' destroys " << sel << ": " << desc << "\n");
         // destroy (decrease refs) the ds
-        _dsm.release(desc, sel);
+        release_ds(desc, sel);
         c->reglist().remove(sel);
     }
     uf << E_SUCCESS;
@@ -882,8 +972,8 @@ void ChildManager::Portals::pf(capsel_t pid) {
     try {
         ScopedLock<RCULock> guard(&RCU::lock());
         Child *c = cm->get_child(pid);
-        ScopedLock<UserSm> guard_switch(&cm->_switchsm);
         ScopedLock<UserSm> guard_regs(&c->_sm);
+        c->_faults++;
 
         LOG(PFS, "Child '" << c->cmdline() << "': Pagefault for " << fmt(pfaddr, "p")
                            << " @ " << fmt(eip, "p") << " on cpu " << pcpu << ", error="
@@ -942,20 +1032,15 @@ void ChildManager::Portals::pf(capsel_t pid) {
 
         if(!kill && (remap || !flags)) {
             // try to map the next few pages
-            size_t pages = 32;
-            if(ds->desc().flags() & DataSpaceDesc::BIGPAGES) {
-                // try to map the whole pagetable at once
-                pages = ExecEnv::PT_ENTRY_COUNT;
-                // take care that we start at the beginning (note that this assumes that it is
-                // properly aligned, which is made sure by root. otherwise we might leave the ds
-                pfpage &= ~(ExecEnv::BIG_PAGE_SIZE - 1);
-            }
+            size_t pages = ds->fault_window(pfpage);
             uintptr_t src = ds->origin(pfpage);
             CapRange cr(src >> ExecEnv::PAGE_SHIFT, pages, Crd::MEM | (perms << 2),
                         pfpage >> ExecEnv::PAGE_SHIFT);
             // ensure that it fits into the utcb
             cr.limit_to(uf.free_typed());
             cr.count(ds->page_perms(pfpage, cr.count(), perms));
+            ds->init_pages(pfpage, cr.count());
+            ds->faulted(pfpage, cr.count());
             uf.delegate(cr);
             // ensure that we have the memory (if we're a subsystem this might not be true)
             // TODO this is not sufficient, in general
@@ -1045,7 +1130,7 @@ void ChildManager::kill_child(capsel_t pid, UtcbExcFrameRef &uf, ExitType type)
             if(stack) {
                 capsel_t sel;
                 DataSpaceDesc desc = c->reglist().remove_by_addr(stack, &sel);
-                _dsm.release(desc, sel);
+                release_ds(desc, sel);
             }
             if(utcb)
                 c->reglist().remove_by_addr(utcb);
@@ -1091,7 +1176,7 @@ void ChildManager::destroy_child(capsel_t pid) {
     // (we need new portals at the same place, so that they have to be revoked first)
     RCU::gc(true);
     _child_count--;
-    notify_services();
+    notify_services(i, true);
     Sync::memory_barrier();
     _diesm.up();
 }
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <kobj/UserSm.h>
+#include <util/ScopedLock.h>
+#include <services/Network.h>
+
+/**
+ * The forwarding table of the switch, which maps MAC addresses to ports (i.e. session ids). It
+ * is direct-mapped like the CAM of a hardware switch: if two addresses collide, the last one
+ * wins and frames to the other one are flooded until it is learned again. This is correct, just
+ * slower, and lookups stay constant time.
+ * Every frame does a lookup and a learn. Both use a UserSm, which costs one atomic operation
+ * without contention and only blocks if a port thread on a different CPU uses the table at the
+ * same time. Since the source address of a port rarely changes, learn does not even take the lock
+ * if the entry is up to date.
+ */
+class MacTable {
+    typedef nre::Network::mac_type mac_type;
+
+    static const size_t SIZE    = 256;
+
+    struct Entry {
+        mac_type mac;
+        size_t port;
+        bool used;
+    };
+
+public:
+    static const size_t NO_PORT = static_cast<size_t>(-1);
+
+    explicit MacTable() : _sm(), _entries() {
+    }
+
+    /**
+     * Remembers that <mac> is reachable via <port>
+     *
+     * @param mac the source address of a frame
+     * @param port the port the frame has been received from
+     */
+    void learn(mac_type mac, size_t port) {
+        Entry &e = _entries[hash(mac)];
+        // if we race with a different learn, it's as if it happened afterwards
+        if(e.used && e.mac == mac && e.port == port)
+            return;
+        nre::ScopedLock<nre::UserSm> guard(&_sm);
+        e.mac = mac;
+        e.port = port;
+        e.used = true;
+    }
+
+    /**
+     * @param mac the destination address of a frame
+     * @return the port that <mac> is reachable by or NO_PORT if unknown
+     */
+    size_t lookup(mac_type mac) {
+        const Entry &e = _entries[hash(mac)];
+        nre::ScopedLock<nre::UserSm> guard(&_sm);
+        return e.used && e.mac == mac ? e.port : NO_PORT;
+    }
+
+    /**
+     * Removes all entries that point to <port>
+     *
+     * @param port the port that has been removed
+     */
+    void forget(size_t port) {
+        nre::ScopedLock<nre::UserSm> guard(&_sm);
+        for(size_t i = 0; i < SIZE; ++i) {
+            if(_entries[i].port == port)
+                _entries[i].used = false;
+        }
+    }
+
+private:
+    static size_t hash(mac_type mac) {
+        // the lower bytes are the most random ones for both, real and generated addresses
+        return (mac ^ (mac >> 8) ^ (mac >> 24)) & (SIZE - 1);
+    }
+
+    nre::UserSm _sm;
+    Entry _entries[SIZE];
+};
@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <kobj/Sm.h>
+#include <kobj/UserSm.h>
+#include <kobj/GlobalThread.h>
+#include <ipc/Service.h>
+#include <ipc/Producer.h>
+#include <ipc/Consumer.h>
+#include <services/Network.h>
+#include <stream/OStringStream.h>
+#include <util/ScopedLock.h>
+#include <util/ScopedPtr.h>
+#include <Logging.h>
+#include <cstring>
+
+#include "MacTable.h"
+
+using namespace nre;
+
+class NetworkService;
+
+static NetworkService *srv;
+static MacTable table;
+
+/**
+ * A port of the virtual switch. Each port has a thread that takes the frames from the transmit
+ * ring of the client and copies them directly into the receive rings of the destination ports.
+ * That is, the switch does not buffer frames on its own and never blocks on a port; if the
+ * receive ring of a port is full, the frame is dropped for this port.
+ */
+class NetworkServiceSession : public ServiceSession {
+public:
+    explicit NetworkServiceSession(Service *s, size_t id, capsel_t cap, capsel_t caps,
+                                   Pt::portal_func func)
+        : ServiceSession(s, id, cap, caps, func), _ctrlds(), _rxsm(), _txsm(), _rx(), _tx(),
+          _rxlock(), _stopped(0), _drops(), _mac(BASE_MAC | (id & 0xffff)) {
+    }
+    virtual ~NetworkServiceSession() {
+        if(_tx) {
+            // let the transmit thread finish, because it uses our members
+            _tx->stop();
+            _stopped.down();
+        }
+        delete _tx;
+        delete _rx;
+        delete _ctrlds;
+        delete _rxsm;
+        delete _txsm;
+    }
+
+    bool initialized() const {
+        return _ctrlds != 0;
+    }
+    Network::mac_type mac() const {
+        return _mac;
+    }
+
+    void init(DataSpace *ctrlds, Sm *rxsm, Sm *txsm) {
+        if(_ctrlds)
+            throw Exception(E_EXISTS, "Already initialized");
+        if(ctrlds->size() < Network::CTRLDS_SIZE)
+            VTHROW(Exception, E_ARGS_INVALID,
+                   "Control dataspace is too small (" << ctrlds->size() << ")");
+        // don't keep any of the objects before everything has been created and the transmit
+        // thread runs, because the caller destroys them if we throw
+        ScopedPtr<Producer<Network::Packet> > rx(
+            new Producer<Network::Packet>(*ctrlds, *rxsm, false, 0, Network::RING_SIZE));
+        ScopedPtr<Consumer<Network::Packet> > tx(
+            new Consumer<Network::Packet>(*ctrlds, *txsm, false, Network::RING_SIZE,
+                                          Network::RING_SIZE));
+
+        // forward the frames on the CPU of the client
+        char name[32];
+        OStringStream os(name, sizeof(name));
+        os << "network-tx-" << id();
+        ScopedPtr<GlobalThread> gt(
+            GlobalThread::create(tx_thread, CPU::current().log_id(), name));
+        gt->set_tls<NetworkServiceSession*>(Thread::TLS_PARAM, this);
+        _tx = tx.get();
+        try {
+            gt->start();
+        }
+        catch(...) {
+            _tx = nullptr;
+            throw;
+        }
+        // the thread deletes itself when it's done
+        gt.release();
+        _rxsm = rxsm;
+        _txsm = txsm;
+        _rx = rx.release();
+        tx.release();
+
+        // other ports deliver frames to us as soon as _ctrlds is set
+        Sync::memory_barrier();
+        _ctrlds = ctrlds;
+        LOG(NET, "[" << id() << "] Connected with MAC " << fmt(_mac, "#0x", 12) << "\n");
+    }
+
+    /**
+     * Copies the given frame into our receive ring, if there is space left.
+     *
+     * @param frame the frame
+     * @param len the length of the frame
+     */
+    void deliver(const uint8_t *frame, size_t len) {
+        // multiple ports might send to us at the same time
+        ScopedLock<UserSm> guard(&_rxlock);
+        Network::Packet *pk = _rx->current();
+        if(!pk) {
+            if((_drops++ % 1024) == 0)
+                LOG(NET, "[" << id() << "] Receive ring full, dropped " << _drops << " frames\n");
+            return;
+        }
+        memcpy(pk->data, frame, len);
+        pk->len = len;
+        _rx->next();
+    }
+
+protected:
+    virtual void invalidate() {
+        table.forget(id());
+    }
+
+private:
+    // locally administered, unicast
+    static const Network::mac_type BASE_MAC = 0x024e52450000ULL;
+
+    void forward(const Network::Packet &pk);
+
+    static void tx_thread(void*) {
+        NetworkServiceSession *sess =
+            Thread::current()->get_tls<NetworkServiceSession*>(Thread::TLS_PARAM);
+        Consumer<Network::Packet> *cons = sess->_tx;
+        // the client does only notify us if we're sleeping. so, as long as it keeps the ring
+        // filled, frames are switched without any system calls.
+        for(size_t n; (n = cons->get_batch()) > 0; cons->next(n)) {
+            // don't hold the lock while waiting, because the sessions can't be destroyed then
+            ScopedLock<RCULock> guard(&RCU::lock());
+            for(size_t i = 0; i < n; ++i)
+                sess->forward(*cons->item(i));
+        }
+        sess->_stopped.up();
+    }
+
+    DataSpace *volatile _ctrlds;
+    Sm *_rxsm;
+    Sm *_txsm;
+    Producer<Network::Packet> *_rx;
+    Consumer<Network::Packet> *_tx;
+    UserSm _rxlock;
+    Sm _stopped;
+    size_t _drops;
+    Network::mac_type _mac;
+};
+
+class NetworkService : public Service {
+public:
+    explicit NetworkService(const char *name)
+        : Service(name, CPUSet(CPUSet::ALL), portal) {
+        // we want to accept one dataspace and two semaphores
+        for(auto it = CPU::begin(); it != CPU::end(); ++it) {
+            LocalThread *ec = get_thread(it->log_id());
+            UtcbFrameRef uf(ec->utcb());
+            uf.accept_delegates(2);
+        }
+    }
+
+private:
+    virtual ServiceSession *create_session(size_t id, capsel_t cap, capsel_t caps,
+                                           Pt::portal_func func) {
+        return new NetworkServiceSession(this, id, cap, caps, func);
+    }
+
+    PORTAL static void portal(capsel_t pid);
+};
+
+void NetworkServiceSession::forward(const Network::Packet &pk) {
+    // the client might change the frame while we're forwarding it. that doesn't hurt, as long
+    // as we read the length only once.
+    size_t len = *static_cast<const volatile size_t*>(&pk.len);
+    if(len < Network::HEADER_SIZE || len > Network::MAX_FRAME_SIZE)
+        return;
+
+    Network::mac_type src = Network::src(pk.data);
+    Network::mac_type dst = Network::dst(pk.data);
+    if(!Network::is_multicast(src))
+        table.learn(src, id());
+
+    if(!Network::is_multicast(dst)) {
+        size_t port = table.lookup(dst);
+        if(port == id())
+            return;
+        if(port != MacTable::NO_PORT) {
+            try {
+                NetworkServiceSession *sess = srv->get_session_by_id<NetworkServiceSession>(port);
+                if(sess->initialized()) {
+                    sess->deliver(pk.data, len);
+                    return;
+                }
+            }
+            catch(const ServiceException&) {
+                // the port has been removed in the meanwhile; flood it
+            }
+        }
+    }
+
+    // broadcast, multicast or unknown destination
+    typedef SessionIterator<NetworkServiceSession> sess_iterator;
+    for(sess_iterator it = srv->sessions_begin<NetworkServiceSession>();
+        it != srv->sessions_end<NetworkServiceSession>(); ++it) {
+        if(&*it != this && it->initialized())
+            it->deliver(pk.data, len);
+    }
+}
+
+void NetworkService::portal(capsel_t pid) {
+    ScopedLock<RCULock> guard(&RCU::lock());
+    NetworkServiceSession *sess = srv->get_session<NetworkServiceSession>(pid);
+    UtcbFrameRef uf;
+    try {
+        Network::Command cmd;
+        uf >> cmd;
+        switch(cmd) {
+            case Network::INIT: {
+                capsel_t ctrlsel = uf.get_delegated(0).offset();
+                capsel_t rxsmsel = uf.get_delegated(0).offset();
+                capsel_t txsmsel = uf.get_delegated(0).offset();
+                uf.finish_input();
+                // the session takes them over only if init() succeeds
+                ScopedPtr<DataSpace> ctrlds(new DataSpace(ctrlsel));
+                ScopedPtr<Sm> rxsm(new Sm(rxsmsel, false));
+                ScopedPtr<Sm> txsm(new Sm(txsmsel, false));
+                sess->init(ctrlds.get(), rxsm.get(), txsm.get());
+                ctrlds.release();
+                rxsm.release();
+                txsm.release();
+                uf.accept_delegates();
+                uf << E_SUCCESS << sess->mac();
+            }
+            break;
+        }
+    }
+    catch(const Exception &e) {
+        Syscalls::revoke(uf.delegation_window(), true);
+        uf.clear();
+        uf << e;
+    }
+}
+
+int main() {
+    srv = new NetworkService("network");
+    srv->start();
+    return 0;
+}
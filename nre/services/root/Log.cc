@@ -19,15 +19,76 @@
 #include <stream/Serial.h>
 #include <kobj/GlobalThread.h>
 #include <kobj/Sc.h>
+#include <stream/OStringStream.h>
+#include <util/ScopedLock.h>
 #include <String.h>
 
 #include "Log.h"
 
 using namespace nre;
 
+class LogSessionData : public ServiceSession {
+public:
+    explicit LogSessionData(Service *s, size_t id, capsel_t cap, capsel_t caps, Pt::portal_func func,
+                            Sm &notify)
+        : ServiceSession(s, id, cap, caps, func),
+          _ds(LogSession::RING_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW),
+          _cons(_ds, notify, true, LogSession::RING_OFFSET), _reported(0) {
+        header()->dropped = 0;
+    }
+
+    virtual void invalidate() {
+        // print the lines that the client has written before it died
+        Log::get().flush(this);
+    }
+
+    const DataSpace &ds() const {
+        return _ds;
+    }
+    Consumer<LogSession::Line> &cons() {
+        return _cons;
+    }
+    LogSession::Header *header() {
+        return reinterpret_cast<LogSession::Header*>(_ds.virt());
+    }
+    word_t &reported() {
+        return _reported;
+    }
+
+private:
+    DataSpace _ds;
+    Consumer<LogSession::Line> _cons;
+    word_t _reported;
+};
+
+class LogService : public Service {
+public:
+    typedef SessionIterator<LogSessionData> iterator;
+
+    explicit LogService(const char *name, Pt::portal_func func, Sm &notify)
+        : Service(name, CPUSet(CPUSet::ALL), func), _notify(notify) {
+    }
+
+    iterator sessions_begin() {
+        return Service::sessions_begin<LogSessionData>();
+    }
+    iterator sessions_end() {
+        return Service::sessions_end<LogSessionData>();
+    }
+
+private:
+    virtual ServiceSession *create_session(size_t id, capsel_t cap, capsel_t caps,
+                                           Pt::portal_func func) {
+        return new LogSessionData(this, id, cap, caps, func, _notify);
+    }
+
+    Sm &_notify;
+};
+
+static LogService *srv;
+
 BufferedLog BufferedLog::_inst INIT_PRIO_SERIAL;
 Log Log::_inst INIT_PRIO_SERIAL;
-Service *Log::_srv;
 const char *Log::_colors[] = {
     "31", "32", "33", "34", "35", "36"
 };
@@ -36,7 +97,8 @@ BufferedLog::BufferedLog() : BaseSerial(), _bufpos(0), _buf() {
     BaseSerial::_inst = this;
 }
 
-Log::Log() : BaseSerial(), _ports(PORT_BASE, 6), _sm(1), _ready(true) {
+Log::Log()
+    : BaseSerial(), _ports(PORT_BASE, 6), _sm(1), _drainsm(1), _outsm(1), _notify(), _ready(true) {
     _ports.out<uint8_t>(0x80, LCR);          // Enable DLAB (set baud rate divisor)
     _ports.out<uint8_t>(0x01, DLR_LO);       // Set divisor to 1 (lo byte) 115200 baud
     _ports.out<uint8_t>(0x00, DLR_HI);       //                  (hi byte)
@@ -47,8 +109,10 @@ Log::Log() : BaseSerial(), _ports(PORT_BASE, 6), _sm(1), _ready(true) {
 }
 
 void Log::start() {
-    _srv = new Service("log", CPUSet(CPUSet::ALL), portal);
-    _srv->start();
+    _notify = new Sm(0);
+    srv = new LogService("log", portal, *_notify);
+    GlobalThread::create(drain_thread, CPU::current().log_id(), "root-log-drain")->start();
+    srv->start();
 }
 
 void Log::write(uint sessid, const char *line, size_t len) {
@@ -62,17 +126,134 @@ void Log::write(uint sessid, const char *line, size_t len) {
     *this << "\e[0m\n";
 }
 
+void Log::write_batch(const Batch &batch) {
+    for(size_t i = 0; i < batch.count; ++i)
+        write(batch.lines[i].sessid, batch.lines[i].text, batch.lines[i].len);
+    _outsm.up();
+}
+
+void Log::add_line(Batch &batch, uint sessid, const char *line, size_t len) {
+    Batch::Entry &e = batch.lines[batch.count++];
+    e.sessid = sessid;
+    e.len = Math::min(len, sizeof(e.text));
+    memcpy(e.text, line, e.len);
+}
+
+void Log::copy_line(LogSessionData *sess, const LogSession::Line *line, Batch &batch) {
+    // copy it out of the ring to prevent the client from changing it while we use it
+    size_t len = line->len;
+
+    word_t dropped = sess->header()->dropped;
+    if(EXPECT_FALSE(dropped != sess->reported())) {
+        char msg[64];
+        OStringStream os(msg, sizeof(msg));
+        os << "*** dropped " << (dropped - sess->reported()) << " lines ***";
+        add_line(batch, sess->id() + 1, msg, os.length());
+        sess->reported() = dropped;
+    }
+    add_line(batch, sess->id() + 1, line->text, len);
+}
+
+bool Log::drain_one(Batch &batch) {
+    // a line might need two entries, because of the dropped-message
+    if(batch.count + 2 > Batch::MAX)
+        return false;
+
+    // take the oldest line of all rings
+    LogSessionData *oldest = nullptr;
+    timevalue_t oldest_tsc = 0;
+    for(auto it = srv->sessions_begin(); it != srv->sessions_end(); ++it) {
+        if(it->cons().available() > 0) {
+            timevalue_t tsc = it->cons().item(0)->tsc;
+            if(!oldest || tsc < oldest_tsc) {
+                oldest = &*it;
+                oldest_tsc = tsc;
+            }
+        }
+    }
+    if(!oldest)
+        return false;
+
+    copy_line(oldest, oldest->cons().item(0), batch);
+    oldest->cons().next();
+    return true;
+}
+
+void Log::flush(LogSessionData *sess) {
+    Batch batch;
+    do {
+        batch.count = 0;
+        {
+            ScopedLock<UserSm> guard(&_drainsm);
+            for(; batch.count + 2 <= Batch::MAX && sess->cons().available() > 0;
+                sess->cons().next())
+                copy_line(sess, sess->cons().item(0), batch);
+            _outsm.down();
+        }
+        write_batch(batch);
+    }
+    while(batch.count > 0);
+}
+
+void Log::drain_thread(void*) {
+    Log &log = Log::get();
+    static Batch batch;
+    while(1) {
+        batch.count = 0;
+        bool avail = false;
+        {
+            ScopedLock<RCULock> guard(&RCU::lock());
+            ScopedLock<UserSm> drainguard(&log._drainsm);
+            while(log.drain_one(batch))
+                ;
+
+            if(batch.count > 0)
+                log._outsm.down();
+            else {
+                // tell all clients that we want to be notified. if one of them has written
+                // something in the meantime, we don't block
+                for(auto it = srv->sessions_begin(); it != srv->sessions_end(); ++it)
+                    avail |= it->cons().prepare_wait();
+            }
+        }
+
+        if(batch.count > 0)
+            log.write_batch(batch);
+        else if(!avail)
+            log._notify->zero();
+    }
+}
+
 void Log::portal(capsel_t pid) {
     ScopedLock<RCULock> guard(&RCU::lock());
-    ServiceSession *sess = _srv->get_session<ServiceSession>(pid);
+    LogSessionData *sess = srv->get_session<LogSessionData>(pid);
     UtcbFrameRef uf;
     try {
-        String line;
-        uf >> line;
-        uf.finish_input();
+        LogSession::Command cmd;
+        uf >> cmd;
+
+        switch(cmd) {
+            case LogSession::WRITE: {
+                String line;
+                uf >> line;
+                uf.finish_input();
+
+                Log::get().write(sess->id() + 1, line.str(), line.length());
+                uf << E_SUCCESS;
+            }
+            break;
+
+            case LogSession::GET_RING:
+                uf.finish_input();
 
-        Log::get().write(sess->id() + 1, line.str(), line.length());
-        uf << E_SUCCESS;
+                uf.delegate(sess->ds().sel(), 0);
+                // the semaphore is shared by all clients, so that they may only up it. otherwise,
+                // one client could steal the wakeups of the drain thread by downing it
+                uf.delegate(Log::get()._notify->sel(), 1, UtcbFrame::NONE,
+                            Crd::OBJ_ALL & ~Crd::SM_DN);
+                uf << E_SUCCESS;
+                break;
+        }
     }
     catch(const Exception &e) {
         uf.clear();
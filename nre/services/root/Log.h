@@ -18,17 +18,22 @@
 
 #include <ipc/Service.h>
 #include <stream/Serial.h>
+#include <services/Log.h>
 #include <kobj/Ports.h>
 #include <kobj/Sm.h>
 
 class BufferedLog;
+class LogSessionData;
 
 /**
  * The log implementation that provides a service for child tasks that allows them to print lines
- * to the serial line.
+ * to the serial line. Each session gets a ring-buffer to which the client appends its lines. A
+ * drain thread merges the lines of all rings by their timestamp and writes them to the serial
+ * line, so that the clients never wait for the serial line.
  */
 class Log : public nre::BaseSerial {
     friend class BufferedLog;
+    friend class LogSessionData;
 
     enum {
         COM1    = 0x3F8,
@@ -48,6 +53,23 @@ class Log : public nre::BaseSerial {
     static const uint PORT_BASE     = COM1;
     static const uint ROOT_SESS     = 0;
 
+    /**
+     * The lines that are taken out of the rings at once and written to the serial line afterwards,
+     * so that we hold neither the RCU lock nor the drain lock while waiting for the serial line
+     */
+    struct Batch {
+        static const size_t MAX = 8;
+
+        struct Entry {
+            uint sessid;
+            size_t len;
+            char text[nre::LogSession::MAX_LINE_LEN];
+        };
+
+        size_t count;
+        Entry lines[MAX];
+    };
+
 public:
     /**
      * @return the instance
@@ -64,6 +86,11 @@ private:
     explicit Log();
 
     void write(uint sessid, const char *line, size_t len);
+    void write_batch(const Batch &batch);
+    static void add_line(Batch &batch, uint sessid, const char *line, size_t len);
+    void copy_line(LogSessionData *sess, const nre::LogSession::Line *line, Batch &batch);
+    bool drain_one(Batch &batch);
+    void flush(LogSessionData *sess);
 
     virtual void write(char c) {
         if(c == '\0')
@@ -76,20 +103,26 @@ private:
         _ports.out<uint8_t>(c, 0);
     }
 
-    // note that we use a portal here instead of shared-memory because dataspace sharing doesn't
-    // work with services living in root. the problem is the translation of caps. the translation
-    // stops as soon as the destination Pd is reached. since stuff in root walks to the
-    // directly to the root-ds-manager and bypasses the childmanager, we receive the cap that is
-    // actually meant for the childmanager in the root-ds-manager. thus, we don't find the dataspace.
-    // to prevent the whole problem, we use a portal which works fine in this case, since its
-    // not performance critical anyway. so, sending a long string doesn't really hurt.
+    // note that the ring-buffer dataspaces are created by us and delegated to the client, not
+    // vice versa, because dataspace sharing in the other direction doesn't work with services
+    // living in root. the problem is the translation of caps. the translation stops as soon as the
+    // destination Pd is reached. since stuff in root walks to the directly to the root-ds-manager
+    // and bypasses the childmanager, we receive the cap that is actually meant for the
+    // childmanager in the root-ds-manager. thus, we don't find the dataspace.
     PORTAL static void portal(capsel_t pid);
+    NORETURN static void drain_thread(void*);
 
     nre::Ports _ports;
     nre::UserSm _sm;
+    // serializes the consumption of the ring-buffers
+    nre::UserSm _drainsm;
+    // is acquired before _drainsm is released and held while writing the consumed lines, so that
+    // they appear in the order they have been taken out of the ring-buffers
+    nre::UserSm _outsm;
+    // is signaled by the clients if the drain thread waits for lines
+    nre::Sm *_notify;
     bool _ready;
     static Log _inst;
-    static nre::Service *_srv;
     static const char *_colors[];
 };
 
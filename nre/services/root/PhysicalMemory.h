@@ -56,15 +56,15 @@ class PhysicalMemory {
         }
 
         uintptr_t alloc_safe(size_t size) {
-            for(auto it = _regs.begin(); it != _regs.end(); ++it) {
-                // it has to be > because we can't free the region here
-                if(it->size > size) {
-                    it->addr += size;
-                    it->size -= size;
-                    return it->addr - size;
-                }
+            // it has to be bigger because we can't free the region here
+            MemRegion *r = get(size + 1, 1);
+            if(!r) {
+                VTHROW(RegionManagerException, E_CAPACITY,
+                       "Unable to allocate " << size << " bytes");
             }
-            VTHROW(RegionManagerException, E_CAPACITY, "Unable to allocate " << size << " bytes");
+            uintptr_t addr = r->addr;
+            resize(r, r->addr + size, r->size - size);
+            return addr;
         }
 
         friend nre::OStream &operator<<(nre::OStream &os, const MemRegManager &rm) {
@@ -117,7 +117,8 @@ void SysInfoService::portal(capsel_t) {
                         threads = c->scs().length() + 1;
                         c->reglist().memusage(virt, phys);
 
-                        uf << E_SUCCESS << true << c->cmdline() << virt << phys << threads;
+                        uf << E_SUCCESS << true << c->cmdline() << virt << phys << threads
+                           << c->faults();
                     }
                     else
                         uf << E_SUCCESS << false;
@@ -125,7 +126,9 @@ void SysInfoService::portal(capsel_t) {
                 // idx 0 is root
                 else {
                     const char *cmdline = srv->get_root_info(virt, phys, threads);
-                    uf << E_SUCCESS << true << String(cmdline) << virt << phys << threads;
+                    // root has no pager
+                    uf << E_SUCCESS << true << String(cmdline) << virt << phys << threads
+                       << static_cast<size_t>(0);
                 }
             }
             break;
@@ -21,6 +21,7 @@
 #include <subsystem/ChildHip.h>
 #include <ipc/Service.h>
 #include <collection/Cycler.h>
+#include <collection/SList.h>
 #include <util/Math.h>
 #include <util/Bytes.h>
 #include <String.h>
@@ -269,23 +270,76 @@ static void sysinfo_thread(void*) {
     sysinfo->start();
 }
 
+/**
+ * A module that root should start
+ */
+struct BootModule : public SListItem {
+    explicit BootModule(size_t no, const HipMem &mem, cpu_t cpu)
+        : SListItem(), cfg(no, mem.cmdline(), cpu), virt(), size(mem.size), started(false) {
+        // map the memory of the module
+        virt = VirtualMemory::alloc(mem.size);
+        Hypervisor::map_mem(mem.addr, virt, mem.size);
+    }
+
+    ChildConfig cfg;
+    uintptr_t virt;
+    size_t size;
+    bool started;
+};
+
+static bool can_start(const SList<BootModule> &mods, const BootModule &m) {
+    if(m.cfg.requirements() > 0) {
+        for(size_t i = 0; i < m.cfg.requirements(); ++i) {
+            if(!mng->has_service(m.cfg.requirement(i)))
+                return false;
+        }
+        return true;
+    }
+
+    // without explicit requirements, we need all services of the modules in front of it
+    for(auto it = mods.cbegin(); &*it != &m; ++it) {
+        for(size_t i = 0; i < it->cfg.waits(); ++i) {
+            if(!mng->has_service(it->cfg.wait(i)))
+                return false;
+        }
+    }
+    return true;
+}
+
 static void start_childs() {
     size_t mod = 0, i = 0;
     ForwardCycler<CPU::iterator> cpus(CPU::begin(), CPU::end());
     const Hip &hip = Hip::get();
+    SList<BootModule> mods;
     for(auto it = hip.mem_begin(); it != hip.mem_end(); ++it, ++mod) {
         // we are the first one :)
         if(it->type == HipMem::MB_MODULE && i++ >= 1) {
-            // map the memory of the module
-            uintptr_t virt = VirtualMemory::alloc(it->size);
-            Hypervisor::map_mem(it->addr, virt, it->size);
-
-            ChildConfig cfg(mod, it->cmdline(), cpus.next()->log_id());
-            mng->load(virt, it->size, cfg);
-            if(cfg.last())
+            BootModule *m = new BootModule(mod, *it, cpus.next()->log_id());
+            mods.append(m);
+            if(m->cfg.last())
                 break;
         }
     }
+
+    // start all modules as soon as the services they require are available. thus, independent
+    // modules are initialized in parallel
+    for(size_t left = mods.length(); left > 0; ) {
+        for(auto it = mods.begin(); it != mods.end(); ++it) {
+            if(!it->started && can_start(mods, *it)) {
+                // the module stays mapped, so that the segments can be loaded on demand
+                mng->start(it->virt, it->size, it->cfg, true);
+                it->started = true;
+                left--;
+            }
+        }
+        if(left > 0)
+            mng->wait_for_service();
+    }
+
+    for(auto it = mods.begin(); it != mods.end(); ) {
+        auto old = it++;
+        delete &*old;
+    }
 }
 
 static void portal_service(capsel_t) {
@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <kobj/GlobalThread.h>
+#include <stream/OStringStream.h>
+#include <util/ScopedLock.h>
+#include <Logging.h>
+#include <CPU.h>
+
+#include "BlockCache.h"
+
+using namespace nre;
+
+BlockCache::BlockCache(size_t blocks)
+    : _sm(), _data(blocks * BLOCK_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW),
+      _count(blocks), _used(0), _hand(0), _blocks(new Block[blocks]), _tree(), _hits(0), _misses(0),
+      _queues() {
+}
+
+BlockCache::~BlockCache() {
+    for(size_t i = 0; i < MAX_QUEUES; ++i) {
+        if(_queues[i])
+            _queues[i]->cons.stop();
+    }
+    delete[] _blocks;
+}
+
+void BlockCache::read(Controller *ctrl, size_t drive, producer_type *prod, tag_type tag,
+                      const DataSpace &ds, sector_type sector, const dma_type &dma) {
+    size_t count = dma.bytecount() / BLOCK_SIZE;
+    // larger reads are never put into the cache, so that we don't serve them from it either
+    Block *blocks[BOUNCE_SIZE / BLOCK_SIZE];
+    bool hit = false;
+    {
+        ScopedLock<UserSm> guard(&_sm);
+        if(count <= ARRAY_SIZE(blocks)) {
+            size_t i;
+            for(i = 0; i < count; ++i) {
+                blocks[i] = _tree.find(key(drive, sector + i));
+                if(!blocks[i])
+                    break;
+            }
+            hit = i == count;
+        }
+
+        if(hit) {
+            _hits++;
+            for(size_t i = 0; i < count; ++i) {
+                blocks[i]->referenced = true;
+                blocks[i]->pins++;
+            }
+        }
+        else
+            _misses++;
+    }
+
+    if(hit) {
+        // concurrent hits should not serialize on the copy. the pinned blocks keep their content
+        // even if they are invalidated in the meanwhile.
+        size_t i;
+        for(i = 0; i < count; ++i) {
+            uintptr_t src = _data.virt() + (blocks[i] - _blocks) * BLOCK_SIZE;
+            if(dma.out(reinterpret_cast<void*>(src), BLOCK_SIZE, i * BLOCK_SIZE, ds))
+                break;
+        }
+        {
+            ScopedLock<UserSm> guard(&_sm);
+            for(size_t j = 0; j < count; ++j)
+                blocks[j]->pins--;
+        }
+        if(i < count)
+            VTHROW(Exception, E_ARGS_INVALID, "Unable to copy sector " << (sector + i));
+
+        LOG(STORAGE_DETAIL, "[" << fmt(tag, "#x") << "] Cache hit for " << sector
+                                << ".." << (sector + count - 1) << "\n");
+        prod->produce(Storage::Packet(tag, 0));
+        return;
+    }
+    submit(ctrl, Storage::READ, drive, prod, tag, &ds, sector, &dma);
+}
+
+void BlockCache::write(Controller *ctrl, size_t drive, producer_type *prod, tag_type tag,
+                       const DataSpace &ds, sector_type sector, const dma_type &dma) {
+    submit(ctrl, Storage::WRITE, drive, prod, tag, &ds, sector, &dma);
+}
+
+void BlockCache::flush(Controller *ctrl, size_t drive, producer_type *prod, tag_type tag) {
+    submit(ctrl, Storage::FLUSH, drive, prod, tag, nullptr, 0, nullptr);
+}
+
+void BlockCache::forget(producer_type *prod) {
+    ScopedLock<UserSm> guard(&_sm);
+    for(size_t i = 0; i < MAX_QUEUES; ++i) {
+        Queue *q = _queues[i];
+        for(size_t j = 0; q && j < q->depth; ++j) {
+            if(q->pending[j].used && q->pending[j].prod == prod) {
+                q->pending[j].prod = nullptr;
+                q->pending[j].ds = nullptr;
+            }
+        }
+    }
+}
+
+void BlockCache::get_stats(Storage::CacheStats *stats) {
+    ScopedLock<UserSm> guard(&_sm);
+    stats->blocks = _count;
+    stats->used = _used;
+    stats->block_size = BLOCK_SIZE;
+    stats->hits = _hits;
+    stats->misses = _misses;
+}
+
+void BlockCache::submit(Controller *ctrl, Storage::Command cmd, size_t drive, producer_type *prod,
+                        tag_type tag, const DataSpace *ds, sector_type sector, const dma_type *dma) {
+    Queue *q;
+    {
+        ScopedLock<UserSm> guard(&_sm);
+        q = get_queue(ctrl, drive);
+    }
+
+    // wait until there is a free slot
+    q->free.down();
+
+    size_t idx;
+    dma_type bouncedma;
+    {
+        ScopedLock<UserSm> guard(&_sm);
+        for(idx = 0; idx < q->depth; ++idx) {
+            if(!q->pending[idx].used)
+                break;
+        }
+        assert(idx < q->depth);
+
+        Pending &p = q->pending[idx];
+        p.used = true;
+        p.cmd = cmd;
+        p.sector = sector;
+        p.count = dma ? dma->bytecount() / BLOCK_SIZE : 0;
+        p.prod = prod;
+        p.tag = tag;
+        p.ds = ds;
+        p.populate = false;
+        p.bounce = false;
+        if(dma)
+            p.dma = *dma;
+        else
+            p.dma.clear();
+
+        if(cmd == Storage::WRITE) {
+            // the blocks are outdated now. additionally, reads that are still in flight might
+            // deliver the old content, so that we shouldn't cache it
+            invalidate(q, sector, p.count);
+            q->pending_writes++;
+        }
+        else if(cmd == Storage::READ && p.count * BLOCK_SIZE <= BOUNCE_SIZE) {
+            // if a write to these sectors is in flight, we don't know what we get
+            p.populate = !overlaps_write(q, sector, p.count);
+            p.bounce = true;
+            bouncedma.push(DMADesc(idx * BOUNCE_SIZE, p.count * BLOCK_SIZE));
+        }
+    }
+
+    try {
+        switch(cmd) {
+            case Storage::READ:
+                if(!bouncedma.count())
+                    ctrl->read(drive, &q->prod, idx, *ds, sector, *dma);
+                else
+                    ctrl->read(drive, &q->prod, idx, q->bounce, sector, bouncedma);
+                break;
+            case Storage::WRITE:
+                ctrl->write(drive, &q->prod, idx, *ds, sector, *dma);
+                break;
+            default:
+                ctrl->flush(drive, &q->prod, idx);
+                break;
+        }
+    }
+    catch(...) {
+        {
+            ScopedLock<UserSm> guard(&_sm);
+            if(cmd == Storage::WRITE)
+                q->pending_writes--;
+            q->pending[idx].used = false;
+        }
+        q->free.up();
+        throw;
+    }
+}
+
+bool BlockCache::overlaps_write(const Queue *q, sector_type sector, size_t count) const {
+    if(q->pending_writes == 0)
+        return false;
+    for(size_t i = 0; i < q->depth; ++i) {
+        const Pending &p = q->pending[i];
+        if(p.used && p.cmd == Storage::WRITE &&
+           sector < p.sector + p.count && p.sector < sector + count)
+            return true;
+    }
+    return false;
+}
+
+void BlockCache::invalidate(Queue *q, sector_type sector, size_t count) {
+    for(size_t i = 0; i < count; ++i) {
+        Block *b = _tree.find(key(q->drive, sector + i));
+        if(b) {
+            _tree.remove(b);
+            b->valid = false;
+            _used--;
+        }
+    }
+
+    for(size_t i = 0; i < q->depth; ++i) {
+        Pending &p = q->pending[i];
+        if(p.used && p.cmd == Storage::READ &&
+           sector < p.sector + p.count && p.sector < sector + count)
+            p.populate = false;
+    }
+}
+
+BlockCache::Block *BlockCache::alloc_block() {
+    // CLOCK: take the first block that is unused or hasn't been referenced since the last round.
+    // after two rounds, all blocks are pinned, so that we can't cache anything at the moment.
+    for(size_t i = 0; i < _count * 2; ++i) {
+        Block *b = _blocks + _hand;
+        _hand = (_hand + 1) % _count;
+        // a hit is still copying it
+        if(b->pins)
+            continue;
+        if(!b->valid)
+            return b;
+        if(!b->referenced) {
+            _tree.remove(b);
+            b->valid = false;
+            _used--;
+            return b;
+        }
+        b->referenced = false;
+    }
+    return nullptr;
+}
+
+void BlockCache::populate(const Queue *q, size_t idx) {
+    const Pending &p = q->pending[idx];
+    const char *src = q->bounce_buffer(idx);
+    for(size_t i = 0; i < p.count; ++i) {
+        uint64_t k = key(q->drive, p.sector + i);
+        Block *b = _tree.find(k);
+        if(b) {
+            // it's up to date, because writes remove the blocks. don't touch it, because a hit
+            // might copy it at the moment.
+            b->referenced = true;
+            continue;
+        }
+        b = alloc_block();
+        if(!b)
+            break;
+        b->key(k);
+        b->valid = true;
+        _tree.insert(b);
+        _used++;
+        b->referenced = true;
+        memcpy(reinterpret_cast<void*>(_data.virt() + (b - _blocks) * BLOCK_SIZE),
+               src + i * BLOCK_SIZE, BLOCK_SIZE);
+    }
+}
+
+BlockCache::Queue *BlockCache::get_queue(Controller *ctrl, size_t drive) {
+    assert(drive < MAX_QUEUES);
+    if(!_queues[drive]) {
+        Storage::Parameter params;
+        ctrl->get_params(drive, &params);
+        Queue *q = new Queue(this, drive, Math::max<size_t>(params.max_requests, 1));
+        char name[32];
+        OStringStream os(name, sizeof(name));
+        os << "storage-cache-" << drive;
+        GlobalThread *gt = GlobalThread::create(completion_thread, CPU::current().log_id(), name);
+        gt->set_tls<Queue*>(Thread::TLS_PARAM, q);
+        gt->start();
+        _queues[drive] = q;
+    }
+    return _queues[drive];
+}
+
+void BlockCache::complete(Queue *q, tag_type tag, uint status) {
+    {
+        ScopedLock<UserSm> guard(&_sm);
+        Pending &p = q->pending[tag];
+        assert(p.used);
+        if(p.cmd == Storage::WRITE)
+            q->pending_writes--;
+        else if(p.bounce && status == 0) {
+            if(p.populate)
+                populate(q, tag);
+            // the DMA list has not been used by the controller, so check it now
+            if(p.ds && p.dma.out(q->bounce_buffer(tag), p.count * BLOCK_SIZE, 0, *p.ds))
+                status = E_ARGS_INVALID;
+        }
+
+        if(p.prod)
+            p.prod->produce(Storage::Packet(p.tag, status));
+        p.used = false;
+    }
+    q->free.up();
+}
+
+void BlockCache::completion_thread(void*) {
+    Queue *q = Thread::current()->get_tls<Queue*>(Thread::TLS_PARAM);
+    for(size_t n; (n = q->cons.get_batch()) > 0; q->cons.next(n)) {
+        for(size_t i = 0; i < n; ++i)
+            q->cache->complete(q, q->cons.item(i)->tag, q->cons.item(i)->status);
+    }
+}
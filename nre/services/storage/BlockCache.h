@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <kobj/Sm.h>
+#include <kobj/UserSm.h>
+#include <mem/DataSpace.h>
+#include <ipc/Consumer.h>
+#include <collection/Treap.h>
+#include <services/Storage.h>
+
+#include "Controller.h"
+
+/**
+ * A block cache that is shared by all sessions. It caches sectors of drives with a sector size
+ * of BLOCK_SIZE, keyed by drive and sector, and uses the CLOCK algorithm to evict blocks. Writes
+ * are passed through to the controller (write-through) and invalidate the cached blocks, so
+ * that FLUSH keeps its meaning.
+ *
+ * Hits are served by copying the blocks into the dataspace of the session. The blocks are pinned
+ * during that time, so that the copy can be done without holding the lock. Misses, writes and
+ * flushes are passed to the controller with an internal completion ring per drive. The
+ * completions are received by a thread per drive that fills the cache with the read data and
+ * forwards the completion to the session afterwards.
+ *
+ * Misses are read into a bounce buffer of the cache and copied to the session from there. The
+ * dataspace of the session is writable by the client, so that we can't take the data for the
+ * cache from it. Reads that are larger than the bounce buffer slot go directly to the session
+ * and are not cached.
+ */
+class BlockCache {
+    typedef nre::Storage::sector_type sector_type;
+    typedef nre::Storage::tag_type tag_type;
+    typedef Completions producer_type;
+    typedef nre::Storage::dma_type dma_type;
+
+    static const size_t MAX_QUEUES      = nre::Storage::MAX_CONTROLLER * nre::Storage::MAX_DRIVES;
+    // the size of the bounce buffer per pending request
+    static const size_t BOUNCE_SIZE     = 64 * 1024;
+
+    /**
+     * A cached block, indexed by drive and sector
+     */
+    class Block : public nre::TreapNode<uint64_t> {
+    public:
+        explicit Block() : nre::TreapNode<uint64_t>(0), valid(false), referenced(false), pins(0) {
+        }
+
+        bool valid;
+        bool referenced;
+        // the number of hits that are currently copying the block; it is not reused till then
+        size_t pins;
+    };
+
+    /**
+     * A request that has been passed to the controller and is not finished yet
+     */
+    struct Pending {
+        bool used;
+        nre::Storage::Command cmd;
+        // whether the cache should be filled with the read data
+        bool populate;
+        // whether the data is read into the bounce buffer
+        bool bounce;
+        sector_type sector;
+        size_t count;
+        producer_type *prod;
+        tag_type tag;
+        const nre::DataSpace *ds;
+        dma_type dma;
+    };
+
+    /**
+     * The pending requests and the completion ring for one drive. There are as many pending
+     * slots as the drive can handle at once, each with its own part of the bounce buffer.
+     */
+    struct Queue {
+        explicit Queue(BlockCache *cache, size_t drive, size_t depth)
+            : cache(cache), drive(drive), depth(depth), free(depth), pending(new Pending[depth]()),
+              pending_writes(0),
+              ds(nre::ExecEnv::PAGE_SIZE, nre::DataSpaceDesc::ANONYMOUS, nre::DataSpaceDesc::RW),
+              sm(0), prod(ds, sm, true), cons(ds, sm, false),
+              bounce(depth * BOUNCE_SIZE, nre::DataSpaceDesc::ANONYMOUS, nre::DataSpaceDesc::RW) {
+        }
+        ~Queue() {
+            delete[] pending;
+        }
+
+        char *bounce_buffer(size_t idx) const {
+            return reinterpret_cast<char*>(bounce.virt() + idx * BOUNCE_SIZE);
+        }
+
+        BlockCache *cache;
+        size_t drive;
+        size_t depth;
+        // counts the free pending slots
+        nre::UserSm free;
+        Pending *pending;
+        size_t pending_writes;
+        nre::DataSpace ds;
+        nre::Sm sm;
+        producer_type prod;
+        nre::Consumer<nre::Storage::Packet> cons;
+        nre::DataSpace bounce;
+
+    private:
+        Queue(const Queue&);
+        Queue& operator=(const Queue&);
+    };
+
+public:
+    static const size_t BLOCK_SIZE      = 512;
+
+    /**
+     * Creates a cache with <blocks> blocks
+     *
+     * @param blocks the number of blocks
+     */
+    explicit BlockCache(size_t blocks);
+    ~BlockCache();
+
+    /**
+     * @param params the parameters of the drive
+     * @return true if the given drive can be cached
+     */
+    static bool cachable(const nre::Storage::Parameter &params) {
+        return params.sector_size == BLOCK_SIZE;
+    }
+
+    /**
+     * Reads the sectors from cache, if all of them are present. Otherwise, the request is
+     * passed to <ctrl>. The arguments are the same as for Controller::read.
+     */
+    void read(Controller *ctrl, size_t drive, producer_type *prod, tag_type tag,
+              const nre::DataSpace &ds, sector_type sector, const dma_type &dma);
+    /**
+     * Invalidates the sectors in the cache and passes the request to <ctrl>. The arguments are
+     * the same as for Controller::write.
+     */
+    void write(Controller *ctrl, size_t drive, producer_type *prod, tag_type tag,
+               const nre::DataSpace &ds, sector_type sector, const dma_type &dma);
+    /**
+     * Passes the flush to <ctrl>. The arguments are the same as for Controller::flush.
+     */
+    void flush(Controller *ctrl, size_t drive, producer_type *prod, tag_type tag);
+
+    /**
+     * Forgets all pending requests of the given producer, i.e. the completions are not forwarded
+     * and the read data is not put into the cache. This has to be done before the producer
+     * and the data dataspace of the corresponding session are destroyed.
+     *
+     * @param prod the producer
+     */
+    void forget(producer_type *prod);
+
+    /**
+     * Stores the statistics into <stats>
+     */
+    void get_stats(nre::Storage::CacheStats *stats);
+
+private:
+    static uint64_t key(size_t drive, sector_type sector) {
+        return (static_cast<uint64_t>(drive) << 48) | sector;
+    }
+
+    void submit(Controller *ctrl, nre::Storage::Command cmd, size_t drive, producer_type *prod,
+                tag_type tag, const nre::DataSpace *ds, sector_type sector, const dma_type *dma);
+    bool overlaps_write(const Queue *q, sector_type sector, size_t count) const;
+    void invalidate(Queue *q, sector_type sector, size_t count);
+    void populate(const Queue *q, size_t idx);
+    Block *alloc_block();
+    Queue *get_queue(Controller *ctrl, size_t drive);
+    void complete(Queue *q, tag_type tag, uint status);
+    static void completion_thread(void*);
+
+    BlockCache(const BlockCache&);
+    BlockCache& operator=(const BlockCache&);
+
+    nre::UserSm _sm;
+    nre::DataSpace _data;
+    size_t _count;
+    size_t _used;
+    size_t _hand;
+    Block *_blocks;
+    nre::Treap<Block> _tree;
+    uint64_t _hits;
+    uint64_t _misses;
+    Queue *_queues[MAX_QUEUES];
+};
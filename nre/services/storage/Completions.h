@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <kobj/Sm.h>
+#include <kobj/UserSm.h>
+#include <mem/DataSpace.h>
+#include <ipc/Producer.h>
+#include <services/Storage.h>
+#include <util/ScopedLock.h>
+
+/**
+ * The producer for a completion ring. The completions of one session are produced by different
+ * threads (e.g. the interrupt thread of the controller and the submission thread of the session),
+ * so that this class serializes them.
+ * To never lose a completion, a slot is reserved for each request before it is started, so that
+ * the completion, no matter whether it reports success or an error, can always be produced
+ * without blocking.
+ */
+class Completions {
+public:
+    /**
+     * Creates the producer. The arguments are the same as for nre::Producer.
+     */
+    explicit Completions(nre::DataSpace &ds, nre::Sm &sm, bool init = true, size_t offset = 0,
+                         size_t size = 0)
+        : _lock(), _reserved(0), _prod(ds, sm, init, offset, size) {
+    }
+
+    /**
+     * Reserves a slot for the completion of a request, if there is one left.
+     *
+     * @return true if a slot has been reserved
+     */
+    bool reserve() {
+        nre::ScopedLock<nre::UserSm> guard(&_lock);
+        if(_reserved >= _prod.free())
+            return false;
+        _reserved++;
+        return true;
+    }
+
+    /**
+     * Reserves a slot for the completion of a request and blocks on <space> until there is one,
+     * if necessary (see nre::Producer::wait_free). Only one thread may wait at a time.
+     *
+     * @param space the semaphore that the consumer ups if there are free slots again
+     * @param stop if this becomes true, we stop waiting (the waiter has to up <space> as well)
+     * @return true if a slot has been reserved
+     */
+    bool reserve_wait(nre::Sm &space, const volatile bool &stop) {
+        while(!reserve()) {
+            if(stop)
+                return false;
+            try {
+                if(!_prod.prepare_wait(_reserved + 1))
+                    space.zero();
+            }
+            catch(...) {
+                // the client has revoked the semaphore
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Gives a reserved slot back, because the request did not produce a completion.
+     */
+    void cancel() {
+        nre::ScopedLock<nre::UserSm> guard(&_lock);
+        _reserved--;
+    }
+
+    /**
+     * Produces the given completion into the slot that has been reserved for the request.
+     *
+     * @param pk the completion
+     * @return true if it has been produced
+     */
+    bool produce(const nre::Storage::Packet &pk) {
+        nre::ScopedLock<nre::UserSm> guard(&_lock);
+        if(_reserved > 0)
+            _reserved--;
+        return _prod.produce(pk);
+    }
+
+private:
+    Completions(const Completions&);
+    Completions& operator=(const Completions&);
+
+    nre::UserSm _lock;
+    size_t _reserved;
+    nre::Producer<nre::Storage::Packet> _prod;
+};
@@ -17,9 +17,10 @@
 #pragma once
 
 #include <mem/DataSpace.h>
-#include <ipc/Producer.h>
 #include <services/Storage.h>
 
+#include "Completions.h"
+
 /**
  * The base class for all disk controllers
  */
@@ -27,7 +28,7 @@ class Controller {
 protected:
     typedef nre::Storage::sector_type sector_type;
     typedef nre::Storage::tag_type tag_type;
-    typedef nre::Producer<nre::Storage::Packet> producer_type;
+    typedef Completions producer_type;
     typedef nre::DMADescList<nre::Storage::MAX_DMA_DESCS> dma_type;
 
 public:
@@ -96,6 +97,15 @@ public:
     virtual void write(size_t drive, producer_type *prod, tag_type tag, const nre::DataSpace &ds,
                        sector_type sector, const dma_type &dma) = 0;
 
+    /**
+     * Forgets all requests that have been issued with the given producer. That is, queued requests
+     * are not executed anymore and no completions are produced for running ones. This is used
+     * when a session is destroyed.
+     *
+     * @param prod the producer
+     */
+    virtual void forget(producer_type *prod) = 0;
+
 protected:
     uint _id;
 };
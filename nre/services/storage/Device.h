@@ -20,6 +20,8 @@
 #include <util/Bytes.h>
 #include <Compiler.h>
 
+#include "Completions.h"
+
 // for printing debug-infos
 #define ATA_LOGDETAIL(msg)  \
     LOG(STORAGE_DETAIL, msg << "\n");
@@ -62,6 +64,8 @@ enum {
     COMMAND_PACKET              = 0xA0,
     COMMAND_FLUSH_CACHE         = 0xE7,
     COMMAND_FLUSH_CACHE_EXT     = 0xEA,
+    COMMAND_READ_FPDMA_QUEUED   = 0x60,
+    COMMAND_WRITE_FPDMA_QUEUED  = 0x61,
     COMMAND_ATAPI_RESET         = 0x8,
 };
 
@@ -141,7 +145,7 @@ class Device {
 public:
     typedef nre::Storage::sector_type sector_type;
     typedef nre::Storage::tag_type tag_type;
-    typedef nre::Producer<nre::Storage::Packet> producer_type;
+    typedef Completions producer_type;
     typedef nre::DMADescList<nre::Storage::MAX_DMA_DESCS> dma_type;
 
     enum Operation {
@@ -252,8 +256,15 @@ public:
         uint16_t : 16;
         uint16_t : 16;
         uint16_t : 16;
-        uint16_t : 16;
-        uint16_t : 16;
+        // maximum queue depth - 1
+        uint16_t queueDepth : 5,
+        : 11;
+        struct {
+            uint16_t : 8,
+            // native command queuing
+                     ncq : 1,
+            : 7;
+        } PACKED sataCapabilities;
         uint16_t : 16;
         uint16_t : 16;
         uint16_t : 16;
@@ -346,8 +357,11 @@ public:
     size_t sector_size() const {
         return _sector_size;
     }
-    size_t max_requests() const {
-        return (1 << (has_lba48() ? 16 : 8)) - 1;
+    /**
+     * @return the number of requests that can be outstanding at the same time
+     */
+    virtual size_t max_requests() const {
+        return 1;
     }
     const char *name() const {
         return _name;
@@ -383,6 +397,12 @@ protected:
     bool has_dma() const {
         return _info.capabilities.DMA;
     }
+    bool has_ncq() const {
+        return _info.sataCapabilities.ncq;
+    }
+    size_t max_sectors() const {
+        return (1 << (has_lba48() ? 16 : 8)) - 1;
+    }
 
     static void devname(char *dst, const char *str, size_t len) {
         for(size_t i = 0; i < len / 2; i++) {
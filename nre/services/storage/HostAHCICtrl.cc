@@ -23,9 +23,9 @@
 
 using namespace nre;
 
-HostAHCICtrl::HostAHCICtrl(uint id, PCI &pci, BDF bdf, Gsi *gsi, bool dmar)
-    : Controller(id), _gsi(gsi), _bdf(bdf), _regs_ds(), _regs_high_ds(), _regs(),
-      _regs_high(0), _portcount(0), _ports() {
+HostAHCICtrl::HostAHCICtrl(uint id, PCI &pci, BDF bdf, bool dmar)
+    : Controller(id), _sm(), _pci(pci), _gsi(), _msix(), _irqsms(), _bdf(bdf), _regs_ds(),
+      _regs_high_ds(), _regs(), _regs_high(0), _portcount(0), _ports() {
     assert(!(~pci.conf_read(_bdf, 1) & 6) && "we need mem-decode and busmaster dma");
     PCI::value_type bar = pci.conf_read(_bdf, 9);
     assert(!(bar & 7) && "we need a 32bit memory bar");
@@ -55,17 +55,63 @@ HostAHCICtrl::HostAHCICtrl(uint id, PCI &pci, BDF bdf, Gsi *gsi, bool dmar)
     for(uint i = 30; _regs_high && i < 32; i++)
         create_ahci_port(i, _regs_high + (i - 30), dmar);
 
+    // we can give each port its own vector, if there is a MSI-X vector for each port
+    uint32_t pi = _regs->pi;
+    _msix = pi && pci.get_msix_count(_bdf) >= Math::bit_scan_reverse(pi) + 1;
+    if(!_msix) {
+        // all ports share one interrupt
+        _gsi = pci.get_gsi(_bdf, 0);
+        LOG(STORAGE, "AHCI: using shared GSI " << _gsi->gsi() << " for all ports\n");
+    }
+    else
+        LOG(STORAGE, "AHCI: using one MSI-X vector per port\n");
+
     // clear pending irqs
     _regs->is = _regs->pi;
     // enable IRQs
     _regs->ghc |= 2;
 
-    // start the gsi thread
+    // start the gsi thread that dispatches the shared interrupt to the ports
+    if(_gsi) {
+        char name[32];
+        OStringStream os(name, sizeof(name));
+        os << "ahci-gsi-" << _gsi->gsi();
+        GlobalThread *gt = GlobalThread::create(gsi_thread, CPU::current().log_id(), name);
+        gt->set_tls<HostAHCICtrl*>(Thread::TLS_PARAM, this);
+        gt->start();
+    }
+}
+
+void HostAHCICtrl::create_irq_thread(uint port) {
+    ScopedLock<UserSm> guard(&_sm);
+    if(_irqsms[port])
+        return;
+
+    cpu_t cpu = CPU::current().log_id();
+    Sm *sm;
     char name[32];
     OStringStream os(name, sizeof(name));
-    os << "ahci-gsi-" << _gsi->gsi();
-    GlobalThread *gt = GlobalThread::create(gsi_thread, CPU::current().log_id(), name);
-    gt->set_tls<HostAHCICtrl*>(Thread::TLS_PARAM, this);
+    if(_msix) {
+        Gsi *gsi = _pci.get_gsi_msi(_bdf, port, nullptr, cpu);
+        os << "ahci-gsi-" << gsi->gsi();
+        sm = gsi;
+    }
+    else {
+        os << "ahci-port-" << port;
+        sm = new Sm(0);
+    }
+
+    // publish it to the gsi thread. if an interrupt arrives before the port thread is running,
+    // it will be handled as soon as it blocks on the semaphore.
+    Sync::memory_barrier();
+    _irqsms[port] = sm;
+
+    LOG(STORAGE, "AHCI: handling interrupts of port " << port << " on CPU " << cpu << "\n");
+    PortIrq *irq = new PortIrq();
+    irq->ctrl = this;
+    irq->port = port;
+    GlobalThread *gt = GlobalThread::create(port_thread, cpu, name);
+    gt->set_tls<PortIrq*>(Thread::TLS_PARAM, irq);
     gt->start();
 }
 
@@ -79,7 +125,8 @@ void HostAHCICtrl::create_ahci_port(uint nr, HostAHCIDevice::Register *portreg,
     if(sig != HostAHCIDevice::SATA_SIG_NONE) {
         try {
             _ports[nr] = new HostAHCIDevice(portreg, _id * Storage::MAX_DRIVES + _portcount,
-                                            ((_regs->cap >> 8) & 0x1f) + 1, dmar);
+                                            ((_regs->cap >> 8) & 0x1f) + 1,
+                                            _regs->cap & (1 << 30), dmar);
             _ports[nr]->determine_capacity();
             LOG(STORAGE, *_ports[nr] << "\n");
             _portcount++;
@@ -96,14 +143,41 @@ void HostAHCICtrl::gsi_thread(void*) {
     while(1) {
         ha->_gsi->down();
 
+        // the line is level-triggered, so that we have to acknowledge all ports that fired
+        // before we wait for the next interrupt. the port threads do only look at the command
+        // registers, so that they don't need the status.
         uint32_t is = ha->_regs->is;
-        uint32_t oldis = is;
-        while(is) {
-            uint32_t port = Math::bit_scan_forward(is);
-            if(ha->_ports[port])
+        uint32_t wake = 0;
+        for(uint32_t pending = is; pending; ) {
+            uint32_t port = Math::bit_scan_forward(pending);
+            pending &= ~(1 << port);
+            if(ha->_irqsms[port]) {
+                ha->_ports[port]->ack_irq();
+                wake |= 1 << port;
+            }
+            else if(ha->_ports[port])
                 ha->_ports[port]->irq();
-            is &= ~(1 << port);
+            else {
+                HostAHCIDevice::Register *regs = ha->port_regs(port);
+                regs->is = regs->is;
+            }
+        }
+        ha->_regs->is = is;
+
+        while(wake) {
+            uint32_t port = Math::bit_scan_forward(wake);
+            wake &= ~(1 << port);
+            ha->_irqsms[port]->up();
         }
-        ha->_regs->is = oldis;
+    }
+}
+
+void HostAHCICtrl::port_thread(void*) {
+    PortIrq *irq = Thread::current()->get_tls<PortIrq*>(Thread::TLS_PARAM);
+    HostAHCICtrl *ha = irq->ctrl;
+    while(1) {
+        ha->_irqsms[irq->port]->down();
+        ha->_ports[irq->port]->irq();
+        ha->_regs->is = 1 << irq->port;
     }
 }
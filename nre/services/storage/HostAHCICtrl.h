@@ -31,8 +31,14 @@
 /**
  * A simple driver for AHCI.
  *
+ * If the HBA has an MSI-X vector for each port, every port gets its own vector. Otherwise, all
+ * ports share one interrupt, which is dispatched to the ports by a separate thread. In both
+ * cases, the interrupts of a port are handled by a thread of the port, that is created on the
+ * CPU of the first request for that port. This way, the completions are usually produced on the
+ * CPU of the client.
+ *
  * State: testing
- * Features: Ports
+ * Features: Ports, MSI-X per port
  */
 class HostAHCICtrl : public Controller {
     /**
@@ -58,9 +64,17 @@ class HostAHCICtrl : public Controller {
         HostAHCIDevice::Register ports[32];
     };
 
+    struct PortIrq {
+        HostAHCICtrl *ctrl;
+        uint port;
+    };
+
 public:
-    explicit HostAHCICtrl(uint id, nre::PCI &pci, nre::BDF bdf, nre::Gsi *gsi, bool dmar);
+    explicit HostAHCICtrl(uint id, nre::PCI &pci, nre::BDF bdf, bool dmar);
     virtual ~HostAHCICtrl() {
+        // these are either MSI-X vectors or semaphores that the gsi thread ups
+        for(size_t i = 0; i < ARRAY_SIZE(_irqsms); ++i)
+            delete _irqsms[i];
         delete _gsi;
         delete _regs_ds;
         delete _regs_high_ds;
@@ -79,27 +93,50 @@ public:
 
     virtual void flush(size_t drive, producer_type *prod, tag_type tag) {
         assert(_ports[idx(drive)]);
+        attach_irq(idx(drive));
         _ports[idx(drive)]->flush(prod, tag);
     }
     virtual void read(size_t drive, producer_type *prod, tag_type tag, const nre::DataSpace &ds,
                       sector_type sector, const dma_type &dma) {
         assert(_ports[idx(drive)]);
+        attach_irq(idx(drive));
         _ports[idx(drive)]->readwrite(prod, tag, ds, sector, dma, false);
     }
     virtual void write(size_t drive, producer_type *prod, tag_type tag, const nre::DataSpace &ds,
                        sector_type sector, const dma_type &dma) {
         assert(_ports[idx(drive)]);
+        attach_irq(idx(drive));
         _ports[idx(drive)]->readwrite(prod, tag, ds, sector, dma, true);
     }
+    virtual void forget(producer_type *prod) {
+        for(size_t i = 0; i < ARRAY_SIZE(_ports); ++i) {
+            if(_ports[i])
+                _ports[i]->forget(prod);
+        }
+    }
 
 private:
     static size_t idx(size_t drive) {
         return drive % nre::Storage::MAX_DRIVES;
     }
+    HostAHCIDevice::Register *port_regs(uint port) const {
+        return port < 30 ? _regs->ports + port : _regs_high + (port - 30);
+    }
     void create_ahci_port(uint nr, HostAHCIDevice::Register *portreg, bool dmar);
+    void attach_irq(uint port) {
+        // the port thread is created lazily on the CPU of the first request
+        if(EXPECT_FALSE(_irqsms[port] == nullptr))
+            create_irq_thread(port);
+    }
+    void create_irq_thread(uint port);
     static void gsi_thread(void*);
+    static void port_thread(void*);
 
+    nre::UserSm _sm;
+    nre::PCI &_pci;
     nre::Gsi *_gsi;
+    bool _msix;
+    nre::Sm *volatile _irqsms[32];
     nre::BDF _bdf;
     uint _hostirq;
     nre::DataSpace *_regs_ds;
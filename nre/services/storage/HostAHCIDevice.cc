@@ -63,59 +63,133 @@ void HostAHCIDevice::init() {
     // nothing in progress anymore
     _inprogress = 0;
 
-    // enable irqs
-    _regs->ie = 0xf98000f1;
+    // enable irqs (including set-device-bits FIS, which finishes queued commands)
+    _regs->ie = 0xf98000f9;
     identify_drive(_bufferds);
     //set_features(0x3, 0x46);
     //set_features(0x2, 0);
     //return identify_drive(buffer);
 }
 
-void HostAHCIDevice::readwrite(Producer<Storage::Packet> *prod, Storage::tag_type tag,
+void HostAHCIDevice::acquire_slots(size_t count) {
+    for(size_t i = 0; i < count; ++i)
+        _slots.down();
+}
+
+void HostAHCIDevice::release_slots(size_t count) {
+    for(size_t i = 0; i < count; ++i)
+        _slots.up();
+}
+
+void HostAHCIDevice::alloc_slot() {
+    uint free = ~_inprogress & ((1ULL << _max_slots) - 1);
+    // the callers make sure that there is always a free slot
+    assert(free != 0);
+    _tag = Math::bit_scan_forward(free);
+}
+
+void HostAHCIDevice::abort_commands() {
+    for(uint busy = _inprogress, tag; busy; busy &= ~(1 << tag)) {
+        tag = Math::bit_scan_forward(busy);
+        LOG(STORAGE, "Aborting operation for user " << fmt(_usertags[tag].tag, "x") << "\n");
+        if(_usertags[tag].prod)
+            _usertags[tag].prod->produce(Storage::Packet(_usertags[tag].tag, E_FAILURE));
+        release_slots(_usertags[tag].slots);
+        _usertags[tag].tag = ~0;
+        _inprogress &= ~(1 << tag);
+    }
+}
+
+void HostAHCIDevice::flush(Completions *prod, Storage::tag_type tag) {
+    // a non-queued command can't be issued while queued commands are in progress. thus, we take
+    // all slots for it, which waits until all queued commands are finished
+    size_t slots = _ncq ? _depth : 1;
+    {
+        ScopedLock<UserSm> guard(&_flushsm);
+        acquire_slots(slots);
+    }
+
+    ScopedLock<UserSm> guard(&_sm);
+    alloc_slot();
+    set_command(has_lba48() ? COMMAND_FLUSH_CACHE_EXT : COMMAND_FLUSH_CACHE, 0, true);
+    start_command(prod, tag, slots);
+}
+
+void HostAHCIDevice::readwrite(Completions *prod, Storage::tag_type tag,
                                const DataSpace &ds, sector_type sector, const dma_type &dma,
                                bool write) {
-    ScopedLock<UserSm> guard(&_sm);
     size_t length = dma.bytecount();
+    size_t count = length / _sector_size;
     // invalid offset or size?
-    if(length >> 13) {
+    if(count == 0 || count > max_sectors()) {
         VTHROW(Exception, E_ARGS_INVALID,
-               "Device " << _id << ": Invalid sector count (" << (length >> 13) << ")");
+               "Device " << _id << ": Invalid sector count (" << count << ")");
     }
-
-    uint8_t command = has_lba48() ? 0x25 : 0xc8;
-    if(write)
-        command = has_lba48() ? 0x35 : 0xca;
-    set_command(command, sector, !write, length >> 13);
-
+    if(dma.count() > MAX_PRD_COUNT)
+        VTHROW(Exception, E_ARGS_INVALID, "Device " << _id << ": Too many DMA descriptors");
     for(auto it = dma.begin(); it != dma.end(); ++it) {
         if(it->offset > ds.size() || it->offset + it->count > ds.size()) {
             VTHROW(Exception, E_ARGS_INVALID,
                    "Device " << _id << ": Invalid offset(" << it->offset <<")/"
                                                << "count(" << it->count << ")");
         }
+    }
+
+    // wait until there is a free slot. this way, we block the client if the queue is full
+    acquire_slots(1);
+
+    ScopedLock<UserSm> guard(&_sm);
+    alloc_slot();
+    if(_ncq) {
+        // for FPDMA, the sector count is in the features register and the tag in the count register
+        uint8_t command = write ? COMMAND_WRITE_FPDMA_QUEUED : COMMAND_READ_FPDMA_QUEUED;
+        set_command(command, sector, !write, _tag << 3, false, 0, count);
+    }
+    else {
+        uint8_t command = has_lba48() ? COMMAND_READ_DMA_EXT : COMMAND_READ_DMA;
+        if(write)
+            command = has_lba48() ? COMMAND_WRITE_DMA_EXT : COMMAND_WRITE_DMA;
+        set_command(command, sector, !write, count);
+    }
+
+    for(auto it = dma.begin(); it != dma.end(); ++it)
         add_dma(ds, it->offset, it->count);
+    start_command(prod, tag, 1, _ncq);
+}
+
+void HostAHCIDevice::forget(Completions *prod) {
+    ScopedLock<UserSm> guard(&_sm);
+    for(size_t i = 0; i < ARRAY_SIZE(_usertags); ++i) {
+        if(_usertags[i].prod == prod)
+            _usertags[i].prod = nullptr;
     }
-    start_command(prod, tag);
 }
 
 void HostAHCIDevice::irq() {
+    ScopedLock<UserSm> guard(&_sm);
     uint32_t is = _regs->is;
 
     // clear interrupt status
     _regs->is = is;
 
-    for(uint done = _inprogress & ~_regs->ci, tag; done; done &= ~(1 << tag)) {
+    // queued commands are finished when the device has cleared the bit in SActive, the others
+    // when the HBA has cleared the bit in CI
+    uint32_t active = _regs->ci | _regs->sact;
+    for(uint done = _inprogress & ~active, tag; done; done &= ~(1 << tag)) {
         tag = nre::Math::bit_scan_forward(done);
         LOG(STORAGE_DETAIL, "Operation for user " << fmt(_usertags[tag].tag, "x") << " is finished\n");
         if(_usertags[tag].prod)
             _usertags[tag].prod->produce(nre::Storage::Packet(_usertags[tag].tag, 0));
 
+        release_slots(_usertags[tag].slots);
         _usertags[tag].tag = ~0;
         _inprogress &= ~(1 << tag);
     }
 
     if((_regs->tfd & 1) && (~_regs->tfd & 0x400)) {
         LOG(STORAGE, "command failed with " << fmt(_regs->tfd, "x") << "\n");
+        // the port is reset, so that all outstanding commands are lost
+        abort_commands();
         init();
     }
 }
@@ -158,22 +232,26 @@ void HostAHCIDevice::add_prd(const nre::DataSpace &ds, uint bytes) {
     p[3] = bytes - 1;
 }
 
-size_t HostAHCIDevice::start_command(nre::Producer<nre::Storage::Packet> *prod, ulong usertag) {
+size_t HostAHCIDevice::start_command(Completions *prod, ulong usertag,
+                                     size_t slots, bool queued) {
     // remember work in progress commands
     assert(!(_inprogress & (1 << _tag)));
     _inprogress |= 1 << _tag;
     _usertags[_tag].tag = usertag;
     _usertags[_tag].prod = prod;
+    _usertags[_tag].slots = slots;
 
+    // for queued commands, SActive has to be set before the command is issued
+    if(queued)
+        _regs->sact = 1 << _tag;
     _regs->ci = 1 << _tag;
-    size_t res = _tag;
-    _tag = (_tag + 1) % _max_slots;
-    return res;
+    return _tag;
 }
 
 void HostAHCIDevice::identify_drive(nre::DataSpace &buffer) {
     uint16_t *buf = reinterpret_cast<uint16_t*>(buffer.virt());
     memset(reinterpret_cast<void*>(buffer.virt()), 0, 512);
+    alloc_slot();
     set_command(0xec, 0, true);
     add_prd(buffer, 512);
     size_t tag = start_command(nullptr, 0);
@@ -190,6 +268,7 @@ void HostAHCIDevice::identify_drive(nre::DataSpace &buffer) {
 }
 
 uint HostAHCIDevice::set_features(uint features, uint count) {
+    alloc_slot();
     set_command(0xef, 0, false, count, false, 0, features);
     size_t tag = start_command(nullptr, 0);
 
@@ -18,10 +18,10 @@
 #pragma once
 
 #include <mem/DataSpace.h>
-#include <ipc/Producer.h>
 #include <util/Clock.h>
 #include <Assert.h>
 
+#include "Completions.h"
 #include "Device.h"
 
 #define check3(X) { unsigned __res = X; if(__res) return __res; }
@@ -30,7 +30,7 @@
  * A single AHCI port with its command list and receive FIS buffer.
  *
  * State: testing
- * Supports: read-sectors, write-sectors, identify-drive
+ * Supports: read-sectors, write-sectors, identify-drive, native command queuing
  * Missing: ATAPI detection
  */
 class HostAHCIDevice : public Device {
@@ -51,8 +51,10 @@ class HostAHCIDevice : public Device {
     };
 
     struct UserTag {
-        nre::Producer<nre::Storage::Packet> *prod;
+        Completions *prod;
         nre::Storage::tag_type tag;
+        // the number of slots to give back when the command is finished
+        size_t slots;
     };
 
 public:
@@ -102,8 +104,9 @@ public:
         return port->sig;
     }
 
-    explicit HostAHCIDevice(Register *regs, uint disknr, size_t max_slots, bool dmar)
-        : Device(disknr), _sm(), _regs(regs), _clock(FREQ), _max_slots(max_slots), _dmar(dmar),
+    explicit HostAHCIDevice(Register *regs, uint disknr, size_t max_slots, bool ncq, bool dmar)
+        : Device(disknr), _sm(), _flushsm(), _slots(0), _regs(regs), _clock(FREQ),
+          _max_slots(max_slots), _depth(1), _ncq(ncq), _dmar(dmar),
           _bufferds(512, nre::DataSpaceDesc::ANONYMOUS, nre::DataSpaceDesc::RW),
           _clds(max_slots * CL_DWORDS * 4, nre::DataSpaceDesc::ANONYMOUS, nre::DataSpaceDesc::RW),
           _ctds(max_slots * (32 + MAX_PRD_COUNT * 4) * 4,
@@ -114,6 +117,11 @@ public:
           _fis(reinterpret_cast<uint32_t*>(_fisds.virt())),
           _tag(0), _usertags(), _inprogress() {
         init();
+        // use NCQ only if both the HBA and the drive support it
+        _ncq = _ncq && has_ncq();
+        _depth = _ncq ? nre::Math::min<size_t>(_info.queueDepth + 1, _max_slots) : _max_slots;
+        for(size_t i = 0; i < _depth; ++i)
+            _slots.up();
     }
 
     virtual const char *type() const {
@@ -122,14 +130,21 @@ public:
     virtual void determine_capacity() {
         _capacity = has_lba48() ? _info.lba48MaxLBA : _info.userSectorCount;
     }
-
-    void flush(nre::Producer<nre::Storage::Packet> *prod, nre::Storage::tag_type tag) {
-        nre::ScopedLock<nre::UserSm> guard(&_sm);
-        set_command(has_lba48() ? 0xea : 0xe7, 0, true);
-        start_command(prod, tag);
+    virtual size_t max_requests() const {
+        return _depth;
     }
-    void readwrite(nre::Producer<nre::Storage::Packet> *prod, nre::Storage::tag_type tag,
+
+    void flush(Completions *prod, nre::Storage::tag_type tag);
+    void readwrite(Completions *prod, nre::Storage::tag_type tag,
                    const nre::DataSpace &ds, sector_type sector, const dma_type &dma, bool write);
+    void forget(Completions *prod);
+    /**
+     * Acknowledges the interrupt at the port without handling it. This is done by the thread of
+     * a shared interrupt, which lets the port thread do the rest.
+     */
+    void ack_irq() {
+        _regs->is = _regs->is;
+    }
     void irq();
 
     void debug() {
@@ -160,18 +175,28 @@ private:
     }
 
     void init();
+    void acquire_slots(size_t count);
+    void release_slots(size_t count);
+    void alloc_slot();
+    void abort_commands();
     void set_command(uint8_t command, uint64_t sector, bool read, uint count = 0, bool atapi = false,
                      uint pmp = 0, uint features = 0);
     void add_dma(const nre::DataSpace &ds, size_t offset, uint count);
     void add_prd(const nre::DataSpace &ds, uint count);
-    size_t start_command(nre::Producer<nre::Storage::Packet> *prod, ulong usertag);
+    size_t start_command(Completions *prod, ulong usertag, size_t slots = 0,
+                         bool queued = false);
     void identify_drive(nre::DataSpace &buffer);
     uint set_features(uint features, uint count = 0);
 
     nre::UserSm _sm;
+    nre::UserSm _flushsm;
+    // counts the free command slots; blocks the submitters if all slots are busy
+    nre::UserSm _slots;
     Register volatile *_regs;
     nre::Clock _clock;
     size_t _max_slots;
+    size_t _depth;
+    bool _ncq;
     bool _dmar;
     nre::DataSpace _bufferds;
     nre::DataSpace _clds;
@@ -180,7 +205,9 @@ private:
     uint32_t *_cl;
     uint32_t *_ct;
     uint32_t *_fis;
+    // the slot of the command that is currently built
     size_t _tag;
     UserTag _usertags[32];
+    // the bitmap of busy slots
     uint _inprogress;
 };
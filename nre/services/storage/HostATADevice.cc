@@ -86,7 +86,9 @@ void HostATADevice::transferPIO(Operation op, const DataSpace &ds, size_t secsiz
         if(op == WRITE && dma.in(buffer(), secsize, offset, ds))
             VTHROW(Exception, E_ARGS_INVALID, "Device " << _id << ": Unable to copyin data");
         if(offset > 0 || waitfirst) {
-            if(op == READ)
+            // wait for the interrupt of the next sector (the previous transfer has already been
+            // waited for by HostIDECtrl)
+            if(op == READ && offset > 0)
                 _ctrl.wait_ready();
             res = _ctrl.wait_until(PIO_TRANSFER_TIMEOUT, CMD_ST_DRQ, CMD_ST_BUSY);
             _ctrl.handle_status(_id, res, "PIO transfer");
@@ -110,10 +112,7 @@ void HostATADevice::transferPIO(Operation op, const DataSpace &ds, size_t secsiz
 
 void HostATADevice::transferDMA(Operation op, const DataSpace &ds, const dma_type &dma,
                                 producer_type *prod, tag_type tag) {
-    // wait until previous transfers are done
-    ATA_LOGDETAIL("Waiting for previous transfers");
-    _ctrl.wait_ready();
-
+    // note that HostIDECtrl has already waited until the previous transfer is done
     // setup PRDTs
     ATA_LOGDETAIL("Setting PRDs");
     HostIDECtrl::PRD *prd = _ctrl.prdt();
@@ -28,7 +28,8 @@ HostIDECtrl::HostIDECtrl(uint id, uint gsi, Ports::port_t portbase,
       _ctrl(portbase, 9), _ctrlreg(portbase + ATA_REG_CONTROL, 1),
       _bm(dma && bmportbase ? new Ports(bmportbase, bmportcount) : nullptr), _clock(1000), _sm(),
       _gsi(gsi ? new Gsi(gsi) : nullptr),
-      _prdt(Storage::MAX_DMA_DESCS * 8, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW), _devs() {
+      _prdt(Storage::MAX_DMA_DESCS * 8, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW), _devs(),
+      _exec(), _free(MAX_REQUESTS), _pending(0), _rpos(0), _wpos(0), _queue() {
     // check if the bus is empty
     if(!is_bus_responding())
         VTHROW(Exception, E_NOT_FOUND, "Bus " << _id << " is floating");
@@ -54,28 +55,105 @@ HostIDECtrl::HostIDECtrl(uint id, uint gsi, Ports::port_t portbase,
             _devs[j] = nullptr;
         }
     }
+
+    // start the thread that executes the requests
+    if(_devs[0] || _devs[1]) {
+        char name[32];
+        nre::OStringStream os(name, sizeof(name));
+        os << "ide-dispatch-" << _id;
+        GlobalThread *gt = GlobalThread::create(dispatch_thread, CPU::current().log_id(), name);
+        gt->set_tls<HostIDECtrl*>(Thread::TLS_PARAM, this);
+        gt->start();
+    }
 }
 
 void HostIDECtrl::get_params(size_t drive, nre::Storage::Parameter *params) const {
     _devs[idx(drive)]->get_params(params);
 }
 
-void HostIDECtrl::read(size_t drive, producer_type *prod, tag_type tag, const nre::DataSpace &ds,
-                       sector_type sector, const dma_type &dma) {
-    nre::ScopedLock<nre::UserSm> guard(&_sm);
-    _devs[idx(drive)]->readwrite(HostATADevice::READ, ds, sector, dma, prod, tag);
+void HostIDECtrl::enqueue(RequestType type, size_t drive, producer_type *prod, tag_type tag,
+                          const nre::DataSpace *ds, sector_type sector, const dma_type *dma) {
+    // block the client if the queue is full
+    _free.down();
+    {
+        nre::ScopedLock<nre::UserSm> guard(&_sm);
+        Request &req = _queue[_wpos];
+        req.type = type;
+        req.drive = drive;
+        req.prod = prod;
+        req.tag = tag;
+        req.ds = ds;
+        req.sector = sector;
+        if(dma)
+            req.dma = *dma;
+        else
+            req.dma.clear();
+        _wpos = (_wpos + 1) % MAX_REQUESTS;
+    }
+    _pending.up();
 }
 
-void HostIDECtrl::write(size_t drive, producer_type *prod, tag_type tag, const nre::DataSpace &ds,
-                        sector_type sector, const dma_type &dma) {
+void HostIDECtrl::forget(producer_type *prod) {
+    // wait until the current request has been started, because it uses the producer and dataspace
+    nre::ScopedLock<nre::UserSm> exec(&_exec);
     nre::ScopedLock<nre::UserSm> guard(&_sm);
-    _devs[idx(drive)]->readwrite(HostATADevice::WRITE, ds, sector, dma, prod, tag);
+    for(size_t i = 0; i < MAX_REQUESTS; ++i) {
+        if(_queue[i].prod == prod) {
+            _queue[i].prod = nullptr;
+            _queue[i].ds = nullptr;
+        }
+    }
+    // don't report the completion of a running transfer
+    if(_tag.prod == prod)
+        _tag.prod = nullptr;
 }
 
-void HostIDECtrl::flush(size_t drive, producer_type *prod, tag_type tag) {
-    nre::ScopedLock<nre::UserSm> guard(&_sm);
-    _devs[idx(drive)]->flush_cache();
-    prod->produce(nre::Storage::Packet(tag, 0));
+void HostIDECtrl::execute(const Request &req) {
+    HostATADevice *dev = _devs[idx(req.drive)];
+    // the previous transfer has to be finished first. this is the only place where we wait for it
+    wait_ready();
+    switch(req.type) {
+        case REQ_READ:
+            dev->readwrite(HostATADevice::READ, *req.ds, req.sector, req.dma, req.prod, req.tag);
+            break;
+        case REQ_WRITE:
+            dev->readwrite(HostATADevice::WRITE, *req.ds, req.sector, req.dma, req.prod, req.tag);
+            break;
+        case REQ_FLUSH:
+            dev->flush_cache();
+            req.prod->produce(nre::Storage::Packet(req.tag, 0));
+            break;
+    }
+}
+
+void HostIDECtrl::dispatch_thread(void *) {
+    HostIDECtrl *ctrl = Thread::current()->get_tls<HostIDECtrl*>(Thread::TLS_PARAM);
+    while(1) {
+        ctrl->_pending.down();
+
+        nre::ScopedLock<nre::UserSm> exec(&ctrl->_exec);
+        Request req;
+        {
+            nre::ScopedLock<nre::UserSm> guard(&ctrl->_sm);
+            req = ctrl->_queue[ctrl->_rpos];
+            ctrl->_rpos = (ctrl->_rpos + 1) % MAX_REQUESTS;
+        }
+        ctrl->_free.up();
+
+        // the session has been destroyed in the meantime
+        if(!req.prod)
+            continue;
+
+        // the command is started here and the next one will wait until the channel is idle again
+        try {
+            ctrl->execute(req);
+        }
+        catch(const Exception &e) {
+            ATA_LOG("Request " << fmt(req.tag, "#x") << " failed: " << e.msg());
+            ctrl->stop_transfer();
+            req.prod->produce(nre::Storage::Packet(req.tag, e.code()));
+        }
+    }
 }
 
 HostATADevice *HostIDECtrl::detect_drive(uint id) {
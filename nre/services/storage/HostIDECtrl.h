@@ -28,14 +28,39 @@
 
 class HostATADevice;
 
+/**
+ * A driver for one channel of an IDE controller. The requests are put into a queue and are
+ * executed one after another by a dispatcher thread, so that read(), write() and flush() return
+ * immediately. The completions are reported via the producer of the request.
+ */
 class HostIDECtrl : public Controller {
     struct UserTag {
-        nre::Producer<nre::Storage::Packet> *prod;
+        Completions *prod;
         nre::Storage::tag_type tag;
         bool dma;
     };
 
+    enum RequestType {
+        REQ_READ,
+        REQ_WRITE,
+        REQ_FLUSH
+    };
+
+    struct Request {
+        RequestType type;
+        size_t drive;
+        producer_type *prod;
+        tag_type tag;
+        const nre::DataSpace *ds;
+        sector_type sector;
+        dma_type dma;
+    };
+
 public:
+    // the requests of all sessions for both drives are queued here. the drives handle only one at
+    // a time, which is what they report as max_requests.
+    static const size_t MAX_REQUESTS    = 32;
+
     // physical region descriptor
     struct PRD {
         uint32_t buffer;
@@ -58,11 +83,18 @@ public:
     }
 
     virtual void get_params(size_t drive, nre::Storage::Parameter *params) const;
-    virtual void flush(size_t drive, producer_type *prod, tag_type tag);
+    virtual void flush(size_t drive, producer_type *prod, tag_type tag) {
+        enqueue(REQ_FLUSH, drive, prod, tag, nullptr, 0, nullptr);
+    }
     virtual void read(size_t drive, producer_type *prod, tag_type tag, const nre::DataSpace &ds,
-                      sector_type sector, const dma_type &dma);
+                      sector_type sector, const dma_type &dma) {
+        enqueue(REQ_READ, drive, prod, tag, &ds, sector, &dma);
+    }
     virtual void write(size_t drive, producer_type *prod, tag_type tag, const nre::DataSpace &ds,
-                       sector_type sector, const dma_type &dma);
+                       sector_type sector, const dma_type &dma) {
+        enqueue(REQ_WRITE, drive, prod, tag, &ds, sector, &dma);
+    }
+    virtual void forget(producer_type *prod);
 
     /**
      * @return whether DMA should and can be used
@@ -203,6 +235,10 @@ private:
     bool is_bus_responding();
     HostATADevice *detect_drive(uint id);
     HostATADevice *identify(uint id, uint cmd);
+    void enqueue(RequestType type, size_t drive, producer_type *prod, tag_type tag,
+                 const nre::DataSpace *ds, sector_type sector, const dma_type *dma);
+    void execute(const Request &req);
+    static void dispatch_thread(void *);
 
     static void gsi_thread(void *) {
         HostIDECtrl *ctrl = nre::Thread::current()->get_tls<HostIDECtrl*>(nre::Thread::TLS_PARAM);
@@ -219,16 +255,18 @@ private:
                 ctrl->inbmrb(BMR_REG_STATUS);
                 ctrl->outbmrb(BMR_REG_COMMAND, 0);
             }
-            if(ctrl->_tag.prod)
-                ctrl->_tag.prod->produce(nre::Storage::Packet(ctrl->_tag.tag, status));
-            ctrl->_ready.up();
+            {
+                // forget() might remove the producer concurrently
+                nre::ScopedLock<nre::UserSm> guard(&ctrl->_sm);
+                if(ctrl->_tag.prod)
+                    ctrl->_tag.prod->produce(nre::Storage::Packet(ctrl->_tag.tag, status));
+                // just in case we receive another interrupt
+                ctrl->_tag.prod = nullptr;
+                ctrl->_tag.dma = false;
+            }
+            // the transfer is finished before we let the next one start
             ctrl->_in_progress = false;
-            // just in case we receive another interrupt
-            // TODO this is not enough. we have to use the session-id and check whether the session
-            // still exists. because the user might have closed it between a transfer-start and
-            // the completion
-            ctrl->_tag.prod = nullptr;
-            ctrl->_tag.dma = false;
+            ctrl->_ready.up();
         }
     }
 
@@ -245,4 +283,12 @@ private:
     nre::DataSpace _prdt;
     UserTag _tag;
     HostATADevice *_devs[2];
+    // the request queue; _free counts the free slots and _pending the queued requests. _exec is
+    // held by the dispatcher while it executes a request
+    nre::UserSm _exec;
+    nre::UserSm _free;
+    nre::Sm _pending;
+    size_t _rpos;
+    size_t _wpos;
+    Request _queue[MAX_REQUESTS];
 };
@@ -15,14 +15,18 @@
  */
 
 #include <kobj/Sm.h>
-#include <ipc/Producer.h>
+#include <kobj/GlobalThread.h>
+#include <ipc/Consumer.h>
 #include <services/PCIConfig.h>
 #include <services/ACPI.h>
 #include <util/PCI.h>
+#include <stream/OStringStream.h>
+#include <stream/IStringStream.h>
 #include <Logging.h>
 #include <cstring>
 
 #include "ControllerMng.h"
+#include "BlockCache.h"
 
 using namespace nre;
 
@@ -32,16 +36,39 @@ class StorageService;
 // when we put the object here instead of a pointer??
 static ControllerMng *mng;
 static StorageService *srv;
+static BlockCache *cache;
 
 class StorageServiceSession : public ServiceSession {
 public:
     explicit StorageServiceSession(Service *s, size_t id, capsel_t cap, capsel_t caps,
                                    Pt::portal_func func)
-        : ServiceSession(s, id, cap, caps, func), _ctrlds(), _sm(), _prod(), _datads(), _drive() {
+        : ServiceSession(s, id, cap, caps, func), _ctrlds(), _sm(), _doorbell(), _subspace(),
+          _compspace(), _prod(), _subcons(), _stopped(0), _stopping(false), _datads(), _drive(),
+          _cached() {
     }
     virtual ~StorageServiceSession() {
+        if(_subcons) {
+            // let the submission thread finish, because it uses our members. it might wait for
+            // free slots in the completion ring, so wake it up in this case as well.
+            _stopping = true;
+            _subcons->stop();
+            try {
+                _compspace->up();
+            }
+            catch(...) {
+            }
+            _stopped.down();
+        }
+        if(cache && _prod)
+            cache->forget(_prod);
+        if(_prod)
+            mng->get(ctrl())->forget(_prod);
+        delete _subcons;
         delete _ctrlds;
         delete _sm;
+        delete _doorbell;
+        delete _subspace;
+        delete _compspace;
         delete _prod;
         delete _datads;
     }
@@ -61,11 +88,23 @@ public:
     const Storage::Parameter &params() const {
         return _params;
     }
-    Producer<Storage::Packet> *prod() {
+    Completions *prod() {
         return _prod;
     }
 
-    void init(DataSpace *ctrlds, DataSpace *data, Sm *sm, size_t drive) {
+    /**
+     * Reserves the slot in the completion ring for a request via portal. In contrast to the
+     * submission ring, we can't wait for the client here, but report it as an error instead.
+     */
+    void reserve() {
+        if(!initialized())
+            throw Exception(E_ARGS_INVALID, "Not initialized");
+        if(!_prod->reserve())
+            throw Exception(E_CAPACITY, "Completion ring is full");
+    }
+
+    void init(DataSpace *ctrlds, DataSpace *data, Sm *sm, Sm *doorbell, Sm *subspace,
+              Sm *compspace, size_t drive) {
         size_t ctrl = drive / Storage::MAX_DRIVES;
         if(!mng->exists(ctrl) || !mng->get(ctrl)->exists(drive)) {
             VTHROW(Exception, E_ARGS_INVALID,
@@ -73,20 +112,162 @@ public:
         }
         if(_ctrlds)
             throw Exception(E_EXISTS, "Already initialized");
+        if(ctrlds->size() < Storage::CTRLDS_SIZE)
+            VTHROW(Exception, E_ARGS_INVALID, "Control dataspace is too small (" << ctrlds->size() << ")");
         _ctrlds = ctrlds;
         _sm = sm;
-        _prod = new Producer<Storage::Packet>(*_ctrlds, *_sm, false);
+        _doorbell = doorbell;
+        _subspace = subspace;
+        _compspace = compspace;
+        _prod = new Completions(*_ctrlds, *_sm, false, 0, Storage::COMPLETION_RING_SIZE);
+        _subcons = new Consumer<Storage::Request>(*_ctrlds, *_doorbell, false,
+                                                  Storage::COMPLETION_RING_SIZE,
+                                                  Storage::SUBMISSION_RING_SIZE, _subspace);
         _datads = data;
         _drive = drive;
         mng->get(ctrl)->get_params(_drive, &_params);
+        _cached = cache && BlockCache::cachable(_params);
+
+        // handle the submission ring on the CPU of the client
+        char name[32];
+        OStringStream os(name, sizeof(name));
+        os << "storage-sq-" << id();
+        GlobalThread *gt = GlobalThread::create(submission_thread, CPU::current().log_id(), name);
+        gt->set_tls<StorageServiceSession*>(Thread::TLS_PARAM, this);
+        gt->start();
+    }
+
+    void flush(Storage::tag_type tag) {
+        if(!initialized())
+            throw Exception(E_ARGS_INVALID, "Not initialized");
+
+        LOG(STORAGE_DETAIL, "[" << id() << "," << fmt(tag, "#x") << "] FLUSH\n");
+        if(_cached)
+            cache->flush(mng->get(ctrl()), _drive, _prod, tag);
+        else
+            mng->get(ctrl())->flush(_drive, _prod, tag);
+    }
+
+    void readwrite(Storage::Command cmd, Storage::tag_type tag, Storage::sector_type sector,
+                   const Storage::dma_type &dma) {
+        if(!initialized())
+            throw Exception(E_ARGS_INVALID, "Not initialized");
+
+        LOG(STORAGE_DETAIL, "[" << id() << "," << fmt(tag, "#x") << "] "
+                                << (cmd == Storage::READ ? "READ" : "WRITE") << " @ " << sector
+                                << " with " << dma << "\n");
+
+        // check offset and size
+        size_t size = dma.bytecount();
+        size_t count = size / _params.sector_size;
+        if(size == 0 || (size & (_params.sector_size - 1)))
+            VTHROW(Exception, E_ARGS_INVALID, "Invalid size (" << size << ")");
+        if(sector >= _params.sectors) {
+            VTHROW(Exception, E_ARGS_INVALID,
+                   "Sector " << sector << " is invalid"
+                             << " (available: 0.." << _params.sectors - 1 << ")");
+        }
+        if(sector + count > _params.sectors) {
+            VTHROW(Exception, E_ARGS_INVALID,
+                   "Sector " << (sector + count - 1) << " is invalid"
+                             << " (available: 0.." << _params.sectors - 1 << ")");
+        }
+
+        if(cmd == Storage::READ) {
+            if(!(_datads->flags() & DataSpaceDesc::R))
+                throw Exception(E_ARGS_INVALID, "Need to read, but no read permission");
+            if(_cached)
+                cache->read(mng->get(ctrl()), _drive, _prod, tag, *_datads, sector, dma);
+            else
+                mng->get(ctrl())->read(_drive, _prod, tag, *_datads, sector, dma);
+        }
+        else {
+            if(!(_datads->flags() & DataSpaceDesc::W))
+                throw Exception(E_ARGS_INVALID, "Need to write, but no write permission");
+            if(_cached)
+                cache->write(mng->get(ctrl()), _drive, _prod, tag, *_datads, sector, dma);
+            else
+                mng->get(ctrl())->write(_drive, _prod, tag, *_datads, sector, dma);
+        }
     }
 
 private:
+    void handle(const Storage::Request &req, const Storage::dma_type &dma) {
+        // every request gets exactly one completion, so that we can't lose one if we reserve the
+        // slot before we start it
+        if(!_prod->reserve_wait(*_compspace, _stopping))
+            return;
+        try {
+            switch(req.cmd) {
+                case Storage::FLUSH:
+                    flush(req.tag);
+                    break;
+
+                case Storage::READ:
+                case Storage::WRITE:
+                    readwrite(req.cmd, req.tag, req.sector, dma);
+                    break;
+
+                default:
+                    VTHROW(Exception, E_ARGS_INVALID, "Invalid command (" << req.cmd << ")");
+                    break;
+            }
+        }
+        catch(const Exception &e) {
+            // there is nobody waiting for a reply, so report it via the completion ring
+            LOG(STORAGE, "[" << id() << "," << fmt(req.tag, "#x") << "] " << e.msg() << "\n");
+            _prod->produce(Storage::Packet(req.tag, e.code()));
+        }
+    }
+
+    static void submission_thread(void*) {
+        StorageServiceSession *sess = Thread::current()->get_tls<StorageServiceSession*>(Thread::TLS_PARAM);
+        Consumer<Storage::Request> *cons = sess->_subcons;
+        // we block until the client signals that there are new requests and handle all requests
+        // in the ring afterwards. the client does only notify us if we're sleeping, so that no
+        // system calls are necessary as long as we're still busy.
+        for(size_t n; (n = cons->get_batch()) > 0; ) {
+            for(size_t i = 0; i < n; ++i) {
+                // copy it out of the ring to prevent the client from changing it while we use it.
+                // the client publishes all slots of a request at once, so that they are all there.
+                Storage::Request copy = *cons->item(i);
+                size_t chained = Math::min<size_t>(copy.chained, n - i - 1);
+                Storage::dma_type dma;
+                append(dma, copy.dma);
+                for(size_t j = 0; j < chained; ++j) {
+                    Storage::Request cont = *cons->item(++i);
+                    append(dma, cont.dma);
+                }
+                sess->handle(copy, dma);
+            }
+            cons->next(n);
+        }
+        sess->_stopped.up();
+    }
+
+    static void append(Storage::dma_type &dma, const Storage::ring_dma_type &ringdma) {
+        // ignore invalid lists
+        if(ringdma.count() > Storage::MAX_RING_DMA_DESCS)
+            return;
+        for(Storage::ring_dma_type::iterator it = ringdma.begin(); it != ringdma.end(); ++it) {
+            if(dma.count() == Storage::MAX_DMA_DESCS)
+                break;
+            dma.push(*it);
+        }
+    }
+
     DataSpace *_ctrlds;
     Sm *_sm;
-    Producer<Storage::Packet> *_prod;
+    Sm *_doorbell;
+    Sm *_subspace;
+    Sm *_compspace;
+    Completions *_prod;
+    Consumer<Storage::Request> *_subcons;
+    Sm _stopped;
+    volatile bool _stopping;
     DataSpace *_datads;
     size_t _drive;
+    bool _cached;
     Storage::Parameter _params;
 };
 
@@ -94,11 +275,11 @@ class StorageService : public Service {
 public:
     explicit StorageService(const char *name)
         : Service(name, CPUSet(CPUSet::ALL), portal) {
-        // we want to accept two dataspaces
+        // we want to accept two dataspaces and four semaphores
         for(auto it = CPU::begin(); it != CPU::end(); ++it) {
             LocalThread *ec = get_thread(it->log_id());
             UtcbFrameRef uf(ec->utcb());
-            uf.accept_delegates(2);
+            uf.accept_delegates(3);
         }
     }
 
@@ -123,21 +304,42 @@ void StorageService::portal(capsel_t pid) {
                 capsel_t ctrlsel = uf.get_delegated(0).offset();
                 capsel_t datasel = uf.get_delegated(0).offset();
                 capsel_t smsel = uf.get_delegated(0).offset();
+                capsel_t doorbellsel = uf.get_delegated(0).offset();
+                capsel_t subspacesel = uf.get_delegated(0).offset();
+                capsel_t compspacesel = uf.get_delegated(0).offset();
                 size_t drive;
                 uf >> drive;
                 uf.finish_input();
-                sess->init(new DataSpace(ctrlsel), new DataSpace(datasel), new Sm(smsel, false), drive);
+                sess->init(new DataSpace(ctrlsel), new DataSpace(datasel), new Sm(smsel, false),
+                           new Sm(doorbellsel, false), new Sm(subspacesel, false),
+                           new Sm(compspacesel, false), drive);
                 uf.accept_delegates();
                 uf << E_SUCCESS << sess->params();
             }
             break;
 
+            case Storage::CACHE_STATS: {
+                uf.finish_input();
+                Storage::CacheStats stats;
+                memset(&stats, 0, sizeof(stats));
+                if(cache)
+                    cache->get_stats(&stats);
+                uf << E_SUCCESS << stats;
+            }
+            break;
+
             case Storage::FLUSH: {
                 Storage::tag_type tag;
                 uf >> tag;
                 uf.finish_input();
-                LOG(STORAGE_DETAIL, "[" << sess->id() << "," << fmt(tag, "#x") << "] FLUSH\n");
-                mng->get(sess->ctrl())->flush(sess->drive(), sess->prod(), tag);
+                sess->reserve();
+                try {
+                    sess->flush(tag);
+                }
+                catch(...) {
+                    sess->prod()->cancel();
+                    throw;
+                }
                 uf << E_SUCCESS;
             }
             break;
@@ -149,41 +351,13 @@ void StorageService::portal(capsel_t pid) {
                 DMADescList<Storage::MAX_DMA_DESCS> dma;
                 uf >> tag >> sector >> dma;
                 uf.finish_input();
-
-                if(!sess->initialized())
-                    throw Exception(E_ARGS_INVALID, "Not initialized");
-
-                LOG(STORAGE_DETAIL, "[" << sess->id() << "," << fmt(tag, "#x") << "] "
-                                        << (cmd == Storage::READ ? "READ" : "WRITE") << " @ " << sector
-                                        << " with " << dma << "\n");
-
-                // check offset and size
-                size_t size = dma.bytecount();
-                size_t count = size / sess->params().sector_size;
-                if(size == 0 || (size & (sess->params().sector_size - 1)))
-                    VTHROW(Exception, E_ARGS_INVALID, "Invalid size (" << size << ")");
-                if(sector >= sess->params().sectors) {
-                    VTHROW(Exception, E_ARGS_INVALID,
-                           "Sector " << sector << " is invalid"
-                                     << " (available: 0.." << sess->params().sectors - 1 << ")");
+                sess->reserve();
+                try {
+                    sess->readwrite(cmd, tag, sector, dma);
                 }
-                if(sector + count > sess->params().sectors) {
-                    VTHROW(Exception, E_ARGS_INVALID,
-                           "Sector " << (sector + count - 1) << " is invalid"
-                                     << " (available: 0.." << sess->params().sectors - 1 << ")");
-                }
-
-                if(cmd == Storage::READ) {
-                    if(!(sess->data().flags() & DataSpaceDesc::R))
-                        throw Exception(E_ARGS_INVALID, "Need to read, but no read permission");
-                    mng->get(sess->ctrl())->read(sess->drive(), sess->prod(), tag,
-                                                 sess->data(), sector, dma);
-                }
-                else {
-                    if(!(sess->data().flags() & DataSpaceDesc::W))
-                        throw Exception(E_ARGS_INVALID, "Need to write, but no write permission");
-                    mng->get(sess->ctrl())->write(sess->drive(), sess->prod(), tag, sess->data(), sector,
-                                                  dma);
+                catch(...) {
+                    sess->prod()->cancel();
+                    throw;
                 }
                 uf << E_SUCCESS;
             }
@@ -204,6 +378,15 @@ int main(int argc, char *argv[]) {
             LOG(STORAGE, "Disabling DMA for IDE devices\n");
             idedma = false;
         }
+        else if(strncmp(argv[i], "cache=", 6) == 0) {
+            // the size is given in KiB
+            size_t size = IStringStream::read_from<size_t>(argv[i] + 6, strlen(argv[i] + 6)) * 1024;
+            size_t blocks = size / BlockCache::BLOCK_SIZE;
+            if(blocks > 0) {
+                LOG(STORAGE, "Using a block cache with " << blocks << " blocks\n");
+                cache = new BlockCache(blocks);
+            }
+        }
     }
 
     mng = new ControllerMng(idedma);
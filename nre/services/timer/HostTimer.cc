@@ -19,6 +19,7 @@
 #include <kobj/Sc.h>
 #include <stream/Serial.h>
 #include <util/Date.h>
+#include <util/ScopedLock.h>
 #include <util/Topology.h>
 #include <Logging.h>
 
@@ -30,13 +31,27 @@ using namespace nre;
 
 void HostTimer::ClientData::init(size_t _sid, cpu_t cpuno, HostTimer::PerCpu *per_cpu) {
     sm = new nre::Sm(0);
-    nr = per_cpu->abstimeouts.alloc(this);
+    {
+        ScopedLock<UserSm> guard(&per_cpu->sm);
+        nr = per_cpu->abstimeouts.alloc(this);
+    }
     cpu = cpuno;
     sid = _sid;
 }
 
+void HostTimer::ClientData::destroy(HostTimer::PerCpu *per_cpu) {
+    {
+        ScopedLock<UserSm> guard(&per_cpu->sm);
+        per_cpu->abstimeouts.dealloc(nr, true);
+    }
+    delete sm;
+    sm = nullptr;
+}
+
 HostTimer::HostTimer(bool force_pit, bool force_hpet_legacy, bool slow_rtc)
-    : _clocks_per_tick(0), _timer(), _rtc(), _clock(Timer::WALLCLOCK_FREQ), _per_cpu(), _xcpu_up(0) {
+    : _clocks_per_tick(0), _timer(), _rtc(), _clock(Timer::WALLCLOCK_FREQ),
+      _clockds(ExecEnv::PAGE_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW),
+      _clockinfo(reinterpret_cast<Timer::ClockInfo*>(_clockds.virt())), _per_cpu(), _xcpu_up(0) {
     if(!force_pit) {
         try {
             _timer = new HostHPET(force_hpet_legacy);
@@ -67,6 +82,13 @@ HostTimer::HostTimer(bool force_pit, bool force_hpet_legacy, bool slow_rtc)
 
     _timer->start(Math::muldiv128(msecs, _timer->freq(), Timer::WALLCLOCK_FREQ));
 
+    _clockinfo->seq = 0;
+    _clockinfo->clocks_per_tick = _clocks_per_tick;
+    _clockinfo->cpt_res = CPT_RES;
+    _clockinfo->timer_freq = _timer->freq();
+    _clockinfo->tsc_freq = _clock.source_freq();
+    update_clock();
+
     // Initialize per cpu data structure
     _per_cpu = new PerCpu *[CPU::count()];
     for(auto it = CPU::begin(); it != CPU::end(); ++it)
@@ -142,6 +164,20 @@ HostTimer::HostTimer(bool force_pit, bool force_hpet_legacy, bool slow_rtc)
     LOG(TIMER_DETAIL, "TIMER: Initialized!\n");
 }
 
+void HostTimer::update_clock() {
+    // if somebody else is updating it at the moment, we don't need to do that as well
+    uint32_t seq = _clockinfo->seq;
+    if((seq & 1) || !Atomic::cmpnswap(&_clockinfo->seq, seq, seq + 1))
+        return;
+    Sync::memory_barrier();
+
+    _clockinfo->tsc_base = Util::tsc();
+    _clockinfo->ticks_base = _timer->current_ticks();
+
+    Sync::memory_barrier();
+    _clockinfo->seq = seq + 2;
+}
+
 bool HostTimer::per_cpu_handle_xcpu(PerCpu *per_cpu) {
     bool reprogram = false;
 
@@ -189,17 +225,16 @@ bool HostTimer::per_cpu_client_request(PerCpu *per_cpu, ClientData *data) {
 
 // Returns the next timeout.
 timevalue_t HostTimer::handle_expired_timers(PerCpu *per_cpu, timevalue_t now) {
-    ClientData *data;
-    uint nr;
-    while((nr = per_cpu->abstimeouts.trigger(now, &data))) {
-        assert(data);
-        per_cpu->abstimeouts.cancel(nr);
-        Atomic::add(&data->count, 1U);
-        data->sm->up();
-    }
+    per_cpu->abstimeouts.expire(now, expired);
     return per_cpu->abstimeouts.timeout();
 }
 
+void HostTimer::expired(size_t, ClientData *data) {
+    assert(data);
+    Atomic::add(&data->count, 1U);
+    data->sm->up();
+}
+
 void HostTimer::portal_per_cpu(capsel_t) {
     HostTimer *ht = Thread::current()->get_tls<HostTimer*>(Thread::TLS_PARAM);
     cpu_t cpu = CPU::current().log_id();
@@ -209,6 +244,7 @@ void HostTimer::portal_per_cpu(capsel_t) {
     WorkerMessage m;
     uf >> m;
     bool reprogram = false;
+    ScopedLock<UserSm> guard(&per_cpu->sm);
 
     // We jump here if we were to late with timer
     // programming. reprogram stays true.
@@ -222,6 +258,8 @@ again:
             break;
         case WorkerMessage::TIMER_IRQ: {
             timevalue_t now = ht->_timer->update_ticks(false);
+            // use the opportunity to correct the drift of the clock page
+            ht->update_clock();
             ht->handle_expired_timers(per_cpu, now);
             reprogram = true;
             break;
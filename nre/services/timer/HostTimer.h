@@ -21,6 +21,8 @@
 #include <kobj/LocalThread.h>
 #include <kobj/Pt.h>
 #include <kobj/Sm.h>
+#include <kobj/UserSm.h>
+#include <mem/DataSpace.h>
 #include <services/Timer.h>
 #include <util/TimeoutList.h>
 
@@ -31,7 +33,6 @@ class HostTimer {
     struct PerCpu;
 
 public:
-    static const size_t MAX_CLIENTS = 64;
     // Resolution of our TSC clocks per HPET clock measurement. Lower
     // resolution mean larger error in HPET counter estimation.
     static const uint CPT_RES           = /* 1 divided by */ (1U << 13); /* clocks per hpet tick */
@@ -54,6 +55,7 @@ public:
         }
 
         void init(size_t sid, cpu_t cpu, HostTimer::PerCpu *per_cpu);
+        void destroy(HostTimer::PerCpu *per_cpu);
     };
 
 private:
@@ -73,7 +75,9 @@ private:
     struct PerCpu {
         bool has_timer;
         HostTimerDevice::Timer *timer;
-        nre::TimeoutList<MAX_CLIENTS, ClientData> abstimeouts;
+        nre::TimeoutList<ClientData> abstimeouts;
+        // protects abstimeouts against concurrent session creation/destruction
+        nre::UserSm sm;
 
         nre::LocalThread *ec;
         nre::Pt worker_pt;
@@ -89,7 +93,7 @@ private:
         size_t slot_count; // with this many entries
 
         explicit PerCpu(HostTimer *ht, cpu_t cpu)
-            : has_timer(false), timer(0), abstimeouts(), ec(nre::LocalThread::create(cpu)),
+            : has_timer(false), timer(0), abstimeouts(), sm(), ec(nre::LocalThread::create(cpu)),
               worker_pt(ec, portal_per_cpu), xcpu_sm(0), last_to(~0ULL), remote_sm(),
               remote_slot(), slots(), slot_count() {
             ec->set_tls(nre::Thread::TLS_PARAM, ht);
@@ -102,6 +106,9 @@ public:
     void setup_clientdata(size_t sid, ClientData *data, cpu_t cpu) {
         data->init(sid, cpu, _per_cpu[cpu]);
     }
+    void destroy_clientdata(ClientData *data) {
+        data->destroy(_per_cpu[data->cpu]);
+    }
 
     void program_timer(ClientData *data, timevalue_t time) {
         data->abstimeout = time;
@@ -119,6 +126,13 @@ public:
         unixts = nre::Math::muldiv128(ticks, nre::Timer::WALLCLOCK_FREQ, _timer->freq());
     }
 
+    /**
+     * @return the capability for the clock page, with read permissions only
+     */
+    nre::Crd clock_cap() const {
+        return _clockds.crd(nre::DataSpaceDesc::R);
+    }
+
 private:
     /**
      * Convert an absolute TSC value into an absolute time counter value. Call only from
@@ -132,9 +146,11 @@ private:
         return diff + _timer->current_ticks();
     }
 
+    void update_clock();
     bool per_cpu_handle_xcpu(PerCpu *per_cpu);
     bool per_cpu_client_request(PerCpu *per_cpu, ClientData *data);
     timevalue_t handle_expired_timers(PerCpu *per_cpu, timevalue_t now);
+    static void expired(size_t nr, ClientData *data);
 
     PORTAL static void portal_per_cpu(capsel_t pid);
     NORETURN static void xcpu_wakeup_thread(void *);
@@ -144,6 +160,8 @@ private:
     HostTimerDevice *_timer;
     HostRTC _rtc;
     nre::Clock _clock;
+    nre::DataSpace _clockds;
+    nre::Timer::ClockInfo *_clockinfo;
     PerCpu **_per_cpu;
     nre::Sm _xcpu_up;
 };
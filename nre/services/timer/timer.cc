@@ -35,6 +35,8 @@ public:
             timer->setup_clientdata(id, _data + it->log_id(), it->log_id());
     }
     virtual ~TimerSessionData() {
+        for(auto it = CPU::begin(); it != CPU::end(); ++it)
+            timer->destroy_clientdata(_data + it->log_id());
         delete[] _data;
     }
 
@@ -104,6 +106,13 @@ PORTAL static void portal_timer(capsel_t pid) {
                 uf << E_SUCCESS << uptime << unixts;
             }
             break;
+
+            case nre::Timer::GET_CLOCK:
+                uf.finish_input();
+
+                uf.delegate(timer->clock_cap());
+                uf << E_SUCCESS;
+                break;
         }
     }
     catch(const Exception &e) {